@@ -0,0 +1,803 @@
+/*---------------------.
+| batchMode.cpp         \______________________________
+|                                                      \
+| See the header of batchMode.h for details.           |
+\_____________________________________________________*/
+
+#include "batchMode.h"
+#include "splatterBoardManip.h"
+#include "pngRows.h"
+#include "taskScheduler.h"
+
+#include <qapplication.h>
+#include <qdatetime.h>
+#include <qdir.h>
+#include <qfileinfo.h>
+#include <qstringlist.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+
+ /*
+ | The filters which may be named in a recipe.
+*/
+enum batchOperation { opConvolute, opFade, opIntensify, opInvert, opBoxBlur,
+                      opKernel };
+
+struct batchFilter {
+  const char      *name;
+  batchOperation   operation;
+  convolutionType  type;
+};
+
+static const batchFilter batchFilters[] = {
+  { "invert",      opInvert,    fade        },
+  { "fade",        opFade,      fade        },
+  { "intensify",   opIntensify, intensify   },
+  { "blur",        opConvolute, blur        },
+  { "tent",        opBoxBlur,   blur        },
+  { "kernel",      opKernel,    fade        },
+  { "sharpen",     opConvolute, sharpen     },
+  { "lapOfGauss",  opConvolute, lapOfGauss  },
+  { "edgeDetectX", opConvolute, edgeDetectX },
+  { "edgeDetectY", opConvolute, edgeDetectY },
+  { "sobel",       opConvolute, sobel       },
+  { "laplacian",   opConvolute, laplacian   },
+  { "laplacian2",  opConvolute, laplacian2  } };
+const int batchFilterCount = sizeof(batchFilters) / sizeof(batchFilters[0]);
+
+ /*
+ | One step of a recipe: a filter, and what is given after its name: the
+ | radius, as in "blur:8" (a box blur of radius 8) or "tent:8" (two such
+ | passes), or the kernel file, as in "kernel:emboss.txt".
+*/
+struct batchStep {
+  const batchFilter *filter;
+  int                radius;
+  ConvolutionKernel  kernel;
+};
+
+ /*
+ | The settings from the command line which apply to every step.
+*/
+struct batchSettings {
+  int               fadeDegree;
+  convolutionEngine engine;
+  kernelMethod      method;
+  bool              fused;
+  bool              stream;
+};
+
+ /*
+ | Return the filter with the given name (ignoring case), or 0 if none.
+*/
+static const batchFilter *findFilter( const QString &name ) {
+  for ( int i = 0; i < batchFilterCount; i++ )
+    if ( name.lower() == QString(batchFilters[i].name).lower() )
+      return &batchFilters[i];
+  return 0;
+}
+
+ /*
+ | Print the command line usage, and the filters which may be used.
+*/
+static void printUsage( const char *program ) {
+  fprintf( stderr,
+    "usage: %s --apply <filter>[:<radius>][,...] [--fade-degree <n>]\n"
+    "       %*s [--engine scalar|simd|fixed] [--threads <n>] [--fused]\n"
+    "       %*s [--stream] [--trace <file>]\n"
+    "       %*s [--kernel-method auto|direct|separable|fft]\n"
+    "       %*s <input> <output> [<input> <output> ...]\n"
+    "   or: %s --apply <filter>[:<radius>][,...] [options]\n"
+    "       %*s --input-dir <dir> --output-dir <dir>\n"
+    "filters:", program, (int)strlen(program), "", (int)strlen(program), "",
+    (int)strlen(program), "", (int)strlen(program), "", program,
+    (int)strlen(program), "" );
+  for ( int i = 0; i < batchFilterCount; i++ )
+    fprintf( stderr, " %s", batchFilters[i].name );
+  fprintf( stderr, " (kernel:<file> applies the matrix in the file)\n" );
+}
+
+ /*
+ | Return the QImage format name to save the given file name with.
+*/
+static QString formatForFile( const QString &filename ) {
+  QString format = QFileInfo( filename ).extension( FALSE ).upper();
+  if ( format == "JPG" ) format = "JPEG";
+  return format;
+}
+
+ /*
+ | Apply the given step to the image.  A blur with a radius above 1 is a box
+ | blur of that radius, rather than the 3x3 blur matrix.
+*/
+static void applyStep( QImage &image, const batchStep &step,
+                       const batchSettings &settings ) {
+  switch ( step.filter->operation ) {
+    case opConvolute :
+      if ( step.filter->type == blur && step.radius > 1 )
+        boxBlurImage( image, step.radius );
+      else
+        convoluteImage( image, step.filter->type, settings.engine );
+      break;
+    case opFade      : fadeImage( image, settings.fadeDegree );      break;
+    case opIntensify : intensifyImage( image, settings.fadeDegree ); break;
+    case opInvert    : invertImage( image );                         break;
+    case opBoxBlur   : boxBlurImage( image, step.radius, 2 );        break;
+    case opKernel    :
+      convoluteKernelImage( image, step.kernel, settings.method );
+      break;
+  }
+}
+
+ /*
+ | Return the name to report the step's time under.
+*/
+static QString stepName( const batchStep &step, const QImage &image,
+                         const batchSettings &settings ) {
+  QString name = step.filter->name;
+  if ( step.filter->operation == opKernel ) {
+    kernelMethod method = settings.method;
+    if ( method == methodAuto )
+      method = imageKernelMethod( ImageRows( 0, image.width(),
+                                             image.height(), 0 ),
+                                  step.kernel.matrix(), step.kernel.size );
+    name = QString("kernel %1x%1 %2").arg( step.kernel.size )
+                                     .arg( kernelMethodName( method ) );
+  } else if ( step.radius > 1 )
+    name += QString(":%1").arg( step.radius );
+  return name;
+}
+
+ /*
+ | Append the step to the chain, if it is one a FilterChain can run.
+*/
+static bool addToChain( FilterChain &chain, const batchStep &step,
+                        const batchSettings &settings ) {
+  switch ( step.filter->operation ) {
+    case opConvolute :
+      if ( step.filter->type == blur && step.radius > 1 ) return false;
+      chain.addConvolution( step.filter->type );
+      return true;
+    case opFade      : chain.addFade( settings.fadeDegree );      return true;
+    case opIntensify : chain.addIntensify( settings.fadeDegree ); return true;
+    case opInvert    : chain.addInvert();                         return true;
+    default          : return false;
+  }
+}
+
+ /*
+ | Print the time a stage took.
+*/
+static void printStage( const QString &name, const int elapsed,
+                        const double megapixels ) {
+  if ( elapsed > 0 )
+    printf( "  %-12s %8d ms  %8.2f MP/s\n", name.latin1(), elapsed,
+            megapixels * 1000.0 / elapsed );
+  else
+    printf( "  %-12s %8d ms\n", name.latin1(), elapsed );
+}
+
+ /*
+ | Load one image, run the recipe over it and save it, reporting the wall time
+ | of every stage.  Return false if the image could not be loaded or saved.
+*/
+static bool processImage( const QString &input, const QString &output,
+                          const QValueList<batchStep> &recipe,
+                          const batchSettings &settings ) {
+  QImage image;
+  QTime  total, stage;
+  total.start();
+
+  stage.start();
+  {
+    StageTimer timer( "load" );
+    if ( !image.load( input ) ) {
+      fprintf( stderr, "%s: could not load image\n", input.latin1() );
+      return false;
+    }
+    image = image.convertDepth( 32 );
+  }
+  int loadTime = stage.elapsed();
+
+  double megapixels = image.width() * image.height() / 1000000.0;
+  printf( "%s -> %s  (%dx%d, %.2f MP)\n", input.latin1(), output.latin1(),
+          image.width(), image.height(), megapixels );
+  printf( "  %-12s %8d ms\n", "load", loadTime );
+
+   // with --fused, each run of steps which a FilterChain can take is run
+   // as one chain
+  QValueList<batchStep>::ConstIterator it = recipe.begin();
+  while ( it != recipe.end() ) {
+    FilterChain chain;
+    if ( settings.fused )
+      while ( it != recipe.end() && addToChain( chain, *it, settings ) )
+        ++it;
+
+    if ( !chain.isEmpty() ) {
+      stage.start();
+      {
+        StageTimer timer( "chain" );
+        runChainImage( image, chain, settings.engine );
+      }
+      printStage( QString("chain of %1").arg( chain.count() ), stage.elapsed(),
+                  megapixels );
+    } else {
+      QString name = stepName( *it, image, settings );
+      stage.start();
+      {
+        StageTimer timer( "step" );
+        applyStep( image, *it, settings );
+      }
+      printStage( name, stage.elapsed(), megapixels );
+      ++it;
+    }
+  }
+
+  stage.start();
+  {
+    StageTimer timer( "save" );
+    if ( !image.save( output, formatForFile( output ).latin1() ) ) {
+      fprintf( stderr, "%s: could not save image\n", output.latin1() );
+      return false;
+    }
+  }
+  printf( "  %-12s %8d ms\n", "save", stage.elapsed() );
+  printf( "  %-12s %8d ms\n", "total", total.elapsed() );
+  return true;
+}
+
+ /*
+ | Return the step as a filter of tiles (or bands of rows), made with new.
+*/
+static TileFilter *stepFilter( const batchStep &step,
+                               const batchSettings &settings ) {
+  switch ( step.filter->operation ) {
+    case opConvolute :
+      if ( step.filter->type == blur && step.radius > 1 )
+        return new BoxBlurTileFilter( step.radius, 1 );
+      return new ConvoluteTileFilter( step.filter->type, settings.engine );
+    case opFade      :
+      return new PointTileFilter( fadeTable( settings.fadeDegree ) );
+    case opIntensify :
+      return new PointTileFilter( intensifyTable( settings.fadeDegree ) );
+    case opInvert    : return new PointTileFilter( invertTable() );
+    case opBoxBlur   : return new BoxBlurTileFilter( step.radius, 2 );
+    case opKernel    : return new KernelTileFilter( step.kernel,
+                                                    settings.method );
+  }
+  return 0;
+}
+
+ /*
+ | The recipe as filters of tiles (or bands of rows): each step, or with
+ | --fused, each run of steps a FilterChain can take.  The filters (and the
+ | chains they run) go with it.
+*/
+struct recipeFilters {
+  std::vector<FilterChain*> chains;
+  std::vector<TileFilter*>  filters;
+
+  recipeFilters( const QValueList<batchStep> &recipe,
+                 const batchSettings &settings );
+  ~recipeFilters();
+};
+
+recipeFilters::recipeFilters( const QValueList<batchStep> &recipe,
+                              const batchSettings &settings ) {
+  QValueList<batchStep>::ConstIterator it = recipe.begin();
+  while ( it != recipe.end() ) {
+    FilterChain *chain = new FilterChain;
+    if ( settings.fused )
+      while ( it != recipe.end() && addToChain( *chain, *it, settings ) )
+        ++it;
+    if ( !chain->isEmpty() ) {
+      chains.push_back( chain );
+      filters.push_back( new ChainTileFilter( *chain, settings.engine ) );
+    } else {
+      delete chain;
+      filters.push_back( stepFilter( *it, settings ) );
+      ++it;
+    }
+  }
+}
+
+recipeFilters::~recipeFilters() {
+  for (unsigned i=0; i<filters.size(); i++) delete filters[i];
+  for (unsigned i=0; i<chains.size();  i++) delete chains[i];
+}
+
+ /*
+ | Run the recipe over a PNG file a band of rows at a time, straight into the
+ | output file, never holding either image whole: each step (or with --fused,
+ | each run of steps a FilterChain can take) is a RowStream feeding the next,
+ | and the last feeds the PNG writer.  Return false if the image could not be
+ | read or written.
+*/
+static bool streamImage( const QString &input, const QString &output,
+                         const QValueList<batchStep> &recipe,
+                         const batchSettings &settings ) {
+  QTime total;
+  total.start();
+  StageTimer timer( "stream" );
+
+  std::string error;
+  PngReader reader;
+  if ( !reader.open( input.local8Bit(), error ) ) {
+    fprintf( stderr, "%s: %s\n", input.latin1(), error.c_str() );
+    return false;
+  }
+  if ( formatForFile( output ) != "PNG" ) {
+    fprintf( stderr, "%s: --stream writes PNG files only\n", output.latin1() );
+    return false;
+  }
+  PngWriter writer;
+  if ( !writer.open( output.local8Bit(), reader.width(), reader.height(),
+                     reader.hasAlpha(), error ) ) {
+    fprintf( stderr, "%s: %s\n", output.latin1(), error.c_str() );
+    return false;
+  }
+
+  recipeFilters steps( recipe, settings );
+
+   // each stream hands its rows on to the one after it
+  std::vector<RowStream*> streams( steps.filters.size() );
+  RowSink *sink = &writer;
+  int    rows  = 0;
+  size_t bytes = 0;
+  for (int i=(int)streams.size()-1; i>=0; i--) {
+    streams[i] = new RowStream( *steps.filters[i], reader.width(),
+                                reader.height(), *sink );
+    sink = streams[i];
+    rows  += streams[i]->rowsHeld();
+    bytes += streams[i]->bytes();
+  }
+
+  double megapixels = reader.width() * (double)reader.height() / 1000000.0;
+  printf( "%s -> %s  (%dx%d, %.2f MP, streamed)\n", input.latin1(),
+          output.latin1(), reader.width(), reader.height(), megapixels );
+
+  std::string writeError;
+  bool read    = reader.readInto( *sink, error );
+  bool written = writer.finish( writeError );
+  if ( !written )
+    fprintf( stderr, "%s: %s\n", output.latin1(), writeError.c_str() );
+  else if ( !read )
+    fprintf( stderr, "%s: %s\n", input.latin1(), error.c_str() );
+
+  for (unsigned i=0; i<streams.size(); i++) delete streams[i];
+  if ( !read || !written ) return false;
+
+  printStage( "stream", total.elapsed(), megapixels );
+  printf( "  %-12s %8d rows, %.2f MB\n", "held", rows,
+          bytes / 1048576.0 );
+  return true;
+}
+
+/*---------------------------\
+|    Directories of images    |
+\---------------------------*/
+
+ // the rows of an image each filter task takes, so that a large image is
+ // shared out between the threads rather than left to one
+#define pipelineBandRows    256
+
+ /*
+ | The totals of a directory's run, and what the files' tasks share, guarded
+ | by lock.  QImage is not made to be used on several threads at once, so
+ | the files it reads and writes (all but PNGs) take qtLock as well.
+*/
+struct pipelineRun {
+  const std::vector<TileFilter*> *filters;
+  pthread_mutex_t lock, qtLock;
+  int             done, failed;
+  long long       bytesRead, bytesWritten;
+  double          megapixels;
+};
+
+ /*
+ | One file on its way through the pipeline.  The names are plain strings,
+ | since a QString must not be shared between threads.
+*/
+struct pipelineFile {
+  pipelineRun          *run;
+  std::string           input, output, format;
+  std::vector<uint32_t> pixels, result;
+  int                   width, height;
+  bool                  alpha;
+  unsigned              step;        // the filter being run
+  int                   bandsLeft;   // of it, guarded by run->lock
+
+  ImageRows rows() { return ImageRows( &pixels[0], width, height, width ); }
+};
+
+static long long fileBytes( const std::string &filename ) {
+  struct stat status;
+  return stat( filename.c_str(), &status ) == 0 ? status.st_size : 0;
+}
+
+ /*
+ | Count the file as failed, with the reason, and let it go.
+*/
+static void pipelineFailed( pipelineFile *file, const std::string &filename,
+                            const std::string &error ) {
+  pthread_mutex_lock( &file->run->lock );
+  fprintf( stderr, "%s: %s\n", filename.c_str(), error.c_str() );
+  file->run->failed++;
+  pthread_mutex_unlock( &file->run->lock );
+  delete file;
+}
+
+static void startStep( pipelineFile *file, TaskScheduler &scheduler,
+                       int worker );
+
+ /*
+ | Read the file's image.
+*/
+class decodeTask : public Task {
+ public:
+  decodeTask( pipelineFile *f ) : file(f) {}
+  void run( TaskScheduler &scheduler, int worker );
+
+  pipelineFile *file;
+};
+
+void decodeTask::run( TaskScheduler &scheduler, int worker ) {
+  StageTimer timer( "decode" );
+  std::string error;
+  if ( file->format == "PNG" ) {
+    PngReader reader;
+    if ( !reader.open( file->input.c_str(), error ) ) {
+      pipelineFailed( file, file->input, error );
+      return;
+    }
+    file->width  = reader.width();
+    file->height = reader.height();
+    file->alpha  = reader.hasAlpha();
+    file->pixels.resize( (size_t)file->width * file->height + 1 );
+    for (int y=0; y<file->height; y++)
+      if ( !reader.readRow( file->rows().row(y), error ) ) {
+        pipelineFailed( file, file->input, error );
+        return;
+      }
+  } else {
+    pthread_mutex_lock( &file->run->qtLock );
+    QImage image;
+    bool loaded =
+      image.load( QString::fromLocal8Bit( file->input.c_str() ) );
+    if ( loaded ) {
+      image = image.convertDepth( 32 );
+      file->width  = image.width();
+      file->height = image.height();
+      file->alpha  = image.hasAlphaBuffer();
+      file->pixels.resize( (size_t)file->width * file->height + 1 );
+      ImageRows in = imageRows( image );
+      for (int y=0; y<file->height; y++)
+        memcpy( file->rows().row(y), in.row(y),
+                file->width * sizeof(uint32_t) );
+    }
+    pthread_mutex_unlock( &file->run->qtLock );
+    if ( !loaded ) {
+      pipelineFailed( file, file->input, "could not load image" );
+      return;
+    }
+  }
+
+  pthread_mutex_lock( &file->run->lock );
+  file->run->bytesRead  += fileBytes( file->input );
+  file->run->megapixels += file->width * (double)file->height / 1000000.0;
+  pthread_mutex_unlock( &file->run->lock );
+  file->step = 0;
+  startStep( file, scheduler, worker );
+}
+
+ /*
+ | Run the file's current filter over the rows y0 <= y < y1.  A filter which
+ | reads around each pixel is run, as tiledApply() runs it, over the band and
+ | its margin, into a copy, from which the band is kept.  The last band of
+ | the filter to finish starts the next.
+*/
+class bandTask : public Task {
+ public:
+  bandTask( pipelineFile *f, int a, int b ) : file(f), y0(a), y1(b) {}
+  void run( TaskScheduler &scheduler, int worker );
+
+  pipelineFile *file;
+  int           y0, y1;
+};
+
+void bandTask::run( TaskScheduler &scheduler, int worker ) {
+  {
+    StageTimer timer( "filter" );
+    const TileFilter &filter = *(*file->run->filters)[ file->step ];
+    int halo = filter.halo();
+    ImageRows image = file->rows();
+    if ( halo == 0 ) {
+      ImageRows band( image.row(y0), image.width, y1 - y0, image.stride );
+      filter.run( band, band );
+    } else {
+      int top    = y0 - halo > 0 ? y0 - halo : 0;
+      int bottom = y1 + halo < image.height ? y1 + halo : image.height;
+      std::vector<uint32_t> out( (size_t)image.width * (bottom - top) );
+      ImageRows src( image.row(top), image.width, bottom - top, image.stride );
+      ImageRows dst( &out[0], image.width, bottom - top, image.width );
+      filter.run( src, dst );
+      for (int y=y0; y<y1; y++)
+        memcpy( &file->result[ (size_t)y * image.width ], dst.row( y - top ),
+                image.width * sizeof(uint32_t) );
+    }
+  }
+
+  pthread_mutex_lock( &file->run->lock );
+  bool last = --file->bandsLeft == 0;
+  pthread_mutex_unlock( &file->run->lock );
+  if ( !last ) return;
+
+  if ( (*file->run->filters)[ file->step ]->halo() > 0 )
+    file->pixels.swap( file->result );
+  file->step++;
+  startStep( file, scheduler, worker );
+}
+
+ /*
+ | Write the file's image, and let it go.
+*/
+class encodeTask : public Task {
+ public:
+  encodeTask( pipelineFile *f ) : file(f) {}
+  void run( TaskScheduler &scheduler, int worker );
+
+  pipelineFile *file;
+};
+
+void encodeTask::run( TaskScheduler &, int ) {
+  StageTimer timer( "encode" );
+  std::string error;
+  bool written;
+  if ( file->format == "PNG" ) {
+    PngWriter writer;
+    written = writer.open( file->output.c_str(), file->width, file->height,
+                           file->alpha, error );
+    for (int y=0; written && y<file->height; y++)
+      writer.putRow( file->rows().row(y) );
+    if ( written ) written = writer.finish( error );
+  } else {
+    pthread_mutex_lock( &file->run->qtLock );
+    QImage image( file->width, file->height, 32 );
+    image.setAlphaBuffer( file->alpha );
+    ImageRows out = imageRows( image );
+    for (int y=0; y<file->height; y++)
+      memcpy( out.row(y), file->rows().row(y),
+              file->width * sizeof(uint32_t) );
+    written = image.save( QString::fromLocal8Bit( file->output.c_str() ),
+                          file->format.c_str() );
+    pthread_mutex_unlock( &file->run->qtLock );
+    error = "could not save image";
+  }
+  if ( !written ) {
+    pipelineFailed( file, file->output, error );
+    return;
+  }
+
+  pthread_mutex_lock( &file->run->lock );
+  file->run->bytesWritten += fileBytes( file->output );
+  file->run->done++;
+  pthread_mutex_unlock( &file->run->lock );
+  delete file;
+}
+
+ /*
+ | Start the file's current filter, as a task for each band of rows, or, if
+ | the filters are done, write it out.  The tasks go on the worker's own
+ | queue, so it carries on with the file unless another worker is idle.
+*/
+static void startStep( pipelineFile *file, TaskScheduler &scheduler,
+                       int worker ) {
+  if ( file->step == file->run->filters->size() || file->height == 0 ) {
+    scheduler.spawn( new encodeTask( file ), worker );
+    return;
+  }
+  if ( (*file->run->filters)[ file->step ]->halo() > 0 )
+    file->result.resize( file->pixels.size() );
+
+  int bands = (file->height + pipelineBandRows-1) / pipelineBandRows;
+  file->bandsLeft = bands;
+  for (int i=bands-1; i>=0; i--) {
+    int y1 = (i+1) * pipelineBandRows;
+    scheduler.spawn( new bandTask( file, i * pipelineBandRows,
+                                   y1 < file->height ? y1 : file->height ),
+                     worker );
+  }
+}
+
+ /*
+ | Run the recipe over every image in the input directory, into files of the
+ | same names in the output directory, on a thread per processor (or as
+ | --threads says).  Each file is read, filtered a band at a time, and
+ | written, as tasks of a TaskScheduler, so that one file is read while
+ | another is filtered and another written, and the bands of a large image
+ | are shared out rather than holding up one thread.  The largest files are
+ | started first.  Return the number of files which failed.
+*/
+static int processDirectory( const QString &inputDir,
+                             const QString &outputDir,
+                             const QValueList<batchStep> &recipe,
+                             const batchSettings &settings ) {
+  QDir input( inputDir, "*.png *.bmp *.jpg *.jpeg *.ppm *.pgm *.xpm",
+              QDir::Size | QDir::IgnoreCase, QDir::Files | QDir::Readable );
+  if ( !input.exists() ) {
+    fprintf( stderr, "%s: no such directory\n", inputDir.latin1() );
+    return 1;
+  }
+  if ( !QDir( outputDir ).exists() && !QDir().mkdir( outputDir ) ) {
+    fprintf( stderr, "%s: could not make the directory\n",
+             outputDir.latin1() );
+    return 1;
+  }
+
+   // the files are shared out between the threads, so each file's filters
+   // run on its own thread; the pool is made now, before the threads start
+  int threads = imageThreadCount();
+  imageSetThreadCount( 1 );
+  imageThreadCount();
+
+  recipeFilters steps( recipe, settings );
+  pipelineRun run;
+  run.filters = &steps.filters;
+  pthread_mutex_init( &run.lock, 0 );
+  pthread_mutex_init( &run.qtLock, 0 );
+  run.done = run.failed = 0;
+  run.bytesRead = run.bytesWritten = 0;
+  run.megapixels = 0.0;
+
+  TaskScheduler scheduler( threads );
+  QStringList names = input.entryList();
+  for ( QStringList::Iterator it = names.begin(); it != names.end(); ++it ) {
+    pipelineFile *file = new pipelineFile;
+    file->run    = &run;
+    file->input  = (const char*)input.filePath( *it ).local8Bit();
+    file->output = (const char*)QDir( outputDir ).filePath( *it ).local8Bit();
+    file->format = (const char*)formatForFile( *it ).latin1();
+    file->width  = file->height = 0;
+    file->alpha  = false;
+    file->step   = 0;
+    file->bandsLeft = 0;
+    scheduler.spawn( new decodeTask( file ) );
+  }
+
+  printf( "%s -> %s  (%d files, %d threads)\n", inputDir.latin1(),
+          outputDir.latin1(), (int)names.count(), threads );
+  QTime total;
+  total.start();
+  scheduler.run();
+  double seconds = total.elapsed() / 1000.0;
+
+  printf( "  %d done, %d failed in %.2f s: %.1f files/s, %.1f MP/s\n",
+          run.done, run.failed, seconds,
+          seconds > 0 ? run.done / seconds : 0.0,
+          seconds > 0 ? run.megapixels / seconds : 0.0 );
+  printf( "  read %.1f MB, wrote %.1f MB\n", run.bytesRead / 1048576.0,
+          run.bytesWritten / 1048576.0 );
+
+  pthread_mutex_destroy( &run.qtLock );
+  pthread_mutex_destroy( &run.lock );
+  imageSetThreadCount( threads );
+  return run.failed;
+}
+
+
+bool isBatchCommand( int argc, char **argv )
+ { return argc > 1 && QString( argv[1] ) == "--apply"; }
+
+ /*
+ | Parse the recipe and the file pairs from the command line, and process
+ | every pair.  No window is opened, so no display is needed.
+*/
+int runBatch( int argc, char **argv ) {
+  QApplication app( argc, argv, FALSE );
+  QValueList<batchStep> recipe;
+  QStringList files;
+  QString inputDir, outputDir;
+  batchSettings settings;
+  settings.fadeDegree = defaultFadeDegree;
+  settings.engine = engineSimd;
+  settings.method = methodAuto;
+  settings.fused = false;
+  settings.stream = false;
+
+  if ( argc < 3 ) {
+    printUsage( argv[0] );
+    return 2;
+  }
+
+  QStringList names = QStringList::split( ",", argv[2] );
+  for ( QStringList::Iterator it = names.begin(); it != names.end(); ++it ) {
+    batchStep step;
+    QString name = (*it).stripWhiteSpace();
+    step.filter = findFilter( name.section( ':', 0, 0 ) );
+    step.radius = name.contains( ':' ) ? name.section( ':', 1 ).toInt() : 1;
+    if ( !step.filter ) {
+      fprintf( stderr, "unknown filter: %s\n", (*it).latin1() );
+      printUsage( argv[0] );
+      return 2;
+    }
+    if ( step.filter->operation == opKernel ) {
+      std::string error;
+      QString filename = name.section( ':', 1 );
+      if ( !imageLoadKernel( filename.local8Bit(), step.kernel, error ) ) {
+        fprintf( stderr, "%s: %s\n", filename.latin1(), error.c_str() );
+        return 2;
+      }
+    }
+    recipe.append( step );
+  }
+
+  for ( int i = 3; i < argc; i++ ) {
+    if ( QString( argv[i] ) == "--fade-degree" && i+1 < argc )
+      settings.fadeDegree = QString( argv[++i] ).toInt();
+    else if ( QString( argv[i] ) == "--engine" && i+1 < argc ) {
+      QString name = argv[++i];
+      if      ( name == "scalar" ) settings.engine = engineScalar;
+      else if ( name == "simd"   ) settings.engine = engineSimd;
+      else if ( name == "fixed"  ) settings.engine = engineFixedPoint;
+      else {
+        fprintf( stderr, "unknown engine: %s\n", name.latin1() );
+        printUsage( argv[0] );
+        return 2;
+      }
+    } else if ( QString( argv[i] ) == "--kernel-method" && i+1 < argc ) {
+      QString name = argv[++i];
+      if      ( name == "auto"      ) settings.method = methodAuto;
+      else if ( name == "direct"    ) settings.method = methodDirect;
+      else if ( name == "separable" ) settings.method = methodSeparable;
+      else if ( name == "fft"       ) settings.method = methodFourier;
+      else {
+        fprintf( stderr, "unknown kernel method: %s\n", name.latin1() );
+        printUsage( argv[0] );
+        return 2;
+      }
+    } else if ( QString( argv[i] ) == "--fused" )
+      settings.fused = true;
+    else if ( QString( argv[i] ) == "--stream" )
+      settings.stream = true;
+    else if ( QString( argv[i] ) == "--input-dir" && i+1 < argc )
+      inputDir = argv[++i];
+    else if ( QString( argv[i] ) == "--output-dir" && i+1 < argc )
+      outputDir = argv[++i];
+    else if ( ( QString( argv[i] ) == "--threads" ||
+                QString( argv[i] ) == "--trace" ) && i+1 < argc )
+      i++;   // already applied by main()
+    else
+      files.append( argv[i] );
+  }
+  bool directory = !inputDir.isEmpty() || !outputDir.isEmpty();
+  if ( recipe.isEmpty() ||
+       ( directory ? inputDir.isEmpty() || outputDir.isEmpty() ||
+                     !files.isEmpty() || settings.stream
+                   : files.isEmpty() || files.count() % 2 != 0 ) ) {
+    printUsage( argv[0] );
+    return 2;
+  }
+
+  QString engineName = "scalar";
+  if ( settings.engine == engineSimd )
+    engineName = QString("simd (%1)").arg( imageSimdLevel() );
+  else if ( settings.engine == engineFixedPoint )
+    engineName = QString("fixed (%1)").arg( imageSimdLevel() );
+  printf( "convolution engine: %s, threads: %d\n", engineName.latin1(),
+          imageThreadCount() );
+
+  if ( directory )
+    return processDirectory( inputDir, outputDir, recipe, settings ) ? 1 : 0;
+
+  int failures = 0;
+  for ( unsigned int i = 0; i < files.count(); i += 2 )
+    if ( !( settings.stream
+            ? streamImage( files[i], files[i+1], recipe, settings )
+            : processImage( files[i], files[i+1], recipe, settings ) ) )
+      failures++;
+
+  return failures ? 1 : 0;
+}
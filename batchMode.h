@@ -0,0 +1,35 @@
+/*---------------------.
+| batchMode.h           \______________________________
+|                                                      \
+| A headless command-line mode which applies a recipe  |
+| of the image manipulation filters to image files,    |
+| without opening a window or an OpenGL context.       |
+|                                                      |
+|   splatterBoardManip --apply blur,sharpen in.png out.png
+|                                                      |
+| Images are processed at their native resolution,     |
+| and the wall time of each stage is reported.  With   |
+| --stream, PNG files are filtered as they are read, a |
+| band of rows at a time (see imageOps/rowStream.h),   |
+| so images of any height take the same memory.        |
+|                                                      |
+|   splatterBoardManip --apply sharpen --input-dir in/ --output-dir out/
+|                                                      |
+| runs the recipe over a whole directory, a file to a  |
+| thread, reading, filtering and writing as tasks      |
+| shared out by work stealing (see taskScheduler.h).   |
+\_____________________________________________________*/
+
+
+#ifndef BATCHMODE_H
+#define BATCHMODE_H
+
+
+ // Return true if the command line asks for the batch mode.
+bool isBatchCommand( int argc, char **argv );
+
+ // Run the batch mode, returning the process exit status.
+int  runBatch( int argc, char **argv );
+
+
+#endif
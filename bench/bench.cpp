@@ -0,0 +1,409 @@
+/*---------------------.
+| bench.cpp             \______________________________
+|                                                      \
+| A benchmark of the image manipulation kernels and of |
+| the rasterizer the drawing tools draw with, at a     |
+| range of image sizes.                                |
+|                                                      |
+|   bench [--sizes 0.25,4,24,100] [--json out.json]    |
+|                                                      |
+| Each case is run once to bring the image into        |
+| memory, then again and again for at least the        |
+| minimum time, and the fastest run is reported, in    |
+| megapixels a second, with the bytes each pixel moves |
+| to or from memory and the bandwidth that makes.      |
+| The JSON file holds the same, one record per case    |
+| and size, to compare across builds and releases.     |
+|                                                      |
+| The program uses imageOps alone, with no QT or       |
+| OpenGL, so it runs without a display.                |
+\_____________________________________________________*/
+
+#include "imageOps.h"
+#include "raster.h"
+
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+ // the canvas's defaults, for drawing the tools' shapes as it would
+#define benchBrushSize           6
+#define benchFadeDegree        128
+#define benchCircleTolerance   0.25
+#define benchCircleMinSegments   16
+#define benchCircleMaxSegments 4096
+
+#define PI    3.14159265358979323846
+
+
+ /*
+ | What a case runs: a 3x3 convolution, a point operation, or a tool's shape.
+*/
+enum benchKind { benchConvolute, benchPoint, benchTool };
+
+enum benchPointOperation { pointFade, pointIntensify, pointInvert };
+
+enum benchToolShape { shapePen, shapeLine, shapeRectangle,
+                      shapeRectangleFilled, shapeCircle, shapeCircleFilled,
+                      shapeTriangle, shapeTriangleFilled };
+
+ /*
+ | A case, and the bytes it reads and writes for each pixel: a convolution
+ | reads the source and writes the destination, a point operation reads and
+ | writes the image in place, and a tool writes the pixels it draws.
+*/
+struct benchCase {
+  const char *name;
+  const char *group;
+  benchKind   kind;
+  int         which;
+  int         bytesPerPixel;
+};
+
+static const benchCase benchCases[] = {
+  { "blur",            "convolution", benchConvolute, blur,        8 },
+  { "sharpen",         "convolution", benchConvolute, sharpen,     8 },
+  { "lapOfGauss",      "convolution", benchConvolute, lapOfGauss,  8 },
+  { "edgeDetectX",     "convolution", benchConvolute, edgeDetectX, 8 },
+  { "edgeDetectY",     "convolution", benchConvolute, edgeDetectY, 8 },
+  { "sobel",           "convolution", benchConvolute, sobel,       8 },
+  { "laplacian",       "convolution", benchConvolute, laplacian,   8 },
+  { "laplacian2",      "convolution", benchConvolute, laplacian2,  8 },
+  { "fade",            "point",       benchPoint, pointFade,       8 },
+  { "intensify",       "point",       benchPoint, pointIntensify,  8 },
+  { "invert",          "point",       benchPoint, pointInvert,     8 },
+  { "pen",             "tool",        benchTool,  shapePen,             4 },
+  { "line",            "tool",        benchTool,  shapeLine,            4 },
+  { "rectangle",       "tool",        benchTool,  shapeRectangle,       4 },
+  { "rectangleFilled", "tool",        benchTool,  shapeRectangleFilled, 4 },
+  { "circle",          "tool",        benchTool,  shapeCircle,          4 },
+  { "circleFilled",    "tool",        benchTool,  shapeCircleFilled,    4 },
+  { "triangle",        "tool",        benchTool,  shapeTriangle,        4 },
+  { "triangleFilled",  "tool",        benchTool,  shapeTriangleFilled,  4 } };
+const int benchCaseCount = sizeof(benchCases) / sizeof(benchCases[0]);
+
+ /*
+ | The settings from the command line.
+*/
+struct benchSettings {
+  std::vector<double> sizes;       // in megapixels
+  convolutionEngine   engine;
+  double              minTime;     // seconds to repeat each case for
+  const char         *jsonFile;    // 0 for none
+};
+
+ /*
+ | One case's timing at one size.
+*/
+struct benchResult {
+  const benchCase *which;
+  double           size;           // the megapixels asked for
+  int              width, height;
+  double           megapixels;     // the pixels one run works on
+  int              runs;
+  double           best, mean;     // seconds a run
+};
+
+
+static double now() {
+  struct timeval t;
+  gettimeofday( &t, 0 );
+  return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+ /*
+ | Fill the image with noise, so that no case can take a short cut.
+*/
+static void fillImage( const ImageRows &image ) {
+  uint32_t seed = 12345;
+  for (int y=0; y<image.height; y++) {
+    uint32_t *row = image.row(y);
+    for (int x=0; x<image.width; x++) {
+      seed = seed * 1664525u + 1013904223u;
+      row[x] = 0xff000000u | (seed >> 8);
+    }
+  }
+}
+
+static void clearImage( const ImageRows &image ) {
+  for (int y=0; y<image.height; y++)
+    memset( image.row(y), 0, image.width * sizeof(uint32_t) );
+}
+
+static int countDrawn( const ImageRows &image ) {
+  int drawn = 0;
+  for (int y=0; y<image.height; y++) {
+    const uint32_t *row = image.row(y);
+    for (int x=0; x<image.width; x++)
+      if ( row[x] ) drawn++;
+  }
+  return drawn;
+}
+
+ /*
+ | Draw a corner of a shape around the middle of the image, with its color
+ | shaded around the shape as the canvas's gradient shades it.
+*/
+static RasterVertex corner( const ImageRows &image, double angle,
+                            double reach ) {
+  double radius = reach * (image.width < image.height ? image.width
+                                                      : image.height) / 2;
+  float shade = (float)(0.3 * cos( angle ));
+  return RasterVertex( (float)(image.width/2  + radius * cos( angle )),
+                       (float)(image.height/2 + radius * sin( angle )),
+                       0.45f + shade, 0.40f + shade, 0.33f - shade );
+}
+
+ /*
+ | Draw the tool's shape into the image, as large as the canvas's tools
+ | would draw it across a window of that size.  The pen draws a wavy stroke
+ | of round points joined by lines; the outlines are lines around the shape.
+*/
+static void drawShape( const ImageRows &image, const int shape ) {
+  std::vector<RasterVertex> v;
+  int corners = 0;
+  switch ( shape ) {
+    case shapePen : {
+      int points = 1000;
+      RasterVertex last;
+      for (int i=0; i<points; i++) {
+        double t = (double)i / (points-1);
+        RasterVertex p( (float)(image.width * (0.05 + 0.9*t)),
+                        (float)(image.height * (0.5 + 0.4*sin( 8*PI*t ))),
+                        (float)t, 0.4f, (float)(1-t) );
+        rasterPoint( image, p, benchBrushSize, true );
+        if ( i ) rasterLine( image, last, p, benchBrushSize );
+        last = p;
+      }
+      return;
+    }
+    case shapeLine :
+      rasterLine( image, corner( image, PI/4, 0.9 ),
+                  corner( image, 5*PI/4, 0.9 ), benchBrushSize );
+      return;
+    case shapeRectangle :
+    case shapeRectangleFilled :
+      corners = 4;
+      break;
+    case shapeCircle :
+    case shapeCircleFilled : {
+       // as many sides as the canvas gives a circle of this radius
+      double radius = 0.9 * (image.width < image.height ? image.width
+                                                        : image.height) / 2;
+      corners = benchCircleMinSegments;
+      while ( corners < PI * sqrt( radius / (2 * benchCircleTolerance) ) &&
+              corners < benchCircleMaxSegments )
+        corners *= 2;
+      break;
+    }
+    case shapeTriangle :
+    case shapeTriangleFilled :
+      corners = 3;
+      break;
+  }
+
+  for (int i=0; i<corners; i++)
+    v.push_back( corner( image, PI/4 + 2*PI * i / corners, 0.9 ) );
+  if ( shape == shapeRectangleFilled || shape == shapeCircleFilled ||
+       shape == shapeTriangleFilled )
+    rasterPolygon( image, &v[0], corners );
+  else
+    for (int i=0; i<corners; i++)
+      rasterLine( image, v[i], v[(i+1) % corners], benchBrushSize );
+}
+
+static void runCase( const benchCase &c, const ImageRows &src,
+                     const ImageRows &dst, const benchSettings &settings ) {
+  switch ( c.kind ) {
+    case benchConvolute :
+      imageConvolute( src, dst, (convolutionType)c.which, settings.engine );
+      break;
+    case benchPoint :
+      switch ( c.which ) {
+        case pointFade      : imageFade( src, benchFadeDegree );      break;
+        case pointIntensify : imageIntensify( src, benchFadeDegree ); break;
+        case pointInvert    : imageInvert( src );                     break;
+      }
+      break;
+    case benchTool :
+      drawShape( dst, c.which );
+      break;
+  }
+}
+
+ /*
+ | Time the case over the images, once to warm up and then for at least the
+ | minimum time.  A tool's speed is counted over the pixels it draws rather
+ | than the whole image, which are counted on the warm-up run.
+*/
+static benchResult timeCase( const benchCase &c, const ImageRows &src,
+                             const ImageRows &dst,
+                             const benchSettings &settings ) {
+  benchResult result;
+  result.which      = &c;
+  result.width      = src.width;
+  result.height     = src.height;
+  result.megapixels = src.width * (double)src.height / 1000000.0;
+
+  if ( c.kind == benchTool ) clearImage( dst );
+  runCase( c, src, dst, settings );
+  if ( c.kind == benchTool )
+    result.megapixels = countDrawn( dst ) / 1000000.0;
+
+  double total = 0.0;
+  result.runs = 0;
+  result.best = 0.0;
+  do {
+    double start = now();
+    runCase( c, src, dst, settings );
+    double elapsed = now() - start;
+    if ( result.runs == 0 || elapsed < result.best ) result.best = elapsed;
+    total += elapsed;
+    result.runs++;
+  } while ( total < settings.minTime );
+  result.mean = total / result.runs;
+  return result;
+}
+
+static double perSecond( const benchResult &r )
+ { return r.best > 0.0 ? r.megapixels / r.best : 0.0; }
+
+static void printResult( const benchResult &r ) {
+  double rate = perSecond( r );
+  printf( "  %-16s %10.3f ms  %9.1f MP/s  %2d B/px  %6.2f GB/s\n",
+          r.which->name, r.best * 1000.0, rate, r.which->bytesPerPixel,
+          rate * r.which->bytesPerPixel / 1000.0 );
+}
+
+ /*
+ | Write the results as JSON, returning false if the file cannot be written.
+*/
+static bool writeJson( const char *filename,
+                       const std::vector<benchResult> &results,
+                       const benchSettings &settings ) {
+  FILE *file = fopen( filename, "w" );
+  if ( !file ) return false;
+
+  const char *engines[] = { "scalar", "simd", "fixed" };
+  fprintf( file, "{\n  \"simd\": \"%s\",\n  \"engine\": \"%s\",\n"
+                 "  \"threads\": %d,\n  \"results\": [",
+           imageSimdLevel(), engines[ settings.engine ], imageThreadCount() );
+  for (unsigned i=0; i<results.size(); i++) {
+    const benchResult &r = results[i];
+    fprintf( file, "%s\n    { \"name\": \"%s\", \"group\": \"%s\", "
+                   "\"size\": %g, \"width\": %d, \"height\": %d,\n"
+                   "      \"megapixels\": %.6f, \"runs\": %d, "
+                   "\"bestMs\": %.4f, \"meanMs\": %.4f,\n"
+                   "      \"megapixelsPerSecond\": %.2f, "
+                   "\"bytesPerPixel\": %d }",
+             i ? "," : "", r.which->name, r.which->group, r.size, r.width,
+             r.height, r.megapixels, r.runs, r.best * 1000.0,
+             r.mean * 1000.0, perSecond( r ), r.which->bytesPerPixel );
+  }
+  fprintf( file, "\n  ]\n}\n" );
+  return fclose( file ) == 0;
+}
+
+static void printUsage( const char *program ) {
+  fprintf( stderr,
+    "usage: %s [--sizes <megapixels>[,...]] [--engine scalar|simd|fixed]\n"
+    "       %*s [--threads <n>] [--min-time <seconds>] [--json <file>]\n",
+    program, (int)strlen(program), "" );
+}
+
+ /*
+ | Read a list of sizes such as "0.25,4,24", returning false if it is not
+ | one.
+*/
+static bool parseSizes( const char *text, std::vector<double> &sizes ) {
+  sizes.clear();
+  while ( *text ) {
+    char *end;
+    double size = strtod( text, &end );
+    if ( end == text || size <= 0.0 ) return false;
+    sizes.push_back( size );
+    text = end;
+    if ( *text == ',' ) text++;
+    else if ( *text ) return false;
+  }
+  return !sizes.empty();
+}
+
+
+int main( int argc, char **argv ) {
+  benchSettings settings;
+  settings.sizes.push_back( 0.25 );
+  settings.sizes.push_back( 4 );
+  settings.sizes.push_back( 24 );
+  settings.sizes.push_back( 100 );
+  settings.engine   = engineSimd;
+  settings.minTime  = 0.5;
+  settings.jsonFile = 0;
+
+  for (int i=1; i<argc; i++) {
+    bool hasValue = i+1 < argc;
+    if ( !strcmp( argv[i], "--sizes" ) && hasValue ) {
+      if ( !parseSizes( argv[++i], settings.sizes ) ) {
+        fprintf( stderr, "%s: bad size list %s\n", argv[0], argv[i] );
+        return 1;
+      }
+    } else if ( !strcmp( argv[i], "--engine" ) && hasValue ) {
+      const char *engine = argv[++i];
+      if      ( !strcmp( engine, "scalar" ) ) settings.engine = engineScalar;
+      else if ( !strcmp( engine, "simd" ) )   settings.engine = engineSimd;
+      else if ( !strcmp( engine, "fixed" ) )  settings.engine = engineFixedPoint;
+      else {
+        fprintf( stderr, "%s: unknown engine %s\n", argv[0], engine );
+        return 1;
+      }
+    } else if ( !strcmp( argv[i], "--threads" ) && hasValue )
+      imageSetThreadCount( atoi( argv[++i] ) );
+    else if ( !strcmp( argv[i], "--min-time" ) && hasValue )
+      settings.minTime = atof( argv[++i] );
+    else if ( !strcmp( argv[i], "--json" ) && hasValue )
+      settings.jsonFile = argv[++i];
+    else {
+      printUsage( argv[0] );
+      return 1;
+    }
+  }
+
+  printf( "simd %s, %d threads\n", imageSimdLevel(), imageThreadCount() );
+  std::vector<benchResult> results;
+  for (unsigned s=0; s<settings.sizes.size(); s++) {
+     // 4:3, as photographs mostly are
+    int width  = (int)( sqrt( settings.sizes[s] * 1000000.0 * 4 / 3 ) + 0.5 );
+    int height = (int)( width * 3 / 4 );
+    std::vector<uint32_t> first, second;
+    try {
+      first.resize( (size_t)width * height );
+      second.resize( first.size() );
+    } catch ( std::bad_alloc & ) {
+      fprintf( stderr, "%g MP: not enough memory, skipped\n",
+               settings.sizes[s] );
+      continue;
+    }
+    ImageRows src( &first[0], width, height, width );
+    ImageRows dst( &second[0], width, height, width );
+    fillImage( src );
+
+    printf( "%g MP (%dx%d)\n", settings.sizes[s], width, height );
+    for (int i=0; i<benchCaseCount; i++) {
+      benchResult r = timeCase( benchCases[i], src, dst, settings );
+      r.size = settings.sizes[s];
+      printResult( r );
+      results.push_back( r );
+    }
+  }
+
+  if ( settings.jsonFile && !writeJson( settings.jsonFile, results,
+                                        settings ) ) {
+    fprintf( stderr, "%s: could not write %s\n", argv[0], settings.jsonFile );
+    return 1;
+  }
+  return 0;
+}
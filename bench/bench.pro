@@ -0,0 +1,24 @@
+######################################################################
+# The benchmark of the image manipulation kernels and the tools'
+# rasterizer, a command-line program with no dependence on QT or OpenGL.
+# "make bench" in the top directory builds it.
+######################################################################
+
+TEMPLATE = app
+INCLUDEPATH += . ../imageOps
+TARGET = bench
+
+# Config
+CONFIG += console warn_on release thread
+CONFIG -= qt
+
+# Input
+SOURCES += bench.cpp
+
+# The image manipulation kernels, a static library of their own
+imageOps.target   = ../imageOps/libimageOps.a
+imageOps.commands = cd ../imageOps && $(QMAKE) imageOps.pro && $(MAKE)
+imageOps.depends  = FORCE
+QMAKE_EXTRA_UNIX_TARGETS += imageOps
+TARGETDEPS += ../imageOps/libimageOps.a
+LIBS += -L../imageOps -limageOps
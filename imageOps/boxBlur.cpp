@@ -0,0 +1,182 @@
+/*---------------------.
+| boxBlur.cpp           \______________________________
+|                                                      \
+| A blur of any radius, as separate horizontal and     |
+| vertical passes of a box filter.  Each pass slides   |
+| a window along the row or column, adding the pixel   |
+| entering the window to a running sum and taking off  |
+| the pixel leaving it, so the cost per pixel is the   |
+| same whatever the radius.  Two passes of a box make  |
+| a tent, three approach a gaussian.                   |
+|                                                      |
+| Pixels beyond the edges of the image are taken to    |
+| repeat the edge pixels, so the whole image is        |
+| blurred, edges included.                             |
+\_____________________________________________________*/
+
+#include "imageOps.h"
+#include "threadPool.h"
+
+#include <string.h>
+#include <vector>
+
+ // the width of the column strips the vertical pass works on
+#define stripWidth    32
+
+ /*
+ | Division by the window size, rounded to the nearest whole number, done as
+ | a multiplication by a fixed-point reciprocal.  Exact for sums up to
+ | 256*size, as long as size*size*256 < 2^32, hence the limit on the radius.
+*/
+class WindowDivider {
+ public:
+  WindowDivider( int size )
+   : half( size / 2 ), reciprocal( (uint64_t)0xffffffffu / size + 1 ) {}
+
+  int operator()( uint32_t sum ) const
+   { return (int)(( (uint64_t)(sum + half) * reciprocal ) >> 32); }
+
+  uint32_t half;
+  uint64_t reciprocal;
+};
+
+ /*
+ | Box blur one row of count pixels from in to out.
+*/
+static void boxBlurRow( const uint32_t *in, uint32_t *out, const int count,
+                        const int radius, const WindowDivider &divide ) {
+  uint32_t r, g, b, pix;
+  int last = count - 1;
+
+  pix = in[0];
+  r = pixelRed(pix) * (radius+1);
+  g = pixelGreen(pix) * (radius+1);
+  b = pixelBlue(pix) * (radius+1);
+  for (int i=1; i<=radius; i++) {
+    pix = in[ i < last ? i : last ];
+    r += pixelRed(pix);  g += pixelGreen(pix);  b += pixelBlue(pix);
+  }
+
+  for (int i=0; i<count; i++) {
+    out[i] = pixelRgb( divide(r), divide(g), divide(b) );
+    uint32_t entering = in[ i+radius+1 < last ? i+radius+1 : last ];
+    uint32_t leaving  = in[ i-radius > 0 ? i-radius : 0 ];
+    r += pixelRed(entering)   - pixelRed(leaving);
+    g += pixelGreen(entering) - pixelGreen(leaving);
+    b += pixelBlue(entering)  - pixelBlue(leaving);
+  }
+}
+
+ /*
+ | Box blur the columns of a strip of width x count pixels from in, whose
+ | rows are stripWidth pixels apart, to out, whose rows are outStride pixels
+ | apart.  All the columns are summed together, a row at a time.
+*/
+static void boxBlurColumns( const uint32_t *in, uint32_t *out,
+                            const ptrdiff_t outStride,
+                            const int width, const int count,
+                            const int radius, const WindowDivider &divide ) {
+  uint32_t sums[stripWidth][3];
+  int last = count - 1;
+
+  for (int x=0; x<width; x++) {
+    uint32_t pix = in[x];
+    sums[x][0] = pixelRed(pix) * (radius+1);
+    sums[x][1] = pixelGreen(pix) * (radius+1);
+    sums[x][2] = pixelBlue(pix) * (radius+1);
+  }
+  for (int i=1; i<=radius; i++) {
+    const uint32_t *row = in + (i < last ? i : last) * stripWidth;
+    for (int x=0; x<width; x++) {
+      sums[x][0] += pixelRed(row[x]);
+      sums[x][1] += pixelGreen(row[x]);
+      sums[x][2] += pixelBlue(row[x]);
+    }
+  }
+
+  for (int i=0; i<count; i++) {
+    uint32_t *outRow = out + i * outStride;
+    const uint32_t *entering = in + (i+radius+1 < last ? i+radius+1 : last)
+                                    * stripWidth;
+    const uint32_t *leaving  = in + (i-radius > 0 ? i-radius : 0) * stripWidth;
+    for (int x=0; x<width; x++) {
+      outRow[x] = pixelRgb( divide(sums[x][0]), divide(sums[x][1]),
+                            divide(sums[x][2]) );
+      sums[x][0] += pixelRed(entering[x])   - pixelRed(leaving[x]);
+      sums[x][1] += pixelGreen(entering[x]) - pixelGreen(leaving[x]);
+      sums[x][2] += pixelBlue(entering[x])  - pixelBlue(leaving[x]);
+    }
+  }
+}
+
+ /*
+ | The horizontal passes, a band of rows at a time.
+*/
+class HorizontalBlurJob : public RowJob {
+ public:
+  HorizontalBlurJob( const ImageRows &s, const ImageRows &d, int r, int p )
+   : src(s), dst(d), radius(r), passes(p), divide(2*r+1) {}
+
+  void run( int yBegin, int yEnd ) {
+    std::vector<uint32_t> line( src.width );
+    for (int y=yBegin; y<yEnd; y++) {
+      memcpy( &line[0], src.row(y), src.width * sizeof(uint32_t) );
+      for (int pass=0; pass<passes; pass++) {
+        if ( pass > 0 )
+          memcpy( &line[0], dst.row(y), src.width * sizeof(uint32_t) );
+        boxBlurRow( &line[0], dst.row(y), src.width, radius, divide );
+      }
+    }
+  }
+
+  const ImageRows &src, &dst;
+  int radius, passes;
+  WindowDivider divide;
+};
+
+ /*
+ | The vertical passes, in place, a band of column strips at a time.  Each
+ | strip is copied out first, so that its pixels are still available after
+ | they have been overwritten.
+*/
+class VerticalBlurJob : public RowJob {
+ public:
+  VerticalBlurJob( const ImageRows &i, int r, int p )
+   : image(i), radius(r), passes(p), divide(2*r+1) {}
+
+  void run( int stripBegin, int stripEnd ) {
+    std::vector<uint32_t> strip( image.height * stripWidth );
+    for (int s=stripBegin; s<stripEnd; s++) {
+      int x0 = s * stripWidth;
+      int width = image.width - x0 < stripWidth ? image.width - x0
+                                                : stripWidth;
+      for (int pass=0; pass<passes; pass++) {
+        for (int y=0; y<image.height; y++)
+          memcpy( &strip[y*stripWidth], image.row(y) + x0,
+                  width * sizeof(uint32_t) );
+        boxBlurColumns( &strip[0], image.row(0) + x0, image.stride,
+                        width, image.height, radius, divide );
+      }
+    }
+  }
+
+  const ImageRows &image;
+  int radius, passes;
+  WindowDivider divide;
+};
+
+ /*
+ | Blur src into dst with a box of the given radius, the given number of times.
+*/
+void imageBoxBlur( const ImageRows &src, const ImageRows &dst,
+                   int radius, int passes ) {
+  if ( radius > maxBlurRadius ) radius = maxBlurRadius;
+  if ( radius < 0 ) radius = 0;
+
+  HorizontalBlurJob horizontal( src, dst, radius, passes );
+  imageOpsPool()->runRows( horizontal, 0, src.height );
+
+  VerticalBlurJob vertical( dst, radius, passes );
+  imageOpsPool()->runRows( vertical, 0,
+                           (src.width + stripWidth-1) / stripWidth );
+}
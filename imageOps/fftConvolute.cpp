@@ -0,0 +1,291 @@
+/*---------------------.
+| fftConvolute.cpp      \______________________________
+|                                                      \
+| Convolution with a large matrix of weights in the    |
+| frequency domain.  The image is cut into square      |
+| tiles a power of two wide, which overlap by the      |
+| size of the matrix (overlap-save): each tile is      |
+| transformed, multiplied by the transform of the      |
+| matrix, and transformed back, and the middle of the  |
+| result, which the wrapping around of the transform   |
+| does not reach, is kept.                             |
+|                                                      |
+| The weights are real, so two channels are carried    |
+| through one complex transform, one as the real part  |
+| and one as the imaginary part, and come back out     |
+| the same way: the three channels of a row of tiles   |
+| are taken two at a time.                             |
+\_____________________________________________________*/
+
+#include "imageOpsInternal.h"
+#include "threadPool.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+ // the range of tile sizes tried, as powers of two
+#define smallestFftTile    32
+#define largestFftTile     1024
+
+#define fftPI    3.14159265358979323846
+
+
+/*-------------------------\
+|    The transform        |
+\-------------------------*/
+
+ /*
+ | A two-dimensional discrete Fourier transform of n x n complex values, n a
+ | power of two, held as separate planes of real and imaginary parts.  The
+ | inverse transform is the forward transform with the planes swapped over,
+ | and is not scaled.
+*/
+class FourierTransform {
+ public:
+  FourierTransform( int n );
+
+  void forward( float *re, float *im ) const;
+
+ protected:
+  void transformRow( float *re, float *im ) const;
+  void transformColumns( float *re, float *im ) const;
+
+  int myN;
+  std::vector<int>   myReversed;       // the bit reversal of each index
+  std::vector<float> myCos, mySin;     // the twiddle factors, n/2 of each
+};
+
+FourierTransform::FourierTransform( int n )
+ : myN(n), myReversed(n), myCos(n/2), mySin(n/2) {
+  int bits = 0;
+  while ( (1 << bits) < n ) bits++;
+  for (int i=0; i<n; i++) {
+    int reversed = 0;
+    for (int b=0; b<bits; b++)
+      if ( i & (1 << b) ) reversed |= 1 << (bits-1-b);
+    myReversed[i] = reversed;
+  }
+  for (int k=0; k<n/2; k++) {
+    myCos[k] = (float)cos( 2.0 * fftPI * k / n );
+    mySin[k] = (float)-sin( 2.0 * fftPI * k / n );
+  }
+}
+
+ /*
+ | Transform one row of n values in place.
+*/
+void FourierTransform::transformRow( float *re, float *im ) const {
+  for (int i=0; i<myN; i++) {
+    int j = myReversed[i];
+    if ( j > i ) {
+      float t = re[i];  re[i] = re[j];  re[j] = t;
+      t = im[i];  im[i] = im[j];  im[j] = t;
+    }
+  }
+  for (int half=1; half<myN; half*=2) {
+    int step = myN / (2*half);
+    for (int start=0; start<myN; start+=2*half)
+      for (int k=0; k<half; k++) {
+        int a = start+k, b = a+half;
+        float wr = myCos[k*step], wi = mySin[k*step];
+        float tr = re[b]*wr - im[b]*wi;
+        float ti = re[b]*wi + im[b]*wr;
+        re[b] = re[a] - tr;  im[b] = im[a] - ti;
+        re[a] += tr;         im[a] += ti;
+      }
+  }
+}
+
+ /*
+ | Transform every column in place.  The butterflies combine whole rows, so
+ | the innermost loop runs along a row.
+*/
+void FourierTransform::transformColumns( float *re, float *im ) const {
+  std::vector<float> swap( myN );
+  for (int i=0; i<myN; i++) {
+    int j = myReversed[i];
+    if ( j > i ) {
+      memcpy( &swap[0],  re + i*myN, myN * sizeof(float) );
+      memcpy( re + i*myN, re + j*myN, myN * sizeof(float) );
+      memcpy( re + j*myN, &swap[0],  myN * sizeof(float) );
+      memcpy( &swap[0],  im + i*myN, myN * sizeof(float) );
+      memcpy( im + i*myN, im + j*myN, myN * sizeof(float) );
+      memcpy( im + j*myN, &swap[0],  myN * sizeof(float) );
+    }
+  }
+  for (int half=1; half<myN; half*=2) {
+    int step = myN / (2*half);
+    for (int start=0; start<myN; start+=2*half)
+      for (int k=0; k<half; k++) {
+        float *ar = re + (start+k)*myN,  *ai = im + (start+k)*myN;
+        float *br = ar + half*myN,       *bi = ai + half*myN;
+        float wr = myCos[k*step], wi = mySin[k*step];
+        for (int x=0; x<myN; x++) {
+          float tr = br[x]*wr - bi[x]*wi;
+          float ti = br[x]*wi + bi[x]*wr;
+          br[x] = ar[x] - tr;  bi[x] = ai[x] - ti;
+          ar[x] += tr;         ai[x] += ti;
+        }
+      }
+  }
+}
+
+void FourierTransform::forward( float *re, float *im ) const {
+  for (int y=0; y<myN; y++)
+    transformRow( re + y*myN, im + y*myN );
+  transformColumns( re, im );
+}
+
+
+/*-------------------------\
+|    The convolution      |
+\-------------------------*/
+
+ /*
+ | Return the time taken to convolve a width x height image (with the border
+ | of radius pixels left out) in tiles n pixels wide, in arbitrary units: the
+ | number of tiles times the work of transforming one.
+*/
+static double tileCost( int width, int height, int radius, int n ) {
+  int valid = n - 2*radius;
+  if ( valid <= 0 ) return -1.0;
+  double across = ceil( (double)(width  - 2*radius) / valid );
+  double down   = ceil( (double)(height - 2*radius) / valid );
+  int bits = 0;
+  while ( (1 << bits) < n ) bits++;
+  return across * down * n * n * bits;
+}
+
+ /*
+ | Return the tile size which convolves the image fastest.
+*/
+int fftTileSize( int width, int height, int size ) {
+  int radius = size / 2, best = 0;
+  double bestCost = 0.0;
+  for (int n=smallestFftTile; n<=largestFftTile; n*=2) {
+    double cost = tileCost( width, height, radius, n );
+    if ( cost > 0.0 && ( best == 0 || cost < bestCost ) ) {
+      best = n;
+      bestCost = cost;
+    }
+  }
+  return best;
+}
+
+ /*
+ | Convolve the rows of tiles of a band.  The three channels of the tiles in
+ | a row of tiles are numbered 3*tile + channel, and taken in pairs.
+*/
+class FftKernelJob : public RowJob {
+ public:
+  FftKernelJob( const ImageRows &s, const ImageRows &d,
+                const FourierTransform &t, const float *hr, const float *hi,
+                int n, int r )
+   : src(s), dst(d), transform(t), kernelRe(hr), kernelIm(hi), tile(n),
+     radius(r), valid(n - 2*r) {
+    across = (src.width - 2*radius + valid-1) / valid;
+  }
+
+  void run( int tileRowBegin, int tileRowEnd ) {
+    std::vector<float> re( tile*tile ), im( tile*tile );
+    for (int t=tileRowBegin; t<tileRowEnd; t++) {
+      copyBorderRows( t );
+      int planes = 3 * across;
+      for (int plane=0; plane<planes; plane+=2) {
+        load( &re[0], t, plane );
+        if ( plane+1 < planes ) load( &im[0], t, plane+1 );
+        else                    memset( &im[0], 0, tile*tile * sizeof(float) );
+
+        transform.forward( &re[0], &im[0] );
+        for (int i=0; i<tile*tile; i++) {
+          float r = re[i]*kernelRe[i] - im[i]*kernelIm[i];
+          im[i] = re[i]*kernelIm[i] + im[i]*kernelRe[i];
+          re[i] = r;
+        }
+        transform.forward( &im[0], &re[0] );
+
+        store( &re[0], t, plane );
+        if ( plane+1 < planes ) store( &im[0], t, plane+1 );
+      }
+    }
+  }
+
+   // Copy the rows which tile row t writes from src, so that the border
+   // columns (and, at the top and bottom, the border rows) are unchanged.
+  void copyBorderRows( int t ) {
+    int yBegin = t == 0 ? 0 : radius + t*valid;
+    int yEnd   = radius + (t+1)*valid;
+    if ( yEnd >= src.height - radius ) yEnd = src.height;
+    for (int y=yBegin; y<yEnd; y++)
+      memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+  }
+
+   // Load one channel of a tile, with zeros beyond the edges of the image.
+  void load( float *plane, int t, int number ) {
+    int x0 = (number/3) * valid, y0 = t * valid, shift = 16 - 8*(number%3);
+    int count = src.width - x0 < tile ? src.width - x0 : tile;
+    for (int i=0; i<tile; i++, plane+=tile) {
+      int j = 0;
+      if ( y0 + i < src.height ) {
+        const uint32_t *in = src.row(y0 + i) + x0;
+        for (; j<count; j++)
+          plane[j] = (float)( (in[j] >> shift) & 0xff );
+      }
+      for (; j<tile; j++)
+        plane[j] = 0.0;
+    }
+  }
+
+   // Store the part of one channel of a tile which the wrapping around does
+   // not reach.  Red is stored first, so it sets the rest of the pixel.
+  void store( const float *plane, int t, int number ) {
+    int x0 = (number/3) * valid, y0 = t * valid, channel = number%3;
+    int shift = 16 - 8*channel;
+    int columns = src.width - 2*radius - x0 < valid ? src.width - 2*radius - x0
+                                                    : valid;
+    int rows    = src.height - 2*radius - y0 < valid ? src.height-2*radius - y0
+                                                     : valid;
+    for (int i=0; i<rows; i++) {
+      const float *in = plane + (radius+i)*tile + radius;
+      uint32_t *out = dst.row(y0 + radius + i) + x0 + radius;
+      if ( channel == 0 )
+        for (int j=0; j<columns; j++)
+          out[j] = 0xff000000u | limit0_255( (int)in[j] ) << shift;
+      else
+        for (int j=0; j<columns; j++)
+          out[j] |= limit0_255( (int)in[j] ) << shift;
+    }
+  }
+
+  const ImageRows &src, &dst;
+  const FourierTransform &transform;
+  const float *kernelRe, *kernelIm;
+  int tile, radius, valid, across;
+};
+
+ /*
+ | Convolve src with the matrix in tiles of size x size pixels, writing dst.
+*/
+void fftConvolute( const ImageRows &src, const ImageRows &dst,
+                   const float *weights, const int size, const int tile ) {
+  int radius = size / 2;
+  FourierTransform transform( tile );
+
+   // the transform of the matrix, turned about its center so that the
+   // product gives the same sum as imageConvoluteKernel's, and scaled to
+   // undo the scaling of the inverse transform
+  std::vector<float> kernelRe( tile*tile, 0.0 ), kernelIm( tile*tile, 0.0 );
+  float scale = 1.0 / ((double)tile * tile);
+  for (int i=0; i<size; i++)
+    for (int j=0; j<size; j++) {
+      int y = (tile - (i-radius)) % tile, x = (tile - (j-radius)) % tile;
+      kernelRe[ y*tile + x ] = weights[ i*size + j ] * scale;
+    }
+  transform.forward( &kernelRe[0], &kernelIm[0] );
+
+  FftKernelJob job( src, dst, transform, &kernelRe[0], &kernelIm[0],
+                    tile, radius );
+  imageOpsPool()->runRows( job, 0, (src.height - 2*radius + job.valid-1)
+                                   / job.valid );
+}
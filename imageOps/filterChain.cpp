@@ -0,0 +1,200 @@
+/*---------------------.
+| filterChain.cpp       \______________________________
+|                                                      \
+| See the header of filterChain.h for details.         |
+\_____________________________________________________*/
+
+#include "filterChain.h"
+#include "imageOpsInternal.h"
+#include "threadPool.h"
+
+#include <string.h>
+
+ // the size of the part of the result each tile writes.  With the margin,
+ // the two buffers of a tile take about 150k, well inside a 256k L2 cache.
+#define chainTileWidth     256
+#define chainTileHeight    64
+
+void FilterChain::add( const chainOperation operation,
+                       const convolutionType type, const PointTable &table ) {
+  ChainStep step;
+  step.operation = operation;
+  step.type      = type;
+  step.table     = table;
+  mySteps.push_back( step );
+}
+
+void FilterChain::addConvolution( const convolutionType type )
+ { add( chainConvolute, type ); }
+void FilterChain::addFade( const int fadeDegree )
+ { add( chainTable, fade, fadeTable( fadeDegree ) ); }
+void FilterChain::addIntensify( const int fadeDegree )
+ { add( chainTable, intensify, intensifyTable( fadeDegree ) ); }
+void FilterChain::addInvert()
+ { add( chainTable, fade, invertTable() ); }
+void FilterChain::addTable( const PointTable &table )
+ { add( chainTable, fade, table ); }
+
+int FilterChain::halo() const {
+  int convolutions = 0;
+  for (unsigned i=0; i<mySteps.size(); i++)
+    if ( mySteps[i].operation == chainConvolute ) convolutions++;
+  return convolutions;
+}
+
+
+ /*
+ | A convolution step, ready to run: the row loop of the engine, and the
+ | matrix, in whichever form that loop takes it.
+*/
+struct ChainConvolution {
+  convoluteRowFunction      floatRow;
+  convoluteFixedRowFunction fixedRow;
+  const kernel3x3          *matrix;
+  FixedKernel               fixed;
+};
+
+ /*
+ | Run the chain over tiles of the image.  The tiles are numbered across and
+ | then down, and each is taken through the whole chain in two buffers,
+ | which swap over at every convolution.
+*/
+class ChainJob : public RowJob {
+ public:
+  ChainJob( const ImageRows &s, const ImageRows &d,
+            const std::vector<ChainStep> &st,
+            const std::vector<ChainConvolution> &c, int h )
+   : src(s), dst(d), steps(st), convolutions(c), halo(h) {
+    across = (src.width + chainTileWidth-1) / chainTileWidth;
+  }
+
+  void run( int tileBegin, int tileEnd ) {
+    int stride = chainTileWidth + 2*halo;
+    std::vector<uint32_t> first( stride * (chainTileHeight + 2*halo) );
+    std::vector<uint32_t> second( first.size() );
+
+    for (int tile=tileBegin; tile<tileEnd; tile++) {
+      PixelRect out;
+      out.x0 = (tile % across) * chainTileWidth;
+      out.y0 = (tile / across) * chainTileHeight;
+      out.x1 = out.x0 + chainTileWidth  < src.width  ? out.x0 + chainTileWidth
+                                                     : src.width;
+      out.y1 = out.y0 + chainTileHeight < src.height ? out.y0 + chainTileHeight
+                                                     : src.height;
+      runTile( out, &first[0], &second[0], stride );
+    }
+  }
+
+   // Return the rectangle out widened by margin on every side, within the
+   // image.
+  PixelRect widen( const PixelRect &out, int margin ) {
+    PixelRect r;
+    r.x0 = out.x0 - margin > 0 ? out.x0 - margin : 0;
+    r.y0 = out.y0 - margin > 0 ? out.y0 - margin : 0;
+    r.x1 = out.x1 + margin < src.width  ? out.x1 + margin : src.width;
+    r.y1 = out.y1 + margin < src.height ? out.y1 + margin : src.height;
+    return r;
+  }
+
+  void runTile( const PixelRect &out, uint32_t *in, uint32_t *next,
+                int stride ) {
+     // the buffers hold the rectangle widened by the whole halo; the part of
+     // it which is up to date shrinks by a pixel at each convolution
+    PixelRect buffer = widen( out, halo );
+    int width = buffer.x1 - buffer.x0;
+    for (int y=buffer.y0; y<buffer.y1; y++)
+      memcpy( in + (y-buffer.y0)*stride, src.row(y) + buffer.x0,
+              width * sizeof(uint32_t) );
+
+    int margin = halo, convolution = 0;
+    for (unsigned i=0; i<steps.size(); i++) {
+      PixelRect valid = widen( out, margin );
+      ImageRows part( in + (valid.y0-buffer.y0)*stride + valid.x0-buffer.x0,
+                      valid.x1-valid.x0, valid.y1-valid.y0, stride );
+      switch ( steps[i].operation ) {
+        case chainTable     : tableRows( part, steps[i].table ); break;
+        case chainConvolute :
+          margin--;
+          convolute( convolutions[convolution++], buffer, widen( out, margin ),
+                     in, next, stride );
+          uint32_t *swap = in;  in = next;  next = swap;
+          break;
+      }
+    }
+
+    for (int y=out.y0; y<out.y1; y++)
+      memcpy( dst.row(y) + out.x0,
+              in + (y-buffer.y0)*stride + out.x0-buffer.x0,
+              (out.x1-out.x0) * sizeof(uint32_t) );
+  }
+
+   // Convolute the rectangle r of the buffer in into the buffer out.  As in
+   // imageConvolute, the first row and column and the last two rows and
+   // columns of the image are copied through unchanged.
+  void convolute( const ChainConvolution &c, const PixelRect &buffer,
+                  const PixelRect &r, const uint32_t *in, uint32_t *out,
+                  int stride ) {
+    int x0 = r.x0 > 1 ? r.x0 : 1;
+    int x1 = r.x1 < src.width-2 ? r.x1 : src.width-2;
+    for (int y=r.y0; y<r.y1; y++) {
+      const uint32_t *center = in + (y-buffer.y0)*stride - buffer.x0;
+      uint32_t *row = out + (y-buffer.y0)*stride - buffer.x0;
+      if ( y < 1 || y >= src.height-2 || x0 >= x1 ) {
+        memcpy( row + r.x0, center + r.x0, (r.x1-r.x0) * sizeof(uint32_t) );
+        continue;
+      }
+      for (int x=r.x0; x<x0; x++)   row[x] = center[x];
+      for (int x=x1; x<r.x1; x++)   row[x] = center[x];
+      if ( c.fixedRow )
+        c.fixedRow( center-stride, center, center+stride, row, x0, x1,
+                    c.fixed );
+      else
+        c.floatRow( center-stride, center, center+stride, row, x0, x1,
+                    *c.matrix );
+    }
+  }
+
+  const ImageRows &src, &dst;
+  const std::vector<ChainStep> &steps;
+  const std::vector<ChainConvolution> &convolutions;
+  int halo, across;
+};
+
+
+ /*
+ | Run the chain over src into dst, a tile at a time, on the imageOps pool.
+ | Each run of point operations is folded into the first table of the run.
+*/
+void FilterChain::run( const ImageRows &src, const ImageRows &dst,
+                       const convolutionEngine engine ) const {
+  std::vector<ChainStep> steps;
+  for (unsigned i=0; i<mySteps.size(); i++) {
+    if ( mySteps[i].operation == chainTable && !steps.empty() &&
+         steps.back().operation == chainTable )
+      steps.back().table.then( mySteps[i].table );
+    else
+      steps.push_back( mySteps[i] );
+  }
+
+  std::vector<ChainConvolution> convolutions;
+  for (unsigned i=0; i<steps.size(); i++) {
+    if ( steps[i].operation != chainConvolute ) continue;
+    ChainConvolution c;
+    c.matrix = &convolutionMatrix[ steps[i].type ];
+    c.floatRow = 0;
+    c.fixedRow = 0;
+    if ( engine == engineFixedPoint ) {
+      quantizeKernel( *c.matrix, c.fixed );
+      c.fixedRow = simdConvoluteFixedRow() ? simdConvoluteFixedRow()
+                                           : convoluteRowFixed;
+    } else if ( engine == engineSimd && simdConvoluteRow() )
+      c.floatRow = simdConvoluteRow();
+    else
+      c.floatRow = convoluteRowScalar;
+    convolutions.push_back( c );
+  }
+
+  ChainJob job( src, dst, steps, convolutions, halo() );
+  int down = (src.height + chainTileHeight-1) / chainTileHeight;
+  imageOpsPool()->runRows( job, 0, job.across * down );
+}
@@ -0,0 +1,80 @@
+/*---------------------.
+| filterChain.h         \______________________________
+|                                                      \
+| A chain of filters (3x3 convolutions and the point   |
+| operations), run over an image in one pass.  Rather  |
+| than taking the whole image through each filter in   |
+| turn, the chain takes each tile of the image through |
+| every filter, while the tile is in the cache, and    |
+| writes only the final result out.  A tile reads a    |
+| margin around itself, one pixel wider for every      |
+| convolution in the chain, so that it needs nothing   |
+| from the tiles around it.                            |
+|                                                      |
+| The point operations are kept as tables, and a run   |
+| of them between two convolutions is folded into one  |
+| table when the chain is run, so it costs one lookup  |
+| per byte however long it is.                         |
+|                                                      |
+| The result is identical to running the filters one   |
+| at a time with the same engine.                      |
+\_____________________________________________________*/
+
+
+#ifndef FILTERCHAIN_H
+#define FILTERCHAIN_H
+
+
+#include "imageOps.h"
+
+#include <vector>
+
+
+enum chainOperation { chainConvolute, chainTable };
+
+ /*
+ | One filter of a chain: the matrix for a convolution, or the table for a
+ | point operation.
+*/
+struct ChainStep {
+  chainOperation  operation;
+  convolutionType type;
+  PointTable      table;
+};
+
+
+class FilterChain {
+ public:
+  FilterChain() {}
+
+   // Append a filter to the end of the chain.
+  void addConvolution( const convolutionType type );
+  void addFade       ( const int fadeDegree );
+  void addIntensify  ( const int fadeDegree );
+  void addInvert     ();
+  void addTable      ( const PointTable &table );
+
+  void clear() { mySteps.clear(); }
+
+  int  count()   const { return (int)mySteps.size(); }
+  bool isEmpty() const { return mySteps.empty(); }
+  const ChainStep &step( int i ) const { return mySteps[i]; }
+
+   // The number of convolutions, which is the width of the margin a tile
+   // reads around itself.
+  int halo() const;
+
+   // Run the chain over src, writing the result into dst, which must be the
+   // same size and must not overlap src.
+  void run( const ImageRows &src, const ImageRows &dst,
+            const convolutionEngine engine = engineSimd ) const;
+
+ protected:
+  void add( const chainOperation operation, const convolutionType type,
+            const PointTable &table = PointTable() );
+
+  std::vector<ChainStep> mySteps;
+};
+
+
+#endif
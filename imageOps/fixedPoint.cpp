@@ -0,0 +1,78 @@
+/*---------------------.
+| fixedPoint.cpp        \______________________________
+|                                                      \
+| The fixed-point convolution engine.  Each weight of  |
+| a 3x3 matrix is quantized to a 16-bit integer, the   |
+| weight scaled by 2^shift and rounded to nearest,     |
+| and each channel is summed in a 32-bit integer, so   |
+| the result depends on nothing but the matrix and     |
+| the pixels: every build and every processor give     |
+| the same image.  The sum is scaled back down by      |
+| shifting, which truncates like the (int) of the      |
+| floating-point engines (the two differ only below    |
+| zero, where both saturate to 0), and saturated to    |
+| 0...255.  imageOpsSimd.cpp vectorizes the same       |
+| arithmetic, with identical results.                  |
+\_____________________________________________________*/
+
+#include "imageOpsInternal.h"
+
+#include <math.h>
+
+ /*
+ | Quantize the matrix, with the largest shift at which every weight still
+ | fits in 16 bits.
+*/
+void quantizeKernel( const kernel3x3 &matrix, FixedKernel &fixed ) {
+  double largest = 0.0;
+  for (int i=0; i<3; i++)
+    for (int j=0; j<3; j++)
+      if ( fabs(matrix[i][j]) > largest ) largest = fabs(matrix[i][j]);
+
+  fixed.shift = maxFixedShift;
+  while ( fixed.shift > 0 &&
+          floor( largest * (1 << fixed.shift) + 0.5 ) > 32767.0 )
+    fixed.shift--;
+
+  for (int i=0; i<3; i++)
+    for (int j=0; j<3; j++)
+      fixed.weights[i][j] =
+        (int16_t)floor( matrix[i][j] * (1 << fixed.shift) + 0.5 );
+}
+
+ /*
+ | Return the channel sum scaled back down and saturated to 0...255.
+*/
+static inline int fixedToLevel( const int32_t sum, const int shift ) {
+  if ( sum < 0 ) return 0;
+  return limit0_255( sum >> shift );
+}
+
+ /*
+ | Apply the quantized matrix to the pixels x0 <= x < x1 of one row, given
+ | the source row and the rows above and below it.  The taps are the same as
+ | convoluteRowScalar's.
+*/
+void convoluteRowFixed( const uint32_t *above, const uint32_t *center,
+                        const uint32_t *below, uint32_t *out,
+                        const int x0, const int x1, const FixedKernel &fixed ) {
+  const uint32_t *rows[3] = { above, center, below };
+  int32_t rgb[3];
+  uint32_t pix;
+
+  for (int x=x0; x<x1; x++) {
+    rgb[0] = rgb[1] = rgb[2] = 0;
+    for( int row = -1;  row <= 1;  row++ ) {
+      for( int col = -1;  col <= 1;  col++ ) {
+        int32_t weight = fixed.weights[col+1][row+1];
+        pix = rows[col+1][x+row];
+        rgb[0] += pixelRed(pix)   * weight;
+        rgb[1] += pixelGreen(pix) * weight;
+        rgb[2] += pixelBlue(pix)  * weight;
+      }
+    }
+    out[x] = pixelRgb( fixedToLevel( rgb[0], fixed.shift ),
+                       fixedToLevel( rgb[1], fixed.shift ),
+                       fixedToLevel( rgb[2], fixed.shift ) );
+  }
+}
@@ -0,0 +1,115 @@
+/*---------------------.
+| imageOps.cpp          \______________________________
+|                                                      \
+| See the header of imageOps.h for details.            |
+\_____________________________________________________*/
+
+#include "imageOpsInternal.h"
+#include "threadPool.h"
+
+#include <string.h>
+
+ /*
+ | Apply the convolution matrix to the pixels x0 <= x < x1 of one row, given
+ | the source row and the rows above and below it.
+*/
+void convoluteRowScalar( const uint32_t *above, const uint32_t *center,
+                         const uint32_t *below, uint32_t *out,
+                         const int x0, const int x1, const kernel3x3 &matrix ) {
+  const uint32_t *rows[3] = { above, center, below };
+  float rgb[3];
+  uint32_t pix;
+
+  for (int x=x0; x<x1; x++) {
+    rgb[0] = rgb[1] = rgb[2] = 0.0;
+    for( int row = -1;  row <= 1;  row++ ) {
+      for( int col = -1;  col <= 1;  col++ ) {
+        pix = rows[col+1][x+row];
+        rgb[0] += (double)pixelRed(pix)   * matrix[col+1][row+1];
+        rgb[1] += (double)pixelGreen(pix) * matrix[col+1][row+1];
+        rgb[2] += (double)pixelBlue(pix)  * matrix[col+1][row+1];
+      }
+    }
+    out[x] = pixelRgb( limit0_255((int)rgb[0]),
+                       limit0_255((int)rgb[1]),
+                       limit0_255((int)rgb[2]) );
+  }
+}
+
+/*------------------------------------\
+|    Row jobs for the thread pool    |
+\------------------------------------*/
+
+ /*
+ | Convolute the rows of a band.  A band reads the row above and the row below
+ | it from src as well as its own, but only writes its own rows of dst, so
+ | bands may run at the same time, in any order, with identical results.
+*/
+class ConvoluteJob : public RowJob {
+ public:
+  ConvoluteJob( const ImageRows &s, const ImageRows &d, const kernel3x3 &m,
+                convoluteRowFunction f )
+   : src(s), dst(d), matrix(m), convoluteRow(f) {}
+
+  void run( int yBegin, int yEnd ) {
+    for (int y=yBegin; y<yEnd; y++) {
+      memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+      if ( y >= 1 && y < src.height-2 )
+        convoluteRow( src.row(y-1), src.row(y), src.row(y+1), dst.row(y),
+                      1, src.width-2, matrix );
+    }
+  }
+
+  const ImageRows &src, &dst;
+  const kernel3x3 &matrix;
+  convoluteRowFunction convoluteRow;
+};
+
+ /*
+ | Convolute the rows of a band with the fixed-point engine, as ConvoluteJob.
+*/
+class FixedConvoluteJob : public RowJob {
+ public:
+  FixedConvoluteJob( const ImageRows &s, const ImageRows &d,
+                     const FixedKernel &k, convoluteFixedRowFunction f )
+   : src(s), dst(d), fixed(k), convoluteRow(f) {}
+
+  void run( int yBegin, int yEnd ) {
+    for (int y=yBegin; y<yEnd; y++) {
+      memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+      if ( y >= 1 && y < src.height-2 )
+        convoluteRow( src.row(y-1), src.row(y), src.row(y+1), dst.row(y),
+                      1, src.width-2, fixed );
+    }
+  }
+
+  const ImageRows &src, &dst;
+  const FixedKernel &fixed;
+  convoluteFixedRowFunction convoluteRow;
+};
+
+ /*
+ | Apply the given convolution matrix to src, writing the result into dst,
+ | with the row loop of the given engine, spread over the imageOps pool.
+*/
+void imageConvolute( const ImageRows &src, const ImageRows &dst,
+                     const convolutionType type,
+                     const convolutionEngine engine ) {
+  if ( engine == engineFixedPoint ) {
+    FixedKernel fixed;
+    quantizeKernel( convolutionMatrix[type], fixed );
+    convoluteFixedRowFunction convoluteRow = convoluteRowFixed;
+    if ( simdConvoluteFixedRow() ) convoluteRow = simdConvoluteFixedRow();
+
+    FixedConvoluteJob job( src, dst, fixed, convoluteRow );
+    imageOpsPool()->runRows( job, 0, src.height );
+    return;
+  }
+
+  convoluteRowFunction convoluteRow = convoluteRowScalar;
+  if ( engine == engineSimd && simdConvoluteRow() )
+    convoluteRow = simdConvoluteRow();
+
+  ConvoluteJob job( src, dst, convolutionMatrix[type], convoluteRow );
+  imageOpsPool()->runRows( job, 0, src.height );
+}
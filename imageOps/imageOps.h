@@ -0,0 +1,244 @@
+/*---------------------.
+| imageOps.h            \______________________________
+|                                                      \
+| The image manipulation kernels of splatterBoardManip |
+| as a library of their own, with no dependence on QT  |
+| or OpenGL.  The kernels work directly on rows of     |
+| 32-bit pixels, laid out as 0xAARRGGBB (the same      |
+| layout as a QRgb, or a 32-bit QImage), with an       |
+| explicit stride between the rows.                    |
+\_____________________________________________________*/
+
+
+#ifndef IMAGEOPS_H
+#define IMAGEOPS_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+ //convolution matrices, and the names used to choose one
+typedef float     float3[3];
+typedef float3    kernel3x3[3];
+typedef kernel3x3 convolutionKernels[10];
+const convolutionKernels convolutionMatrix =
+ { { { 0.0, 0.0, 0.0 },                      //fade
+     { 0.0, 1.0, 0.0 },
+     { 0.0, 0.0, 0.0 } },
+   { { 0.0, 0.0, 0.0 },                      //intensify
+     { 0.0, 1.0, 0.0 },
+     { 0.0, 0.0, 0.0 } },
+   { { 0.1111111, 0.1111111, 0.1111111 },    //blur
+     { 0.1111111, 0.1111111, 0.1111111 },
+     { 0.1111111, 0.1111111, 0.1111111 } },
+   { { -0.117647, -0.117647, -0.117647 },    //sharpen
+     { -0.117647, 1.941176 , -0.117647 },
+     { -0.117647, -0.117647, -0.117647 } },
+   { { -0.05, -0.07, -0.05  },               //Laplacian-of-Gaussian variant
+     { -0.07, 1.58,  -0.07 },
+     { -0.05, -0.07, -0.05  } },
+   { { 0.0  , 0.0, 0.0  },                   //edgeDetectX
+     { -0.25, 1.5, -0.25 },
+     { 0.0  , 0.0, 0.0  } },
+   { { 0.0, -0.25, 0.0 },                    //edgeDetectY
+     { 0.0, 1.5  , 0.0 },
+     { 0.0, -0.25 , 0.0 } },
+   { {  0.5,  1.5,  0.5  },                  //sobel
+     {  0.0,  1.0,  0.0 },
+     { -0.5, -1.5, -0.5  } },
+   { { 0.75,  -2.25, 0.75  },                //Laplacian
+     { -2.25, 4.0,   -2.25 },
+     { 0.75,  -2.25, 0.75  } },
+   { { 0.25,  -0.75, 0.25  },                //Laplacian2
+     { -0.75, 1.0,   -0.75 },
+     { 0.25,  -0.75, 0.25  } } };
+enum convolutionType { fade, intensify, blur, sharpen, lapOfGauss,
+                       edgeDetectX, edgeDetectY,
+                       sobel, laplacian, laplacian2 };
+
+ /*
+ | A view of a rectangle of 32-bit pixels: width x height pixels, where row y
+ | starts at bits + y*stride.  The view does not own the pixels, so it may
+ | describe a QImage, a part of a larger image, or a plain array.
+*/
+struct ImageRows {
+  uint32_t *bits;      // the top-left pixel
+  int       width, height;
+  ptrdiff_t stride;    // pixels from the start of one row to the next
+
+  ImageRows() : bits(0), width(0), height(0), stride(0) {}
+  ImageRows( uint32_t *b, int w, int h, ptrdiff_t s )
+   : bits(b), width(w), height(h), stride(s) {}
+
+  uint32_t *row( int y ) const { return bits + y * stride; }
+};
+
+ /*
+ | A rectangle of pixels: x0 <= x < x1, y0 <= y < y1.  It is empty if either
+ | range is.
+*/
+struct PixelRect {
+  int x0, y0, x1, y1;
+
+  PixelRect() : x0(0), y0(0), x1(0), y1(0) {}
+  PixelRect( int a, int b, int c, int d ) : x0(a), y0(b), x1(c), y1(d) {}
+
+  bool isEmpty() const { return x0 >= x1 || y0 >= y1; }
+  int  width()   const { return x1 - x0; }
+  int  height()  const { return y1 - y0; }
+
+   // The smallest rectangle holding both this one and r.
+  PixelRect united( const PixelRect &r ) const {
+    if ( isEmpty() ) return r;
+    if ( r.isEmpty() ) return *this;
+    return PixelRect( x0 < r.x0 ? x0 : r.x0, y0 < r.y0 ? y0 : r.y0,
+                      x1 > r.x1 ? x1 : r.x1, y1 > r.y1 ? y1 : r.y1 );
+  }
+   // The part of this rectangle inside r.
+  PixelRect intersected( const PixelRect &r ) const {
+    return PixelRect( x0 > r.x0 ? x0 : r.x0, y0 > r.y0 ? y0 : r.y0,
+                      x1 < r.x1 ? x1 : r.x1, y1 < r.y1 ? y1 : r.y1 );
+  }
+};
+
+ // Channel access for 0xAARRGGBB pixels.
+inline int pixelRed  ( uint32_t pix ) { return (pix >> 16) & 0xff; }
+inline int pixelGreen( uint32_t pix ) { return (pix >>  8) & 0xff; }
+inline int pixelBlue ( uint32_t pix ) { return  pix        & 0xff; }
+inline uint32_t pixelRgb( int r, int g, int b )
+ { return 0xff000000u | (r << 16) | (g << 8) | b; }
+
+ // Return the given integer value limited within the range 0 to 255.
+inline int limit0_255( const int &val ) {
+  if      (val < 0  ) return 0;
+  else if (val > 255) return 255;
+  else return val; 
+}
+
+ // The ways a convolution may be computed: the scalar loop, which is the
+ // reference, or the vectorized loop (see imageOpsSimd.cpp), which is
+ // identical to it on processors with AVX2, and within one level per
+ // channel of it on processors with only SSE2.  The vectorized engine falls
+ // back to the scalar loop on other processors.  The fixed-point engine
+ // (see fixedPoint.cpp) works in 16-bit weights and 32-bit integer sums,
+ // vectorized where possible, and gives the same result on every build and
+ // processor; the quantizing of the weights makes that differ from the
+ // scalar loop's by a level per channel at most, for the built-in matrices.
+enum convolutionEngine { engineScalar, engineSimd, engineFixedPoint };
+
+ // Apply the given convolution matrix to src, writing the result into dst,
+ // which must be the same size and must not overlap src.  The pixels which
+ // the matrix does not fully cover (the first row and column, and the last
+ // two rows and columns) are copied through unchanged.
+void imageConvolute( const ImageRows &src, const ImageRows &dst,
+                     const convolutionType type,
+                     const convolutionEngine engine = engineSimd );
+
+ // The instruction set used by engineSimd: "avx2", "sse2" or "none".
+const char *imageSimdLevel();
+
+ // A point operation, as a table of each channel's new value for each old
+ // value.  The channels are in the order of a pixel's bytes in memory:
+ // blue, green, red, alpha.  Tables compose, so a run of point operations
+ // becomes one table, which touches the pixels once (see pointTable.cpp).
+struct PointTable {
+  uint8_t channel[4][256];
+
+  PointTable();                           // leaves every pixel as it is
+  void then( const PointTable &next );    // this, followed by next
+};
+
+ // The tables of the point operations.  fade and intensify set the alpha
+ // channel to 255, the others leave it alone.  levels stretches black...white
+ // to 0...255, gamma raises each channel to 1/gamma, and threshold takes each
+ // channel to 0 below level and 255 from level up.
+PointTable fadeTable     ( const int fadeDegree );
+PointTable intensifyTable( const int fadeDegree );
+PointTable invertTable   ();
+PointTable levelsTable   ( const int black, const int white );
+PointTable gammaTable    ( const double gamma );
+PointTable thresholdTable( const int level );
+
+ // Apply a table to every pixel, in place.
+void imageApplyTable( const ImageRows &image, const PointTable &table );
+
+ // The point operations, in place, each applying its table.
+void imageFade     ( const ImageRows &image, const int fadeDegree );
+void imageIntensify( const ImageRows &image, const int fadeDegree );
+void imageInvert   ( const ImageRows &image );
+
+ // The filters as first written, a pixel at a time on one thread, kept as
+ // the reference the faster paths above are checked against (see
+ // reference.cpp).  referenceConvolute copies src into dst first.
+void referenceConvolute( const ImageRows &src, const ImageRows &dst,
+                         const convolutionType type );
+void referenceFade     ( const ImageRows &image, const int fadeDegree );
+void referenceIntensify( const ImageRows &image, const int fadeDegree );
+void referenceInvert   ( const ImageRows &image );
+
+ // Blur src into dst with a (2*radius+1) square box, passes times over: one
+ // pass is a box blur, two a tent, three close to a gaussian.  The passes
+ // are split into horizontal and vertical sliding-window sums (see
+ // boxBlur.cpp), so the time taken does not depend on the radius.  Each
+ // channel is rounded to the nearest level.  dst may be the same as src.
+#define maxBlurRadius    1000
+void imageBoxBlur( const ImageRows &src, const ImageRows &dst,
+                   int radius, int passes = 1 );
+
+ // A square matrix of weights of any odd size, such as imageLoadKernel
+ // reads from a kernel file.
+struct ConvolutionKernel {
+  int                size;
+  std::vector<float> weights;    // size x size, a row at a time
+
+  ConvolutionKernel() : size(0) {}
+  const float *matrix() const { return &weights[0]; }
+};
+
+ // Read a kernel from a text file (see kernelFile.cpp for the format).
+ // Return false, with the reason in error, if it cannot be read.
+bool imageLoadKernel( const char *filename, ConvolutionKernel &kernel,
+                      std::string &error );
+
+ // The ways a matrix of any size may be applied: every weight at every pixel;
+ // as a vertical and a horizontal pass, for a matrix which is the product of
+ // a column and a row (see kernelIsSeparable), 2*size multiplications per
+ // pixel rather than size*size; or in the frequency domain (see
+ // fftConvolute.cpp), whose time hardly depends on the size.  methodAuto
+ // picks the quickest for the matrix.
+enum kernelMethod { methodAuto, methodDirect, methodSeparable, methodFourier };
+
+ // Apply a size x size matrix of weights (size odd, given a row at a time,
+ // the top row weighing the pixels above) to src, writing the result into
+ // dst, which must not overlap src.  Pixels within size/2 of the edges are
+ // copied through unchanged.  The methods round differently from each other,
+ // by at most a level per channel.  A method which cannot apply the matrix
+ // falls back to methodDirect.
+void imageConvoluteKernel( const ImageRows &src, const ImageRows &dst,
+                           const float *weights, const int size,
+                           kernelMethod method = methodAuto );
+
+ // The method methodAuto picks for the matrix and image, and its name.
+kernelMethod imageKernelMethod( const ImageRows &src, const float *weights,
+                                const int size );
+const char  *kernelMethodName( const kernelMethod method );
+
+ // Return true if the size x size matrix is the product of a column and a
+ // row, within float rounding, filling in the column and row if it is.
+bool kernelIsSeparable( const float *weights, const int size,
+                        float *column, float *row );
+
+ // The kernels above split the image into bands of rows, which are shared
+ // out between a pool of threads (see threadPool.h); the results do not
+ // depend on the number of threads.  Set the number of threads to use (1
+ // runs the kernels on the caller's thread alone), or 0 for one per
+ // processor, which is the default.  This must not be called while a kernel
+ // is running.
+void imageSetThreadCount( int threads );
+int  imageThreadCount();
+
+
+#endif
@@ -0,0 +1,27 @@
+######################################################################
+# The image manipulation kernels, built as a static library with no
+# dependence on QT or OpenGL.  splatterBoardManip.pro builds and links it.
+######################################################################
+
+TEMPLATE = lib
+INCLUDEPATH += .
+
+# Config
+CONFIG += staticlib warn_on release thread
+CONFIG -= qt
+
+# the pixel loops are written to be vectorized by the compiler, which gcc
+# only does at -O3
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+# Input
+HEADERS += imageOps.h imageOpsInternal.h threadPool.h filterChain.h raster.h \
+           tileHistory.h tiledImage.h mipPyramid.h profiler.h rowStream.h \
+           taskScheduler.h lz4Block.h tileFile.h
+SOURCES += imageOps.cpp imageOpsSimd.cpp threadPool.cpp boxBlur.cpp \
+           kernelConvolute.cpp fftConvolute.cpp kernelFile.cpp \
+           fixedPoint.cpp filterChain.cpp raster.cpp tileHistory.cpp \
+           tiledImage.cpp mipPyramid.cpp pointTable.cpp \
+           reference.cpp profiler.cpp rowStream.cpp taskScheduler.cpp \
+           lz4Block.cpp tileFile.cpp
@@ -0,0 +1,87 @@
+/*---------------------.
+| imageOpsInternal.h    \______________________________
+|                                                      \
+| Declarations shared between the source files of the  |
+| imageOps library, which are not part of its          |
+| interface.                                           |
+\_____________________________________________________*/
+
+
+#ifndef IMAGEOPSINTERNAL_H
+#define IMAGEOPSINTERNAL_H
+
+
+#include "imageOps.h"
+
+
+ // A function which applies a 3x3 convolution matrix to the pixels
+ // x0 <= x < x1 of one row, given the source row and the rows above and below.
+typedef void (*convoluteRowFunction)( const uint32_t *above,
+                                      const uint32_t *center,
+                                      const uint32_t *below, uint32_t *out,
+                                      const int x0, const int x1,
+                                      const kernel3x3 &matrix );
+
+ // The scalar row loop, which is the reference for the other engines.
+void convoluteRowScalar( const uint32_t *above, const uint32_t *center,
+                         const uint32_t *below, uint32_t *out,
+                         const int x0, const int x1, const kernel3x3 &matrix );
+
+ // The fastest vectorized row loop this processor supports, or 0 if none.
+convoluteRowFunction simdConvoluteRow();
+
+ // A function which applies a point table to count pixels in place, the
+ // scalar loop, which is the reference, and the fastest vectorized loop this
+ // processor supports, or 0 if none.  They all give identical results.
+typedef void (*tableRowFunction)( uint32_t *pixels, const int count,
+                                  const PointTable &table );
+
+void tableRowScalar( uint32_t *pixels, const int count,
+                     const PointTable &table );
+
+tableRowFunction simdTableRow();
+
+ // Apply a point table to every pixel of the rows given, on this thread,
+ // with the fastest loop.
+void tableRows( const ImageRows &image, const PointTable &table );
+
+ // A 3x3 matrix quantized for the fixed-point engine (see fixedPoint.cpp):
+ // each weight is round(weight * 2^shift), with the shift as large as the
+ // largest weight allows, up to maxFixedShift.  The nine products of a
+ // channel sum to less than 9 * 2^15 * 255, which fits in 32 bits.
+#define maxFixedShift    15
+struct FixedKernel {
+  int16_t weights[3][3];
+  int     shift;
+};
+
+void quantizeKernel( const kernel3x3 &matrix, FixedKernel &fixed );
+
+ // The fixed-point counterparts of convoluteRowFunction, convoluteRowScalar
+ // and simdConvoluteRow.  The vectorized loops give identical results to the
+ // scalar one.
+typedef void (*convoluteFixedRowFunction)( const uint32_t *above,
+                                           const uint32_t *center,
+                                           const uint32_t *below,
+                                           uint32_t *out,
+                                           const int x0, const int x1,
+                                           const FixedKernel &fixed );
+
+void convoluteRowFixed( const uint32_t *above, const uint32_t *center,
+                        const uint32_t *below, uint32_t *out,
+                        const int x0, const int x1, const FixedKernel &fixed );
+
+convoluteFixedRowFunction simdConvoluteFixedRow();
+
+ // Convolve src with a size x size matrix in the frequency domain, in tiles
+ // of tile x tile pixels (see fftConvolute.cpp), writing dst.  The result is
+ // the same as imageConvoluteKernel's to within a level per channel.
+void fftConvolute( const ImageRows &src, const ImageRows &dst,
+                   const float *weights, const int size, const int tile );
+
+ // The tile size which convolves a width x height image with a size x size
+ // matrix in the least time, or 0 if the matrix is too large for any tile.
+int fftTileSize( int width, int height, int size );
+
+
+#endif
@@ -0,0 +1,351 @@
+/*---------------------.
+| imageOpsSimd.cpp      \______________________________
+|                                                      \
+| Vectorized row loops for the 3x3 convolution, for    |
+| x86 processors with SSE2 or AVX2.  The loop for a    |
+| processor is chosen at run time.  The floating-point |
+| loops come first, then the fixed-point ones.         |
+|                                                      |
+| Each pixel is widened to four 32-bit float channels  |
+| (the alpha channel rides along, and is replaced by   |
+| 255 at the end), the nine taps are accumulated in    |
+| the same order as the scalar loop, and the sums are  |
+| truncated and saturated to 0...255 by the pack       |
+| instructions.                                        |
+|                                                      |
+| rounding: the scalar loop adds each exact product to |
+| a float sum, rounding once per tap.  A fused         |
+| multiply-add does exactly the same, so the AVX2 loop |
+| (which requires FMA as well) gives results identical |
+| to the scalar loop.  SSE2 has no fused multiply-add, |
+| so it rounds each product before adding it; its      |
+| results may differ from the scalar loop by one level |
+| in a channel, where a sum lies within rounding of a  |
+| whole number.                                        |
+|                                                      |
+| The fixed-point loops interleave the 16-bit channels |
+| of two taps, so that one multiply-add instruction    |
+| (pmaddwd) gives each channel's sum over both taps;   |
+| the nine taps take five of them.  Integer sums do    |
+| not depend on the order of the additions, so these   |
+| loops match the scalar fixed-point loop exactly.     |
+|                                                      |
+| The point table loop needs AVX-512 VBMI, whose byte  |
+| permute looks 64 bytes up at once in 128 entries of  |
+| a table; two of them and a blend on the top bit of   |
+| each byte cover the 256.  The older byte shuffles    |
+| reach only 16 entries, and take more instructions to |
+| cover a table than the scalar loop's four loads.     |
+\_____________________________________________________*/
+
+#include "imageOpsInternal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEOPS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+#ifdef IMAGEOPS_X86_SIMD
+
+ /*
+ | SSE2: four pixels per iteration, one pixel per register.
+*/
+__attribute__((target("sse2")))
+static void convoluteRowSse2( const uint32_t *above, const uint32_t *center,
+                              const uint32_t *below, uint32_t *out,
+                              const int x0, const int x1,
+                              const kernel3x3 &matrix ) {
+  const uint32_t *rows[3] = { above, center, below };
+  const __m128i zero  = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32( (int)0xff000000 );
+  int x = x0;
+
+  for ( ; x+4 <= x1; x += 4) {
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps(),
+           sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+
+    for( int row = -1;  row <= 1;  row++ ) {
+      for( int col = -1;  col <= 1;  col++ ) {
+        __m128i pix = _mm_loadu_si128( (const __m128i*)(rows[col+1]+x+row) );
+        __m128i lo  = _mm_unpacklo_epi8( pix, zero );
+        __m128i hi  = _mm_unpackhi_epi8( pix, zero );
+        __m128  weight = _mm_set1_ps( matrix[col+1][row+1] );
+        sum0 = _mm_add_ps( sum0, _mm_mul_ps( weight,
+                 _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ) ) );
+        sum1 = _mm_add_ps( sum1, _mm_mul_ps( weight,
+                 _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ) ) );
+        sum2 = _mm_add_ps( sum2, _mm_mul_ps( weight,
+                 _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ) ) );
+        sum3 = _mm_add_ps( sum3, _mm_mul_ps( weight,
+                 _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ) ) );
+      }
+    }
+
+    __m128i words01 = _mm_packs_epi32( _mm_cvttps_epi32( sum0 ),
+                                       _mm_cvttps_epi32( sum1 ) );
+    __m128i words23 = _mm_packs_epi32( _mm_cvttps_epi32( sum2 ),
+                                       _mm_cvttps_epi32( sum3 ) );
+    _mm_storeu_si128( (__m128i*)(out+x),
+      _mm_or_si128( _mm_packus_epi16( words01, words23 ), alpha ) );
+  }
+
+  convoluteRowScalar( above, center, below, out, x, x1, matrix );
+}
+
+ /*
+ | AVX2 with FMA: eight pixels per iteration, two pixels per register.
+*/
+__attribute__((target("avx2,fma")))
+static void convoluteRowAvx2( const uint32_t *above, const uint32_t *center,
+                              const uint32_t *below, uint32_t *out,
+                              const int x0, const int x1,
+                              const kernel3x3 &matrix ) {
+  const uint32_t *rows[3] = { above, center, below };
+  const __m256i alpha = _mm256_set1_epi32( (int)0xff000000 );
+  int x = x0;
+
+  for ( ; x+8 <= x1; x += 8) {
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps(),
+           sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+
+    for( int row = -1;  row <= 1;  row++ ) {
+      for( int col = -1;  col <= 1;  col++ ) {
+        const uint32_t *src = rows[col+1]+x+row;
+        __m128i pix03 = _mm_loadu_si128( (const __m128i*)src );
+        __m128i pix47 = _mm_loadu_si128( (const __m128i*)(src+4) );
+        __m256  weight = _mm256_set1_ps( matrix[col+1][row+1] );
+        sum0 = _mm256_fmadd_ps( _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32(
+                 pix03 ) ), weight, sum0 );
+        sum1 = _mm256_fmadd_ps( _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32(
+                 _mm_srli_si128( pix03, 8 ) ) ), weight, sum1 );
+        sum2 = _mm256_fmadd_ps( _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32(
+                 pix47 ) ), weight, sum2 );
+        sum3 = _mm256_fmadd_ps( _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32(
+                 _mm_srli_si128( pix47, 8 ) ) ), weight, sum3 );
+      }
+    }
+
+     // the packs work within 128-bit lanes, so the pixels come out in the
+     // order 0 2 4 6 1 3 5 7, and are put back in order by the permute.
+    __m256i words = _mm256_packs_epi32( _mm256_cvttps_epi32( sum0 ),
+                                        _mm256_cvttps_epi32( sum1 ) );
+    __m256i words2 = _mm256_packs_epi32( _mm256_cvttps_epi32( sum2 ),
+                                         _mm256_cvttps_epi32( sum3 ) );
+    __m256i bytes = _mm256_packus_epi16( words, words2 );
+    bytes = _mm256_permutevar8x32_epi32( bytes,
+              _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 ) );
+    _mm256_storeu_si256( (__m256i*)(out+x), _mm256_or_si256( bytes, alpha ) );
+  }
+
+  convoluteRowScalar( above, center, below, out, x, x1, matrix );
+}
+
+
+ /*
+ | The weights of taps a and b of the quantized matrix, interleaved as the
+ | pairs of 16-bit words pmaddwd multiplies the interleaved channels by.
+*/
+static inline int tapPair( const FixedKernel &fixed, int a, int b ) {
+  int16_t wa = fixed.weights[a/3][a%3];
+  int16_t wb = b < 9 ? fixed.weights[b/3][b%3] : 0;
+  return (int)( (uint16_t)wa | ((uint32_t)(uint16_t)wb << 16) );
+}
+
+ /*
+ | SSE2, fixed-point: four pixels per iteration, one pixel per register.
+*/
+__attribute__((target("sse2")))
+static void convoluteFixedRowSse2( const uint32_t *above,
+                                   const uint32_t *center,
+                                   const uint32_t *below, uint32_t *out,
+                                   const int x0, const int x1,
+                                   const FixedKernel &fixed ) {
+  const uint32_t *rows[3] = { above, center, below };
+  const __m128i zero  = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32( (int)0xff000000 );
+  const __m128i shift = _mm_cvtsi32_si128( fixed.shift );
+  __m128i weights[5];
+  for (int pair=0; pair<5; pair++)
+    weights[pair] = _mm_set1_epi32( tapPair( fixed, 2*pair, 2*pair+1 ) );
+  int x = x0;
+
+  for ( ; x+4 <= x1; x += 4) {
+    __m128i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+
+     // tap t is matrix[t/3][t%3], which weighs rows[t/3][x + t%3 - 1]
+    for (int pair=0; pair<5; pair++) {
+      int a = 2*pair, b = 2*pair+1;
+      __m128i pixA = _mm_loadu_si128( (const __m128i*)(rows[a/3]+x+a%3-1) );
+      __m128i pixB = b < 9 ? _mm_loadu_si128( (const __m128i*)
+                                              (rows[b/3]+x+b%3-1) ) : zero;
+      __m128i loA = _mm_unpacklo_epi8( pixA, zero ),
+              hiA = _mm_unpackhi_epi8( pixA, zero );
+      __m128i loB = _mm_unpacklo_epi8( pixB, zero ),
+              hiB = _mm_unpackhi_epi8( pixB, zero );
+      sum0 = _mm_add_epi32( sum0, _mm_madd_epi16(
+               _mm_unpacklo_epi16( loA, loB ), weights[pair] ) );
+      sum1 = _mm_add_epi32( sum1, _mm_madd_epi16(
+               _mm_unpackhi_epi16( loA, loB ), weights[pair] ) );
+      sum2 = _mm_add_epi32( sum2, _mm_madd_epi16(
+               _mm_unpacklo_epi16( hiA, hiB ), weights[pair] ) );
+      sum3 = _mm_add_epi32( sum3, _mm_madd_epi16(
+               _mm_unpackhi_epi16( hiA, hiB ), weights[pair] ) );
+    }
+
+     // the arithmetic shift floors, which differs from truncation only
+     // below zero, and the packs saturate anything below zero to 0
+    __m128i words01 = _mm_packs_epi32( _mm_sra_epi32( sum0, shift ),
+                                       _mm_sra_epi32( sum1, shift ) );
+    __m128i words23 = _mm_packs_epi32( _mm_sra_epi32( sum2, shift ),
+                                       _mm_sra_epi32( sum3, shift ) );
+    _mm_storeu_si128( (__m128i*)(out+x),
+      _mm_or_si128( _mm_packus_epi16( words01, words23 ), alpha ) );
+  }
+
+  convoluteRowFixed( above, center, below, out, x, x1, fixed );
+}
+
+ /*
+ | AVX2, fixed-point: eight pixels per iteration, two pixels per register.
+ | The unpacks and packs both work within 128-bit lanes, so the pixels come
+ | out in order without a permute.
+*/
+__attribute__((target("avx2")))
+static void convoluteFixedRowAvx2( const uint32_t *above,
+                                   const uint32_t *center,
+                                   const uint32_t *below, uint32_t *out,
+                                   const int x0, const int x1,
+                                   const FixedKernel &fixed ) {
+  const uint32_t *rows[3] = { above, center, below };
+  const __m256i zero  = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi32( (int)0xff000000 );
+  const __m128i shift = _mm_cvtsi32_si128( fixed.shift );
+  __m256i weights[5];
+  for (int pair=0; pair<5; pair++)
+    weights[pair] = _mm256_set1_epi32( tapPair( fixed, 2*pair, 2*pair+1 ) );
+  int x = x0;
+
+  for ( ; x+8 <= x1; x += 8) {
+    __m256i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+
+    for (int pair=0; pair<5; pair++) {
+      int a = 2*pair, b = 2*pair+1;
+      __m256i pixA = _mm256_loadu_si256( (const __m256i*)
+                                         (rows[a/3]+x+a%3-1) );
+      __m256i pixB = b < 9 ? _mm256_loadu_si256( (const __m256i*)
+                                                 (rows[b/3]+x+b%3-1) ) : zero;
+      __m256i loA = _mm256_unpacklo_epi8( pixA, zero ),
+              hiA = _mm256_unpackhi_epi8( pixA, zero );
+      __m256i loB = _mm256_unpacklo_epi8( pixB, zero ),
+              hiB = _mm256_unpackhi_epi8( pixB, zero );
+      sum0 = _mm256_add_epi32( sum0, _mm256_madd_epi16(
+               _mm256_unpacklo_epi16( loA, loB ), weights[pair] ) );
+      sum1 = _mm256_add_epi32( sum1, _mm256_madd_epi16(
+               _mm256_unpackhi_epi16( loA, loB ), weights[pair] ) );
+      sum2 = _mm256_add_epi32( sum2, _mm256_madd_epi16(
+               _mm256_unpacklo_epi16( hiA, hiB ), weights[pair] ) );
+      sum3 = _mm256_add_epi32( sum3, _mm256_madd_epi16(
+               _mm256_unpackhi_epi16( hiA, hiB ), weights[pair] ) );
+    }
+
+    __m256i words01 = _mm256_packs_epi32( _mm256_sra_epi32( sum0, shift ),
+                                          _mm256_sra_epi32( sum1, shift ) );
+    __m256i words23 = _mm256_packs_epi32( _mm256_sra_epi32( sum2, shift ),
+                                          _mm256_sra_epi32( sum3, shift ) );
+    _mm256_storeu_si256( (__m256i*)(out+x), _mm256_or_si256(
+      _mm256_packus_epi16( words01, words23 ), alpha ) );
+  }
+
+  convoluteRowFixed( above, center, below, out, x, x1, fixed );
+}
+
+
+ /*
+ | AVX-512 VBMI: sixteen pixels per iteration.  Each byte is looked up in all
+ | four channels' tables, and the channel's own lookup is kept by a mask over
+ | every fourth byte.  The last few pixels of the row are loaded and stored
+ | under a mask.
+*/
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void tableRowVbmi( uint32_t *pixels, const int count,
+                          const PointTable &table ) {
+  __m512i part[4][4];
+  for (int c=0; c<4; c++)
+    for (int p=0; p<4; p++)
+      part[c][p] = _mm512_loadu_si512( table.channel[c] + 64*p );
+
+  for (int x=0; x<count; x+=16) {
+    __mmask16 tail = count - x >= 16 ? (__mmask16)0xffff
+                                     : (__mmask16)((1u << (count - x)) - 1);
+    __m512i in = _mm512_maskz_loadu_epi32( tail, pixels + x );
+    __mmask64 top = _mm512_movepi8_mask( in );
+
+    __m512i out = in;
+    for (int c=0; c<4; c++) {
+      __m512i low  = _mm512_permutex2var_epi8( part[c][0], in, part[c][1] );
+      __m512i high = _mm512_permutex2var_epi8( part[c][2], in, part[c][3] );
+      out = _mm512_mask_blend_epi8( (0x1111111111111111ULL << c) & ~top,
+                                    out, low );
+      out = _mm512_mask_blend_epi8( (0x1111111111111111ULL << c) & top,
+                                    out, high );
+    }
+    _mm512_mask_storeu_epi32( pixels + x, tail, out );
+  }
+}
+
+#endif
+
+
+ /*
+ | Return the fastest row loop this processor supports, or 0 if none.
+*/
+convoluteRowFunction simdConvoluteRow() {
+#ifdef IMAGEOPS_X86_SIMD
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") )
+    return convoluteRowAvx2;
+  if ( __builtin_cpu_supports("sse2") )
+    return convoluteRowSse2;
+#endif
+  return 0;
+}
+
+ /*
+ | Return the fastest fixed-point row loop this processor supports, or 0.
+*/
+convoluteFixedRowFunction simdConvoluteFixedRow() {
+#ifdef IMAGEOPS_X86_SIMD
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx2") )
+    return convoluteFixedRowAvx2;
+  if ( __builtin_cpu_supports("sse2") )
+    return convoluteFixedRowSse2;
+#endif
+  return 0;
+}
+
+ /*
+ | Return the vectorized point table loop, or 0 if this processor has none.
+*/
+tableRowFunction simdTableRow() {
+#ifdef IMAGEOPS_X86_SIMD
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512bw") &&
+       __builtin_cpu_supports("avx512vbmi") )
+    return tableRowVbmi;
+#endif
+  return 0;
+}
+
+ /*
+ | Return the name of the instruction set the vectorized engine uses.
+*/
+const char *imageSimdLevel() {
+#ifdef IMAGEOPS_X86_SIMD
+  convoluteRowFunction function = simdConvoluteRow();
+  if ( function == convoluteRowAvx2 ) return "avx2";
+  if ( function == convoluteRowSse2 ) return "sse2";
+#endif
+  return "none";
+}
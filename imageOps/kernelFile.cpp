@@ -0,0 +1,125 @@
+/*---------------------.
+| kernelFile.cpp        \______________________________
+|                                                      \
+| Reading convolution kernels from text files.  A      |
+| kernel file holds the weights of a square matrix of  |
+| odd size, a row at a time, separated by spaces,      |
+| commas or new lines; the size is the square root of  |
+| the number of weights.  Anything after a '#' on a    |
+| line is a comment.  Two words may come before the    |
+| weights:                                             |
+|                                                      |
+|   scale <s>    every weight is multiplied by s       |
+|   normalize    the weights are scaled to sum to 1    |
+|                                                      |
+| so a 5x5 gaussian may be written with its whole      |
+| number weights, followed by "normalize".             |
+|                                                      |
+| The whole file is read before it is split into       |
+| words, so a line may be as long as a row of the      |
+| largest matrix needs.                                |
+\_____________________________________________________*/
+
+#include "imageOps.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ // the largest matrix accepted
+#define maxKernelSize    255
+
+bool imageLoadKernel( const char *filename, ConvolutionKernel &kernel,
+                      std::string &error ) {
+  FILE *file = fopen( filename, "r" );
+  if ( !file ) {
+    error = std::string("cannot open ") + filename;
+    return false;
+  }
+
+  std::string text;
+  char buffer[4096];
+  size_t bytes;
+  while ( ( bytes = fread( buffer, 1, sizeof(buffer), file ) ) > 0 )
+    text.append( buffer, bytes );
+  bool failed = ferror( file );
+  fclose( file );
+  if ( failed ) {
+    error = std::string("cannot read ") + filename;
+    return false;
+  }
+
+  std::vector<float> weights;
+  double scale = 1.0;
+  bool normalize = false;
+  std::vector<char> line;
+  int lineNumber = 0;
+  error = "";
+
+  for ( size_t start = 0; error.empty() && start < text.size(); ) {
+    size_t end = text.find( '\n', start );
+    if ( end == std::string::npos ) end = text.size();
+    line.assign( text.begin() + start, text.begin() + end );
+    line.push_back( '\0' );
+    start = end + 1;
+    lineNumber++;
+    char *comment = strchr( &line[0], '#' );
+    if ( comment ) *comment = '\0';
+
+    for ( char *word = strtok( &line[0], " \t\r\n," ); word;
+          word = strtok( 0, " \t\r\n," ) ) {
+      char *end;
+      double value = strtod( word, &end );
+      if ( *end == '\0' ) {
+        weights.push_back( (float)value );
+      } else if ( !strcmp( word, "normalize" ) ) {
+        normalize = true;
+      } else if ( !strcmp( word, "scale" ) ) {
+        char *next = strtok( 0, " \t\r\n," );
+        scale = next ? strtod( next, &end ) : 0.0;
+        if ( !next || *end != '\0' ) {
+          char message[64];
+          sprintf( message, "line %d: scale needs a number", lineNumber );
+          error = message;
+          break;
+        }
+      } else {
+        char message[64];
+        sprintf( message, "line %d: not a number: ", lineNumber );
+        error = message + std::string( word );
+        break;
+      }
+    }
+  }
+  if ( !error.empty() ) return false;
+
+  int size = (int)( sqrt( (double)weights.size() ) + 0.5 );
+  if ( weights.empty() || size*size != (int)weights.size() || size%2 == 0 ) {
+    char message[96];
+    sprintf( message, "%d weights do not make a square matrix of odd size",
+             (int)weights.size() );
+    error = message;
+    return false;
+  }
+  if ( size > maxKernelSize ) {
+    error = "the matrix is too large";
+    return false;
+  }
+
+  if ( normalize ) {
+    double sum = 0.0;
+    for (unsigned i=0; i<weights.size(); i++) sum += weights[i];
+    if ( sum == 0.0 ) {
+      error = "the weights sum to 0, so cannot be normalized";
+      return false;
+    }
+    scale /= sum;
+  }
+  for (unsigned i=0; i<weights.size(); i++)
+    weights[i] = (float)( weights[i] * scale );
+
+  kernel.size = size;
+  kernel.weights = weights;
+  return true;
+}
@@ -0,0 +1,188 @@
+/*---------------------.
+| lz4Block.cpp          \______________________________
+|                                                      \
+| See the header of lz4Block.h for details.            |
+|                                                      |
+| A block is a series of sequences: a token byte, the  |
+| count of bytes to copy as they are in its top four   |
+| bits and the length of the match less four in its    |
+| bottom four (15 in either going on in more bytes,    |
+| 255 at a time), the bytes, and the match's distance  |
+| back in two bytes, the low byte first.  The last     |
+| sequence has no match, and the last five bytes are   |
+| always copied as they are.                           |
+|                                                      |
+| Matches are found through a table of where each      |
+| four bytes, hashed, were last seen.  The search      |
+| steps further the longer it goes without a match,    |
+| so bytes which will not compress pass quickly.       |
+\_____________________________________________________*/
+
+#include "lz4Block.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define hashBits       14
+#define minMatch        4
+#define lastLiterals    5   // the bytes at the end copied as they are
+#define matchLimit     12   // no match starts within this of the end
+#define maxDistance 65535
+
+
+static inline uint32_t read32( const unsigned char *p ) {
+  uint32_t value;
+  memcpy( &value, p, sizeof(value) );
+  return value;
+}
+
+static inline uint64_t read64( const unsigned char *p ) {
+  uint64_t value;
+  memcpy( &value, p, sizeof(value) );
+  return value;
+}
+
+static inline int hashOf( uint32_t sequence )
+ { return (int)( ( sequence * 2654435761u ) >> (32 - hashBits) ); }
+
+ /*
+ | Write a length's bytes beyond the 15 its token holds.
+*/
+static inline unsigned char *putLength( unsigned char *out, size_t length ) {
+  for (length-=15; length>=255; length-=255) *out++ = 255;
+  *out++ = (unsigned char)length;
+  return out;
+}
+
+ /*
+ | Write the bytes from anchor to the match, and the match; or with no match,
+ | the last bytes.  Return 0 if they would run past end.
+*/
+static unsigned char *putSequence( unsigned char *out, unsigned char *end,
+                                   const unsigned char *anchor,
+                                   size_t literals, size_t distance,
+                                   size_t matchLength ) {
+  if ( (size_t)(end - out) < 1 + literals + literals/255 + 1 + 2 +
+                             matchLength/255 + 1 )
+    return 0;
+  unsigned char *token = out++;
+  *token = (unsigned char)( ( literals < 15 ? literals : 15 ) << 4 );
+  if ( literals >= 15 ) out = putLength( out, literals );
+  memcpy( out, anchor, literals );
+  out += literals;
+  if ( !distance ) return out;
+
+  *out++ = (unsigned char)distance;
+  *out++ = (unsigned char)( distance >> 8 );
+  matchLength -= minMatch;
+  *token |= (unsigned char)( matchLength < 15 ? matchLength : 15 );
+  if ( matchLength >= 15 ) out = putLength( out, matchLength );
+  return out;
+}
+
+size_t lz4Compress( const unsigned char *src, size_t size,
+                    unsigned char *dst, size_t capacity ) {
+  const unsigned char *in = src, *anchor = src, *end = src + size;
+  unsigned char *out = dst, *outEnd = dst + capacity;
+
+  if ( size > matchLimit ) {
+    const unsigned char *lastMatch = end - matchLimit;
+    const unsigned char *matchEnd  = end - lastLiterals;
+    int32_t table[1 << hashBits];
+    for (int i=0; i<(1 << hashBits); i++) table[i] = -1;
+
+    int misses = 0;
+    while ( in < lastMatch ) {
+      uint32_t sequence = read32( in );
+      int h = hashOf( sequence );
+      int32_t candidate = table[h];
+      table[h] = (int32_t)( in - src );
+      if ( candidate < 0 || in - src - candidate > maxDistance ||
+           read32( src + candidate ) != sequence ) {
+        in += 1 + ( misses++ >> 6 );
+        continue;
+      }
+      misses = 0;
+
+      const unsigned char *match = src + candidate;
+      while ( in > anchor && match > src && in[-1] == match[-1] ) {
+        in--;
+        match--;
+      }
+      const unsigned char *p = in + minMatch, *m = match + minMatch;
+      while ( p + 8 <= matchEnd && read64( p ) == read64( m ) ) {
+        p += 8;
+        m += 8;
+      }
+      while ( p < matchEnd && *p == *m ) {
+        p++;
+        m++;
+      }
+
+      out = putSequence( out, outEnd, anchor, in - anchor, in - match,
+                         p - in );
+      if ( !out ) return 0;
+      in = anchor = p;
+      if ( in - 2 >= src && in < lastMatch )
+        table[ hashOf( read32( in - 2 ) ) ] = (int32_t)( in - 2 - src );
+    }
+  }
+
+  out = putSequence( out, outEnd, anchor, end - anchor, 0, 0 );
+  return out ? out - dst : 0;
+}
+
+ /*
+ | Read a length's bytes beyond the 15 its token holds.
+*/
+static inline bool getLength( const unsigned char *&in,
+                              const unsigned char *end, size_t &length ) {
+  unsigned char b;
+  do {
+    if ( in >= end ) return false;
+    b = *in++;
+    length += b;
+  } while ( b == 255 );
+  return true;
+}
+
+bool lz4Decompress( const unsigned char *src, size_t size,
+                    unsigned char *dst, size_t length ) {
+  const unsigned char *in = src, *end = src + size;
+  unsigned char *out = dst, *outEnd = dst + length;
+
+  while ( in < end ) {
+    unsigned token = *in++;
+    size_t literals = token >> 4;
+    if ( literals == 15 && !getLength( in, end, literals ) ) return false;
+    if ( (size_t)(end - in) < literals || (size_t)(outEnd - out) < literals )
+      return false;
+    memcpy( out, in, literals );
+    in  += literals;
+    out += literals;
+    if ( in == end ) return out == outEnd;
+
+    if ( end - in < 2 ) return false;
+    size_t distance = in[0] | ( in[1] << 8 );
+    in += 2;
+    size_t matchLength = token & 15;
+    if ( matchLength == 15 && !getLength( in, end, matchLength ) )
+      return false;
+    matchLength += minMatch;
+    if ( distance == 0 || distance > (size_t)(out - dst) ||
+         (size_t)(outEnd - out) < matchLength )
+      return false;
+
+     // a match closer than its length repeats itself: copy what there is,
+     // which doubles what there is to copy from, until it is all done
+    const unsigned char *match = out - distance;
+    while ( matchLength > 0 ) {
+      size_t n = (size_t)(out - match);
+      if ( n > matchLength ) n = matchLength;
+      memcpy( out, match, n );
+      out += n;
+      matchLength -= n;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,35 @@
+/*---------------------.
+| lz4Block.h            \______________________________
+|                                                      \
+| Compression in the LZ4 block format: runs of bytes   |
+| copied as they are, each followed by a copy of bytes |
+| from up to 64 KB back.  It is fast both ways, a few  |
+| hundred MB a second to compress and more to expand,  |
+| so an image of flat colour or little detail is kept  |
+| in a fraction of its size at little cost, where one  |
+| of noise is left as it was.                          |
+|                                                      |
+| The blocks are the LZ4 library's, so other tools can |
+| read them, but the library itself is not needed.     |
+\_____________________________________________________*/
+
+
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+
+#include <stddef.h>
+
+
+ // Compress size bytes of src into dst, returning the length compressed, or
+ // 0 if that would be more than capacity bytes.
+size_t lz4Compress( const unsigned char *src, size_t size,
+                    unsigned char *dst, size_t capacity );
+
+ // Expand size bytes of src into exactly length bytes of dst.  Return false
+ // if they are not a whole block which expands to that length.
+bool   lz4Decompress( const unsigned char *src, size_t size,
+                      unsigned char *dst, size_t length );
+
+
+#endif
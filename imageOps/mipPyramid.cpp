@@ -0,0 +1,175 @@
+/*---------------------.
+| mipPyramid.cpp        \______________________________
+|                                                      \
+| See the header of mipPyramid.h for details.          |
+\_____________________________________________________*/
+
+#include "mipPyramid.h"
+#include "profiler.h"
+#include "threadPool.h"
+
+
+ /*
+ | The average of four pixels, each channel rounded to nearest, a byte at a
+ | time within whole words: the top six bits of each byte are summed apart
+ | from the bottom two, so no sum carries into the next byte.
+*/
+static inline uint32_t averagePixels( uint32_t a, uint32_t b, uint32_t c,
+                                      uint32_t d ) {
+  uint32_t high = ((a >> 2) & 0x3f3f3f3fu) + ((b >> 2) & 0x3f3f3f3fu)
+                + ((c >> 2) & 0x3f3f3f3fu) + ((d >> 2) & 0x3f3f3f3fu);
+  uint32_t low  = (a & 0x03030303u) + (b & 0x03030303u) + (c & 0x03030303u)
+                + (d & 0x03030303u) + 0x02020202u;
+  return high + ((low >> 2) & 0x03030303u);
+}
+
+ /*
+ | Make the given tiles of a level from the level below, a tile at a time.
+ | A pixel at the right or bottom edge of a level whose width or height is
+ | odd has only one or two pixels below it, which are counted twice.
+*/
+class MipTileJob : public RowJob {
+ public:
+  MipTileJob( const TiledImage &s, TiledImage &d, const std::vector<int> &t,
+              std::vector<char> &b )
+   : src(s), dst(d), tiles(t), built(b) {}
+
+  void run( int begin, int end ) {
+    std::vector<uint32_t> in;
+    for (int i=begin; i<end; i++) {
+      int column = tiles[i] % dst.tileColumns();
+      int row    = tiles[i] / dst.tileColumns();
+      PixelRect t = dst.tileRect( column, row );
+      PixelRect s = PixelRect( 2*t.x0, 2*t.y0, 2*t.x1, 2*t.y1 )
+                      .intersected( src.rect() );
+      in.resize( s.width() * s.height() );
+      ImageRows pixels( &in[0], s.width(), s.height(), s.width() );
+      src.read( s, pixels );
+
+      ImageRows out = dst.tile( column, row );
+      for (int y=0; y<out.height; y++) {
+        const uint32_t *above = pixels.row( 2*y );
+        const uint32_t *below = pixels.row( 2*y+1 < s.height() ? 2*y+1
+                                                                : 2*y );
+        uint32_t *o = out.row(y);
+        int pairs = s.width() / 2;
+        for (int x=0; x<pairs; x++)
+          o[x] = averagePixels( above[2*x], above[2*x+1],
+                                below[2*x], below[2*x+1] );
+        if ( pairs < out.width )
+          o[pairs] = averagePixels( above[2*pairs], above[2*pairs],
+                                    below[2*pairs], below[2*pairs] );
+      }
+      built[ tiles[i] ] = 1;
+      src.release( s );
+    }
+  }
+
+  const TiledImage &src;
+  TiledImage &dst;
+  const std::vector<int> &tiles;
+  std::vector<char> &built;
+};
+
+
+MipPyramid::MipPyramid()
+ : myBase(0) {}
+
+MipPyramid::~MipPyramid()
+ { reset(); }
+
+void MipPyramid::reset() {
+  for (unsigned n=0; n<myLevels.size(); n++)
+    delete myLevels[n];
+  myLevels.clear();
+  myBuilt.clear();
+}
+
+void MipPyramid::reset( const TiledImage &image ) {
+  reset();
+  myBase = &image;
+  myLevels.resize( levels(), 0 );
+  myBuilt.resize( levels() );
+}
+
+int MipPyramid::levels() const {
+  if ( !myBase ) return 1;
+  int n = 0;
+  while ( (myBase->width()  >> n) > smallestMipSide ||
+          (myBase->height() >> n) > smallestMipSide )
+    n++;
+  return n + 1;
+}
+
+PixelRect MipPyramid::scaled( const PixelRect &rect, int n ) {
+  if ( rect.isEmpty() ) return PixelRect();
+  int round = (1 << n) - 1;
+   // shifting rounds towards minus infinity, whatever the sign
+  return PixelRect( rect.x0 >> n, rect.y0 >> n,
+                    (rect.x1 + round) >> n, (rect.y1 + round) >> n );
+}
+
+void MipPyramid::invalidate( const PixelRect &rect ) {
+  for (unsigned n=1; n<myLevels.size(); n++) {
+    if ( !myLevels[n] ) continue;
+    PixelRect r = scaled( rect, n ).intersected( myLevels[n]->rect() );
+    if ( r.isEmpty() ) continue;
+    for (int row=r.y0/imageTileSize; row*imageTileSize<r.y1; row++)
+      for (int column=r.x0/imageTileSize; column*imageTileSize<r.x1;
+           column++)
+        myBuilt[n][ row * myLevels[n]->tileColumns() + column ] = 0;
+  }
+}
+
+ /*
+ | The level's scratch file is made the first time it is asked for.
+*/
+const TiledImage *MipPyramid::level( int n, const PixelRect &rect,
+                                     std::string &error ) {
+  if ( n <= 0 || !myBase ) return myBase;
+  if ( n >= (int)myLevels.size() ) n = myLevels.size() - 1;
+
+  if ( !myLevels[n] ) {
+    PixelRect size = scaled( myBase->rect(), n );
+    TiledImage *image = new TiledImage;
+    if ( !image->create( size.width(), size.height(), error ) ) {
+      delete image;
+      return 0;
+    }
+    myLevels[n] = image;
+    myBuilt[n].assign( image->tileColumns() * image->tileRows(), 0 );
+  }
+
+  PixelRect r = rect.intersected( myLevels[n]->rect() );
+  if ( !r.isEmpty() ) {
+     // the level below must be up to date under the tiles r touches
+    int t = imageTileSize;
+    PixelRect touched( r.x0/t*t, r.y0/t*t, (r.x1+t-1)/t*t, (r.y1+t-1)/t*t );
+    if ( !level( n-1, PixelRect( 2*touched.x0, 2*touched.y0,
+                                 2*touched.x1, 2*touched.y1 ), error ) )
+      return 0;
+    build( n, r );
+  }
+  return myLevels[n];
+}
+
+ /*
+ | Make the tiles of level n the rectangle touches which are out of date.
+ | The level below must be up to date under them.
+*/
+void MipPyramid::build( int n, const PixelRect &rect ) {
+  TiledImage &image = *myLevels[n];
+  std::vector<int> tiles;
+  for (int row=rect.y0/imageTileSize; row*imageTileSize<rect.y1; row++)
+    for (int column=rect.x0/imageTileSize; column*imageTileSize<rect.x1;
+         column++) {
+      int i = row * image.tileColumns() + column;
+      if ( !myBuilt[n][i] ) tiles.push_back( i );
+    }
+  if ( tiles.empty() ) return;
+
+  StageTimer timer( "pyramid" );
+  const TiledImage &below = n == 1 ? *myBase : *myLevels[n-1];
+  MipTileJob job( below, image, tiles, myBuilt[n] );
+  imageOpsPool()->runRows( job, 0, tiles.size() );
+}
@@ -0,0 +1,66 @@
+/*---------------------.
+| mipPyramid.h          \______________________________
+|                                                      \
+| Smaller copies of an image, for showing it zoomed    |
+| out: each level is half the width and height of the  |
+| one below, each of its pixels the average of four    |
+| there, and level 0 is the image itself.              |
+|                                                      |
+| The levels are made a tile at a time, and only when  |
+| a part of them is asked for, so showing a corner of  |
+| a level costs about the pixels shown.  Drawing on    |
+| the image marks the tiles above the part drawn on to |
+| be made again, the next time they are asked for.     |
+\_____________________________________________________*/
+
+
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+
+#include "tiledImage.h"
+
+#include <string>
+#include <vector>
+
+ // levels are added until the larger side is no more than this
+#define smallestMipSide    64
+
+
+class MipPyramid {
+ public:
+  MipPyramid();
+  ~MipPyramid();
+
+   // Start again over the image, which must stay where it is while the
+   // pyramid is in use.  Its contents and size may change, as long as the
+   // pyramid is told (with invalidate() or reset()).
+  void reset( const TiledImage &image );
+  void reset();
+
+  int levels() const;    // counting level 0
+
+   // Return the given level, with the rectangle of it (in its own pixels)
+   // up to date, or 0, with the reason in error, if it cannot be made.
+  const TiledImage *level( int n, const PixelRect &rect, std::string &error );
+
+   // Mark the levels above the rectangle of the image to be made again.
+  void invalidate( const PixelRect &rect );
+
+   // Return the rectangle of level n which covers the rectangle of level 0.
+  static PixelRect scaled( const PixelRect &rect, int n );
+
+ protected:
+  void build( int n, const PixelRect &rect );
+
+  const TiledImage *myBase;
+  std::vector<TiledImage*> myLevels;          // 0 for level 0, or not made
+  std::vector< std::vector<char> > myBuilt;   // each tile's, row by row
+
+ private:
+  MipPyramid( const MipPyramid & );           // not to be copied
+  MipPyramid &operator=( const MipPyramid & );
+};
+
+
+#endif
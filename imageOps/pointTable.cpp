@@ -0,0 +1,155 @@
+/*---------------------.
+| pointTable.cpp        \______________________________
+|                                                      \
+| The point operations as tables.  Each operation's    |
+| formula is worked out once for each of the 256       |
+| values of a channel, rather than once per channel    |
+| per pixel, and a run of operations is folded into    |
+| one table before the pixels are touched, so any      |
+| number of them cost one pass over the image.         |
+|                                                      |
+| The table is applied a pixel at a time by the scalar |
+| loop, and 16 pixels at a time by the vectorized one  |
+| (see imageOpsSimd.cpp), which looks the bytes up     |
+| with byte permutes.                                  |
+\_____________________________________________________*/
+
+#include "imageOpsInternal.h"
+#include "threadPool.h"
+
+#include <math.h>
+
+
+PointTable::PointTable() {
+  for (int c=0; c<4; c++)
+    for (int v=0; v<256; v++)
+      channel[c][v] = (uint8_t)v;
+}
+
+void PointTable::then( const PointTable &next ) {
+  for (int c=0; c<4; c++)
+    for (int v=0; v<256; v++)
+      channel[c][v] = next.channel[c][ channel[c][v] ];
+}
+
+ /*
+ | Return a table which gives the color channels the values in color, and
+ | sets alpha to 255 or leaves it alone.
+*/
+static PointTable colorTable( const int *color, const bool opaque ) {
+  PointTable table;
+  for (int v=0; v<256; v++) {
+    for (int c=0; c<3; c++)
+      table.channel[c][v] = (uint8_t)color[v];
+    if ( opaque ) table.channel[3][v] = 255;
+  }
+  return table;
+}
+
+ /*
+ | Fade the colors towards white.
+*/
+PointTable fadeTable( const int fadeDegree ) {
+  int color[256];
+  for (int v=0; v<256; v++)
+    color[v] = limit0_255( v/2 + fadeDegree );
+  return colorTable( color, true );
+}
+
+ /*
+ | Intensify the colors towards black.
+*/
+PointTable intensifyTable( const int fadeDegree ) {
+  int color[256];
+  for (int v=0; v<256; v++)
+    color[v] = limit0_255( (v - fadeDegree) * 2 );
+  return colorTable( color, true );
+}
+
+PointTable invertTable() {
+  int color[256];
+  for (int v=0; v<256; v++)
+    color[v] = 255 - v;
+  return colorTable( color, false );
+}
+
+ /*
+ | Stretch black...white to 0...255, rounding to nearest.  With white no
+ | greater than black, the stretch is a step at black.
+*/
+PointTable levelsTable( const int black, const int white ) {
+  if ( white <= black ) return thresholdTable( black+1 );
+  int color[256], range = white - black;
+  for (int v=0; v<256; v++)
+    color[v] = v <= black ? 0 : v >= white ? 255
+             : ((v - black) * 255 + range/2) / range;
+  return colorTable( color, false );
+}
+
+PointTable gammaTable( const double gamma ) {
+  int color[256];
+  for (int v=0; v<256; v++)
+    color[v] = gamma > 0.0 ? (int)( 255.0 * pow( v / 255.0, 1.0 / gamma )
+                                    + 0.5 )
+                           : v;
+  return colorTable( color, false );
+}
+
+PointTable thresholdTable( const int level ) {
+  int color[256];
+  for (int v=0; v<256; v++)
+    color[v] = v < level ? 0 : 255;
+  return colorTable( color, false );
+}
+
+
+ /*
+ | Look each byte of each pixel up in its channel's table.
+*/
+void tableRowScalar( uint32_t *pixels, const int count,
+                     const PointTable &table ) {
+  for (int x=0; x<count; x++) {
+    uint32_t pix = pixels[x];
+    pixels[x] = (uint32_t)table.channel[0][  pix        & 0xff ]
+              | (uint32_t)table.channel[1][ (pix >>  8) & 0xff ] << 8
+              | (uint32_t)table.channel[2][ (pix >> 16) & 0xff ] << 16
+              | (uint32_t)table.channel[3][  pix >> 24         ] << 24;
+  }
+}
+
+void tableRows( const ImageRows &image, const PointTable &table ) {
+  tableRowFunction tableRow = simdTableRow();
+  if ( !tableRow ) tableRow = tableRowScalar;
+  for (int y=0; y<image.height; y++)
+    tableRow( image.row(y), image.width, table );
+}
+
+ /*
+ | Apply a table to the rows of a band.
+*/
+class TableJob : public RowJob {
+ public:
+  TableJob( const ImageRows &i, const PointTable &t ) : image(i), table(t) {}
+
+  void run( int yBegin, int yEnd ) {
+    tableRows( ImageRows( image.row(yBegin), image.width, yEnd-yBegin,
+                          image.stride ), table );
+  }
+
+  const ImageRows &image;
+  const PointTable &table;
+};
+
+void imageApplyTable( const ImageRows &image, const PointTable &table ) {
+  TableJob job( image, table );
+  imageOpsPool()->runRows( job, 0, image.height );
+}
+
+void imageFade( const ImageRows &image, const int fadeDegree )
+ { imageApplyTable( image, fadeTable( fadeDegree ) ); }
+
+void imageIntensify( const ImageRows &image, const int fadeDegree )
+ { imageApplyTable( image, intensifyTable( fadeDegree ) ); }
+
+void imageInvert( const ImageRows &image )
+ { imageApplyTable( image, invertTable() ); }
@@ -0,0 +1,197 @@
+/*---------------------.
+| profiler.cpp          \______________________________
+|                                                      \
+| See the header of profiler.h for details.            |
+|                                                      |
+| Stages may be timed on any thread, so everything is  |
+| kept under one lock.  Stages are coarse (a frame, a  |
+| filter), so it is never held for long or often.      |
+\_____________________________________________________*/
+
+#include "profiler.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+
+ /*
+ | A stage's timings, or a counter, in the order they first appeared.
+*/
+struct ProfileStage {
+  const char *name;
+  bool        counter;
+  long        count;           // timings, or the counter's value
+  double      total, last;     // microseconds
+};
+
+ /*
+ | A timing, a counter's new value or the memory's, for the trace.
+*/
+struct ProfileEvent {
+  const char *name;
+  char        phase;           // 'X' a timing, 'C' a counter
+  double      start, value;    // the duration of a timing
+  pthread_t   thread;
+};
+
+static pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool   profileOn = false;
+static bool            profileTracing = false;
+static std::vector<ProfileStage> profileStages;
+static std::vector<ProfileEvent> profileEvents;
+static long long       memoryBytes = 0, memoryPeak = 0;
+
+static void addEvent( const char *name, char phase, double start,
+                      double value ) {
+  if ( !profileTracing || profileEvents.size() >= maxTraceEvents ) return;
+  ProfileEvent e;
+  e.name   = name;
+  e.phase  = phase;
+  e.start  = start;
+  e.value  = value;
+  e.thread = pthread_self();
+  profileEvents.push_back( e );
+}
+
+static ProfileStage &findStage( const char *name, bool counter ) {
+  for (unsigned i=0; i<profileStages.size(); i++)
+    if ( profileStages[i].name == name ||
+         !strcmp( profileStages[i].name, name ) )
+      return profileStages[i];
+  ProfileStage s;
+  s.name    = name;
+  s.counter = counter;
+  s.count   = 0;
+  s.total   = s.last = 0.0;
+  profileStages.push_back( s );
+  return profileStages.back();
+}
+
+
+void profileEnable( bool on, bool trace ) {
+  pthread_mutex_lock( &profileLock );
+  profileOn = on;
+  profileTracing = on && trace;
+  pthread_mutex_unlock( &profileLock );
+}
+
+bool profileEnabled()
+ { return profileOn; }
+
+double profileNow() {
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+}
+
+void profileAdd( const char *stage, double start, double duration ) {
+  pthread_mutex_lock( &profileLock );
+  ProfileStage &s = findStage( stage, false );
+  s.count++;
+  s.total += duration;
+  s.last   = duration;
+  addEvent( stage, 'X', start, duration );
+  pthread_mutex_unlock( &profileLock );
+}
+
+void profileCount( const char *counter, long amount ) {
+  if ( !profileOn ) return;
+  double now = profileNow();
+  pthread_mutex_lock( &profileLock );
+  ProfileStage &s = findStage( counter, true );
+  s.count += amount;
+  addEvent( counter, 'C', now, s.count );
+  pthread_mutex_unlock( &profileLock );
+}
+
+void profileMemory( long long bytes ) {
+  double now = profileNow();
+  pthread_mutex_lock( &profileLock );
+  memoryBytes += bytes;
+  if ( memoryBytes > memoryPeak ) memoryPeak = memoryBytes;
+  addEvent( "image memory MB", 'C', now, memoryBytes / 1048576.0 );
+  pthread_mutex_unlock( &profileLock );
+}
+
+long long profileMemoryPeak() {
+  pthread_mutex_lock( &profileLock );
+  long long peak = memoryPeak;
+  pthread_mutex_unlock( &profileLock );
+  return peak;
+}
+
+std::string profileSummary() {
+  std::string line;
+  char text[128];
+  pthread_mutex_lock( &profileLock );
+  for (unsigned i=0; i<profileStages.size(); i++) {
+    const ProfileStage &s = profileStages[i];
+    if ( s.counter )
+      snprintf( text, sizeof(text), "%s %ld", s.name, s.count );
+    else
+      snprintf( text, sizeof(text), "%s %.1f ms (mean %.1f)", s.name,
+                s.last / 1000.0, s.total / s.count / 1000.0 );
+    line += text;
+    line += ",  ";
+  }
+  snprintf( text, sizeof(text), "images %.0f MB (peak %.0f MB)",
+            memoryBytes / 1048576.0, memoryPeak / 1048576.0 );
+  line += text;
+  pthread_mutex_unlock( &profileLock );
+  return line;
+}
+
+void profileReset() {
+  pthread_mutex_lock( &profileLock );
+  profileStages.clear();
+  profileEvents.clear();
+  memoryPeak = memoryBytes;
+  pthread_mutex_unlock( &profileLock );
+}
+
+ /*
+ | The threads are numbered in the order their first events were kept, the
+ | first (normally the main thread) from 1.
+*/
+bool profileWriteTrace( const char *filename, std::string &error ) {
+  FILE *file = fopen( filename, "w" );
+  if ( !file ) {
+    error = std::string( "cannot write " ) + filename + ": "
+            + strerror( errno );
+    return false;
+  }
+
+  pthread_mutex_lock( &profileLock );
+  std::vector<pthread_t> threads;
+  fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+  for (unsigned i=0; i<profileEvents.size(); i++) {
+    const ProfileEvent &e = profileEvents[i];
+    unsigned thread = 0;
+    while ( thread < threads.size() &&
+            !pthread_equal( threads[thread], e.thread ) )
+      thread++;
+    if ( thread == threads.size() ) threads.push_back( e.thread );
+
+    if ( e.phase == 'X' )
+      fprintf( file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%.1f,\"dur\":%.1f}",
+               i ? "," : "", e.name, thread+1, e.start, e.value );
+    else
+      fprintf( file, "%s\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%.1f,\"args\":{\"value\":%g}}",
+               i ? "," : "", e.name, thread+1, e.start, e.value );
+  }
+  pthread_mutex_unlock( &profileLock );
+  fprintf( file, "\n]}\n" );
+
+  if ( fclose( file ) != 0 ) {
+    error = std::string( "cannot write " ) + filename + ": "
+            + strerror( errno );
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+/*---------------------.
+| profiler.h            \______________________________
+|                                                      \
+| Timers for the stages of the program's work (drawing |
+| the screen, running a filter, drawing a stroke), to  |
+| see where the time goes.  A StageTimer times the     |
+| scope it is declared in, adding to its stage's count |
+| and totals; with tracing on, each timing is kept as  |
+| an event as well, to be written out in the Chrome    |
+| trace event format (for chrome://tracing, or         |
+| ui.perfetto.dev).  Counters are kept the same way.   |
+|                                                      |
+| The timers are off until switched on, and cost the   |
+| test of a flag while they are.  The memory held by   |
+| the images' scratch files is counted either way.     |
+| Stage and counter names must be string constants.    |
+\_____________________________________________________*/
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+#include <string>
+
+ // events beyond this many are dropped, so that tracing for a long time
+ // takes no more than about 32 MB
+#define maxTraceEvents    1000000
+
+
+ // Switch the timers and counters on or off, and with them, the keeping of
+ // every timing as an event.
+void profileEnable( bool on, bool trace = false );
+bool profileEnabled();
+
+ // Microseconds from some fixed time.
+double profileNow();
+
+ // Add a timing of the stage, from start for duration microseconds.
+void profileAdd( const char *stage, double start, double duration );
+
+ // Add to a counter, such as the pen's motion events.
+void profileCount( const char *counter, long amount = 1 );
+
+ // Note the images taking (or, if negative, giving back) bytes more.
+void profileMemory( long long bytes );
+long long profileMemoryPeak();
+
+ // A line of the last and mean time of each stage, the counters and the
+ // memory, for the status bar.
+std::string profileSummary();
+
+ // Forget the timings, counters and events (and the memory's peak).
+void profileReset();
+
+ // Write the events kept as a Chrome trace.  Return false, with the reason
+ // in error, if the file cannot be written.
+bool profileWriteTrace( const char *filename, std::string &error );
+
+
+class StageTimer {
+ public:
+  StageTimer( const char *stage )
+   : myStage(stage), myStart( profileEnabled() ? profileNow() : -1.0 ) {}
+  ~StageTimer()
+   { if ( myStart >= 0.0 ) profileAdd( myStage, myStart,
+                                       profileNow() - myStart ); }
+
+ protected:
+  const char *myStage;
+  double      myStart;
+
+ private:
+  StageTimer( const StageTimer & );              // not to be copied
+  StageTimer &operator=( const StageTimer & );
+};
+
+
+#endif
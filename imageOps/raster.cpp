@@ -0,0 +1,431 @@
+/*---------------------.
+| raster.cpp            \______________________________
+|                                                      \
+| See the header of raster.h for details.              |
+|                                                      |
+| Every position is first rounded to a sixteenth of a  |
+| pixel, and every color to a level, and from there    |
+| the arithmetic is in integers, so nothing depends on |
+| how a compiler or processor rounds floating point.   |
+|                                                      |
+| A triangle is filled a row at a time: the ends of    |
+| the row's run of pixels are solved from the edges,   |
+| and the run written with its colors stepped across   |
+| it in 16.16 fixed point, four pixels at a time where |
+| SSE2 is to hand, one at a time otherwise, with the   |
+| same sums either way.                                |
+|                                                      |
+| Lines and round points are anti-aliased: each pixel  |
+| near the edge is blended with the color by how much  |
+| of it the shape covers, measured in 256ths.          |
+\_____________________________________________________*/
+
+#include "raster.h"
+
+#include <math.h>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#define subpixelOne    (1 << rasterSubpixelBits)
+#define subpixelHalf   (subpixelOne / 2)
+
+ // The precision of a line's direction, and of the distances measured from it.
+#define directionBits  14
+#define distanceOne    ((int64_t)subpixelOne << directionBits)
+#define distanceHalf   (distanceOne / 2)
+
+ // A color level in 16.16 fixed point, kept within 0.0 to 255.99.
+#define levelMax       0xffffff
+
+
+ /*
+ | Return a color channel of 0.0 to 1.0 as a level of 0 to 255.
+*/
+static inline int channelLevel( const float channel ) {
+  return limit0_255( (int)( channel * 255.0f + 0.5f ) );
+}
+
+ /*
+ | Return a coordinate in pixels as a count of sixteenths.
+*/
+static inline int64_t subpixels( const float coordinate ) {
+  return (int64_t)floor( coordinate * subpixelOne + 0.5f );
+}
+
+ /*
+ | Rounded-down and rounded-up a / b, for b of either sign.
+*/
+static inline int64_t floorDiv( int64_t a, int64_t b ) {
+  if ( b < 0 ) { a = -a;  b = -b; }
+  return a >= 0 ? a / b : -( (-a + b - 1) / b );
+}
+
+static inline int64_t ceilDiv( int64_t a, int64_t b )
+ { return -floorDiv( -a, b ); }
+
+ /*
+ | The rounded-down square root of n, exactly.
+*/
+static inline int64_t isqrt( const int64_t n ) {
+  if ( n <= 0 ) return 0;
+  int64_t r = (int64_t)sqrt( (double)n );
+  while ( r * r > n ) r--;
+  while ( (r + 1) * (r + 1) <= n ) r++;
+  return r;
+}
+
+ /*
+ | num / den, for 0 <= num and 0 < den, in 16.16 fixed point.
+*/
+static inline int32_t fixedRatio( const int64_t num, const int64_t den ) {
+  int64_t whole = num / den;
+  return (int32_t)( (whole << 16) + ((num - whole * den) << 16) / den );
+}
+
+static inline int32_t clampLevel( const int32_t level )
+ { return level < 0 ? 0 : level > levelMax ? levelMax : level; }
+
+static inline uint32_t levelPixel( const int32_t r, const int32_t g,
+                                   const int32_t b ) {
+  return 0xff000000 | ( clampLevel(r) & 0xff0000 ) |
+         ( ( clampLevel(g) >> 8 ) & 0xff00 ) | ( clampLevel(b) >> 16 );
+}
+
+ /*
+ | Blend a level of 0 to 255 into a pixel's channel, by cover/256.
+*/
+static inline uint32_t blendPixel( const uint32_t pixel, const int red,
+                                   const int green, const int blue,
+                                   const int cover ) {
+  int keep = 256 - cover;
+  int r = ( ((pixel >> 16) & 0xff) * keep + red   * cover + 128 ) >> 8;
+  int g = ( ((pixel >>  8) & 0xff) * keep + green * cover + 128 ) >> 8;
+  int b = ( ( pixel        & 0xff) * keep + blue  * cover + 128 ) >> 8;
+  return pixelRgb( r, g, b );
+}
+
+
+/*-------------------------\
+|    Spans                |
+\-------------------------*/
+
+ /*
+ | Fill row[x0] to row[x1-1], the channels starting at level[] and going up by
+ | step[] a pixel.  Sums in 32 bits wrap the same way in either loop, so the
+ | vector loop and the scalar one give the same pixels.
+*/
+static void fillSpan( uint32_t *row, int x0, const int x1,
+                      const int32_t level[3], const int32_t step[3] ) {
+  int32_t r = level[0], g = level[1], b = level[2];
+#ifdef __SSE2__
+  if ( x1 - x0 >= 8 ) {
+    __m128i vr = _mm_setr_epi32( r, r + step[0], r + 2*step[0], r + 3*step[0] );
+    __m128i vg = _mm_setr_epi32( g, g + step[1], g + 2*step[1], g + 3*step[1] );
+    __m128i vb = _mm_setr_epi32( b, b + step[2], b + 2*step[2], b + 3*step[2] );
+    const __m128i sr = _mm_set1_epi32( 4*step[0] );
+    const __m128i sg = _mm_set1_epi32( 4*step[1] );
+    const __m128i sb = _mm_set1_epi32( 4*step[2] );
+    const __m128i top    = _mm_set1_epi32( levelMax );
+    const __m128i alpha  = _mm_set1_epi32( (int)0xff000000 );
+    const __m128i red    = _mm_set1_epi32( 0xff0000 );
+    const __m128i green  = _mm_set1_epi32( 0xff00 );
+    for (; x0+4<=x1; x0+=4) {
+      __m128i c[3] = { vr, vg, vb };
+      for (int i=0; i<3; i++) {
+        c[i] = _mm_andnot_si128( _mm_srai_epi32( c[i], 31 ), c[i] );
+        __m128i over = _mm_cmpgt_epi32( c[i], top );
+        c[i] = _mm_or_si128( _mm_andnot_si128( over, c[i] ),
+                             _mm_and_si128( over, top ) );
+      }
+      __m128i pixels = _mm_or_si128(
+        _mm_or_si128( alpha, _mm_and_si128( c[0], red ) ),
+        _mm_or_si128( _mm_and_si128( _mm_srli_epi32( c[1], 8 ), green ),
+                      _mm_srli_epi32( c[2], 16 ) ) );
+      _mm_storeu_si128( (__m128i*)( row + x0 ), pixels );
+      vr = _mm_add_epi32( vr, sr );
+      vg = _mm_add_epi32( vg, sg );
+      vb = _mm_add_epi32( vb, sb );
+    }
+    r = _mm_cvtsi128_si32( vr );
+    g = _mm_cvtsi128_si32( vg );
+    b = _mm_cvtsi128_si32( vb );
+  }
+#endif
+  for (; x0<x1; x0++) {
+    row[x0] = levelPixel( r, g, b );
+    r += step[0];
+    g += step[1];
+    b += step[2];
+  }
+}
+
+ /*
+ | Narrow the run x0...x1 of pixels on the row through the center y, in
+ | sixteenths, to those on the inside of the edge from p to q, inside being
+ | on the right going from p to q with y downwards.  Pixels centered on the
+ | edge are inside.
+*/
+static void clipSpan( int64_t &x0, int64_t &x1, const int64_t cy,
+                      const int64_t px, const int64_t py,
+                      const int64_t qx, const int64_t qy ) {
+   // inside is where (qx-px)*(cy-py) - (qy-py)*(cx-px) >= 0, for cx the
+   // center of pixel x, 16x + 8
+  int64_t dy = qy - py;
+  int64_t a  = (qx - px) * (cy - py) + dy * px - dy * subpixelHalf;
+  if ( dy > 0 ) {
+    int64_t last = floorDiv( a, dy * subpixelOne );
+    if ( last < x1 ) x1 = last;
+  } else if ( dy < 0 ) {
+    int64_t first = ceilDiv( a, dy * subpixelOne );
+    if ( first > x0 ) x0 = first;
+  } else if ( a < 0 ) {
+    x1 = x0 - 1;
+  }
+}
+
+
+/*-------------------------\
+|    Shapes               |
+\-------------------------*/
+
+PixelRect rasterTriangle( const ImageRows &image, const RasterVertex &a,
+                          const RasterVertex &b, const RasterVertex &c ) {
+  const RasterVertex *v[3] = { &a, &b, &c };
+  int64_t x[3], y[3];
+  int level[3][3];
+  for (int i=0; i<3; i++) {
+    x[i] = subpixels( v[i]->x );
+    y[i] = subpixels( v[i]->y );
+    level[i][0] = channelLevel( v[i]->red );
+    level[i][1] = channelLevel( v[i]->green );
+    level[i][2] = channelLevel( v[i]->blue );
+  }
+
+   // twice the area, made positive by swapping two corners if need be
+  int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+  if ( area == 0 ) return PixelRect();
+  if ( area < 0 ) {
+    std::swap( x[1], x[2] );
+    std::swap( y[1], y[2] );
+    for (int k=0; k<3; k++) std::swap( level[1][k], level[2][k] );
+    area = -area;
+  }
+
+   // the rows whose centers lie within the corners' heights
+  int64_t minY = y[0], maxY = y[0];
+  for (int i=1; i<3; i++) {
+    if ( y[i] < minY ) minY = y[i];
+    if ( y[i] > maxY ) maxY = y[i];
+  }
+  int64_t row0 = ceilDiv( minY - subpixelHalf, subpixelOne );
+  int64_t row1 = floorDiv( maxY - subpixelHalf, subpixelOne ) + 1;
+  if ( row0 < 0 ) row0 = 0;
+  if ( row1 > image.height ) row1 = image.height;
+
+   // Corner i's weight at a point is the edge function of the edge facing
+   // it, so a channel is sum(weight*level)/area.  Each weight goes down by
+   // the height of its edge for every sixteenth to the right.
+  int64_t slope[3];
+  for (int i=0; i<3; i++) {
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    slope[i] = y[j] - y[k];
+  }
+  int32_t step[3];
+  for (int k=0; k<3; k++) {
+    int64_t change = subpixelOne * ( slope[0] * level[0][k] +
+                                     slope[1] * level[1][k] +
+                                     slope[2] * level[2][k] );
+    step[k] = change >= 0 ? fixedRatio( change, area )
+                          : -fixedRatio( -change, area );
+  }
+
+   // The colors are worked out exactly at the left end of each row's run and
+   // stepped from there, so a run cut short by the image's edge has the
+   // same pixels as when drawn whole.  No edge is level with both others,
+   // so the run always has both its ends.
+  PixelRect changed;
+  for (int64_t row=row0; row<row1; row++) {
+    int64_t cy = row * subpixelOne + subpixelHalf;
+    int64_t x0 = -((int64_t)1 << 40), x1 = (int64_t)1 << 40;
+    for (int i=0; i<3; i++) {
+      int j = (i + 1) % 3;
+      clipSpan( x0, x1, cy, x[i], y[i], x[j], y[j] );
+    }
+    int64_t first = x0;
+    if ( x0 < 0 ) x0 = 0;
+    if ( x1 > image.width - 1 ) x1 = image.width - 1;
+    if ( x0 > x1 ) continue;
+
+    int64_t cx = first * subpixelOne + subpixelHalf;
+    int32_t start[3];
+    for (int k=0; k<3; k++) {
+      int64_t sum = 0;
+      for (int i=0; i<3; i++) {
+        int j = (i + 1) % 3, l = (i + 2) % 3;
+        int64_t weight = (x[l] - x[j]) * (cy - y[j]) -
+                         (y[l] - y[j]) * (cx - x[j]);
+        sum += weight * level[i][k];
+      }
+       // a half added, so the levels are rounded rather than cut off
+      start[k] = fixedRatio( sum < 0 ? 0 : sum, area ) + 0x8000 +
+                 (int32_t)( (uint32_t)step[k] * (uint32_t)( x0 - first ) );
+    }
+    fillSpan( image.row( (int)row ), (int)x0, (int)x1 + 1, start, step );
+    changed = changed.united( PixelRect( (int)x0, (int)row, (int)x1 + 1,
+                                         (int)row + 1 ) );
+  }
+  return changed;
+}
+
+PixelRect rasterPolygon( const ImageRows &image, const RasterVertex *corners,
+                         const int count ) {
+  PixelRect changed;
+  for (int i=2; i<count; i++)
+    changed = changed.united( rasterTriangle( image, corners[0],
+                                              corners[i-1], corners[i] ) );
+  return changed;
+}
+
+ /*
+ | The line is a rectangle, width wide, about the segment from a to b.  Its
+ | ends are cut square through a and b, the pixels centered from a up to but
+ | not including b, so lines drawn end to end neither gap nor overlap along
+ | a straight run.  Its sides are blended: a pixel's cover is how far its
+ | center is inside them, to half a pixel either way.  Distances are in
+ | sixteenths of a pixel shifted up by directionBits.
+*/
+PixelRect rasterLine( const ImageRows &image, const RasterVertex &a,
+                      const RasterVertex &b, const float width ) {
+  int64_t ax = subpixels( a.x ), ay = subpixels( a.y );
+  int64_t dx = subpixels( b.x ) - ax, dy = subpixels( b.y ) - ay;
+  int64_t length = isqrt( dx*dx + dy*dy );
+  if ( length == 0 ) return PixelRect();
+
+   // the unit vector along the line; across it is (-ty, tx)
+  int64_t tx = ( dx << directionBits ) / length;
+  int64_t ty = ( dy << directionBits ) / length;
+  int64_t along  = length << directionBits;
+  int64_t across = subpixels( ( width < 1.0 ? 1.0 : width ) / 2.0 )
+                   << directionBits;
+
+  int levelA[3] = { channelLevel( a.red ), channelLevel( a.green ),
+                    channelLevel( a.blue ) };
+  int levelB[3] = { channelLevel( b.red ), channelLevel( b.green ),
+                    channelLevel( b.blue ) };
+
+   // the rows a pixel of the line could touch
+  int64_t reach = ( across >> directionBits ) + subpixelOne;
+  int64_t minY = dy < 0 ? ay + dy : ay, maxY = dy < 0 ? ay : ay + dy;
+  int64_t row0 = floorDiv( minY - reach, subpixelOne );
+  int64_t row1 = floorDiv( maxY + reach, subpixelOne ) + 1;
+  if ( row0 < 0 ) row0 = 0;
+  if ( row1 > image.height ) row1 = image.height;
+
+  PixelRect changed;
+  for (int64_t row=row0; row<row1; row++) {
+    int64_t ry = row * subpixelOne + subpixelHalf - ay;
+
+     // The pixels whose centers are between the ends and less than half a
+     // pixel outside the sides; each distance is s0 + s1*x.
+    int64_t x0 = 0, x1 = image.width - 1;
+    int64_t offsetT = ty * ry + tx * ( subpixelHalf - ax );
+    int64_t offsetN = tx * ry - ty * ( subpixelHalf - ax );
+    int64_t bounds[2][4] = {
+      { offsetT, tx * subpixelOne, -1, along },
+      { offsetN, -ty * subpixelOne, -across - distanceHalf,
+        across + distanceHalf } };
+    for (int i=0; i<2; i++) {
+      int64_t s0 = bounds[i][0], s1 = bounds[i][1];
+      int64_t low = bounds[i][2], high = bounds[i][3];
+      if ( s1 == 0 ) {
+        if ( s0 <= low || s0 >= high ) x1 = x0 - 1;
+        continue;
+      }
+      int64_t first = s1 > 0 ? floorDiv( low - s0, s1 )
+                             : floorDiv( high - s0, s1 );
+      int64_t last  = s1 > 0 ? ceilDiv( high - s0, s1 )
+                             : ceilDiv( low - s0, s1 );
+      if ( first > x0 ) x0 = first;
+      if ( last < x1 ) x1 = last;
+    }
+
+    uint32_t *pixels = image.row( (int)row );
+    int64_t t = offsetT + tx * subpixelOne * x0;
+    int64_t n = offsetN - ty * subpixelOne * x0;
+    int drawn0 = image.width, drawn1 = -1;
+    for (int64_t x=x0; x<=x1; x++, t+=tx*subpixelOne, n-=ty*subpixelOne) {
+      int64_t inside = across - ( n < 0 ? -n : n ) + distanceHalf;
+      if ( t < 0 || t >= along || inside <= 0 ) continue;
+      int cover = inside >= distanceOne ? 256
+                                        : (int)( ( inside << 8 ) / distanceOne );
+      if ( cover == 0 ) continue;
+
+      int64_t share = ( t << 16 ) / along;
+      int color[3];
+      for (int k=0; k<3; k++)
+        color[k] = levelA[k] + (int)( ( ( levelB[k] - levelA[k] ) * share
+                                        + 0x8000 ) >> 16 );
+      pixels[x] = blendPixel( pixels[x], color[0], color[1], color[2], cover );
+      if ( x < drawn0 ) drawn0 = (int)x;
+      drawn1 = (int)x;
+    }
+    if ( drawn1 >= drawn0 )
+      changed = changed.united( PixelRect( drawn0, (int)row, drawn1 + 1,
+                                           (int)row + 1 ) );
+  }
+  return changed;
+}
+
+ /*
+ | A square point covers the pixels whose centers are inside it; a round one
+ | is blended in by how far each pixel's center is inside the circle, to half
+ | a pixel either way, measured in 4096ths of a pixel.
+*/
+PixelRect rasterPoint( const ImageRows &image, const RasterVertex &p,
+                       const float size, const bool round ) {
+  int64_t px = subpixels( p.x ), py = subpixels( p.y );
+  int64_t half = subpixels( ( size < 1.0 ? 1.0 : size ) / 2.0 );
+  int red = channelLevel( p.red ), green = channelLevel( p.green );
+  int blue = channelLevel( p.blue );
+
+  PixelRect changed;
+  if ( !round ) {
+    PixelRect square( (int)ceilDiv( px - half - subpixelHalf, subpixelOne ),
+                      (int)ceilDiv( py - half - subpixelHalf, subpixelOne ),
+                      (int)ceilDiv( px + half - subpixelHalf, subpixelOne ),
+                      (int)ceilDiv( py + half - subpixelHalf, subpixelOne ) );
+    changed = square.intersected( PixelRect( 0, 0, image.width,
+                                             image.height ) );
+    if ( changed.isEmpty() ) return changed;
+    int32_t level[3] = { red << 16, green << 16, blue << 16 };
+    int32_t step[3]  = { 0, 0, 0 };
+    for (int y=changed.y0; y<changed.y1; y++)
+      fillSpan( image.row(y), changed.x0, changed.x1, level, step );
+    return changed;
+  }
+
+  int64_t outer = half + subpixelOne;
+  PixelRect bounds( (int)floorDiv( px - outer, subpixelOne ),
+                    (int)floorDiv( py - outer, subpixelOne ),
+                    (int)floorDiv( px + outer, subpixelOne ) + 1,
+                    (int)floorDiv( py + outer, subpixelOne ) + 1 );
+  bounds = bounds.intersected( PixelRect( 0, 0, image.width, image.height ) );
+  int64_t radius = half << 8;
+  for (int y=bounds.y0; y<bounds.y1; y++) {
+    int64_t dy = y * subpixelOne + subpixelHalf - py;
+    uint32_t *row = image.row(y);
+    for (int x=bounds.x0; x<bounds.x1; x++) {
+      int64_t dx = x * subpixelOne + subpixelHalf - px;
+      int64_t inside = radius + 2048 - isqrt( ( dx*dx + dy*dy ) << 16 );
+      if ( inside <= 0 ) continue;
+      int cover = inside >= 4096 ? 256 : (int)( inside >> 4 );
+      if ( cover == 0 ) continue;
+      row[x] = blendPixel( row[x], red, green, blue, cover );
+      changed = changed.united( PixelRect( x, y, x+1, y+1 ) );
+    }
+  }
+  return changed;
+}
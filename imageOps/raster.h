@@ -0,0 +1,80 @@
+/*---------------------.
+| raster.h              \______________________________
+|                                                      \
+| Drawing of the canvas tools' shapes straight into an |
+| image: points, wide lines and convex polygons, with  |
+| colors shaded smoothly between the vertices as       |
+| OpenGL's smooth shading does.  The canvas draws its  |
+| strokes with these, so that its image holds every    |
+| stroke without reading the pixels back from OpenGL.  |
+|                                                      |
+| Coordinates are in pixels, with y downwards, and     |
+| the center of pixel (x,y) at (x+0.5, y+0.5).  A      |
+| pixel is filled if its center is inside the shape;   |
+| lines and round points are blended into the pixels   |
+| along their edges by how much of each they cover.    |
+| Each function returns the rectangle it may have      |
+| changed, within the image.                           |
+|                                                      |
+| Positions are rounded to 1/16 of a pixel and colors  |
+| to levels of 0 to 255, and all else is done in       |
+| integers, so a shape comes out the same to the bit   |
+| on every machine and with every compiler.            |
+\_____________________________________________________*/
+
+
+#ifndef RASTER_H
+#define RASTER_H
+
+
+#include "imageOps.h"
+
+#include <math.h>
+
+
+ // Positions are rounded to 2^-rasterSubpixelBits of a pixel.
+#define rasterSubpixelBits  4
+
+ /*
+ | Return a coordinate rounded as the rasterizer rounds it.  A shape whose
+ | corners are rounded so first may be moved by whole pixels, as into the
+ | coordinates of a tile, exactly, and so draws the same pixels wherever it
+ | is drawn from.
+*/
+inline float rasterSnap( const float coordinate ) {
+  return floor( coordinate * (1 << rasterSubpixelBits) + 0.5f )
+         / (1 << rasterSubpixelBits);
+}
+
+ /*
+ | A corner of a shape, and its color, each channel 0.0 to 1.0 as in OpenGL.
+ | Channels outside that range are taken as the nearest end of it.
+*/
+struct RasterVertex {
+  float x, y;
+  float red, green, blue;
+
+  RasterVertex() : x(0), y(0), red(0), green(0), blue(0) {}
+  RasterVertex( float xx, float yy, float r, float g, float b )
+   : x(xx), y(yy), red(r), green(g), blue(b) {}
+};
+
+ // A triangle, with its colors blended across it.
+PixelRect rasterTriangle( const ImageRows &image, const RasterVertex &a,
+                          const RasterVertex &b, const RasterVertex &c );
+
+ // A convex polygon of count corners, cut into a fan of triangles about the
+ // first corner, as OpenGL draws GL_POLYGON.
+PixelRect rasterPolygon( const ImageRows &image, const RasterVertex *corners,
+                         const int count );
+
+ // A line width pixels wide from a to b, its color blended along it.
+PixelRect rasterLine( const ImageRows &image, const RasterVertex &a,
+                      const RasterVertex &b, const float width );
+
+ // A point size pixels across, round or square, in the color of p.
+PixelRect rasterPoint( const ImageRows &image, const RasterVertex &p,
+                       const float size, const bool round );
+
+
+#endif
@@ -0,0 +1,75 @@
+/*---------------------.
+| reference.cpp         \______________________________
+|                                                      \
+| The filters as the canvas first wrote them: a pixel  |
+| at a time, on one thread, with no tables, tiles or   |
+| vector instructions.  They are far too slow to use,  |
+| and are kept only so that the faster paths can be    |
+| checked against them (see verifyMode.cpp).  Do not   |
+| speed them up.                                       |
+\_____________________________________________________*/
+
+#include "imageOps.h"
+
+#include <string.h>
+
+
+void referenceConvolute( const ImageRows &src, const ImageRows &dst,
+                         const convolutionType type ) {
+  const kernel3x3 &matrix = convolutionMatrix[type];
+  float rgb[3];
+  uint32_t pix;
+
+  for (int y=0; y<src.height; y++)
+    memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+
+  for (int x=1; x<(src.width-2); x++)
+    for (int y=1; y<(src.height-2); y++) {
+
+      rgb[0] = rgb[1] = rgb[2] = 0.0;
+      for( int row = -1;  row <= 1;  row++ ) {
+        for( int col = -1;  col <= 1;  col++ ) {
+          pix = src.row( y+col )[ x+row ];
+          rgb[0] += (double)pixelRed(pix)   * matrix[col+1][row+1];
+          rgb[1] += (double)pixelGreen(pix) * matrix[col+1][row+1];
+          rgb[2] += (double)pixelBlue(pix)  * matrix[col+1][row+1];
+        }
+      }
+
+      dst.row(y)[x] = pixelRgb( limit0_255((int)rgb[0]),
+                                limit0_255((int)rgb[1]),
+                                limit0_255((int)rgb[2]) );
+    }
+}
+
+void referenceFade( const ImageRows &image, const int fadeDegree ) {
+  uint32_t pix;
+
+  for (int y=0; y<image.height; y++)
+    for (int x=0; x<image.width; x++) {
+      pix = image.row(y)[x];
+      image.row(y)[x] =
+       pixelRgb( limit0_255( pixelRed(pix)/2   + fadeDegree ),
+                 limit0_255( pixelGreen(pix)/2 + fadeDegree ),
+                 limit0_255( pixelBlue(pix)/2  + fadeDegree ) );
+    }
+}
+
+void referenceIntensify( const ImageRows &image, const int fadeDegree ) {
+  uint32_t pix;
+
+  for (int y=0; y<image.height; y++)
+    for (int x=0; x<image.width; x++) {
+      pix = image.row(y)[x];
+      image.row(y)[x] =
+       pixelRgb( limit0_255( (pixelRed(pix)   - fadeDegree) * 2 ),
+                 limit0_255( (pixelGreen(pix) - fadeDegree) * 2 ),
+                 limit0_255( (pixelBlue(pix)  - fadeDegree) * 2 ) );
+    }
+}
+
+void referenceInvert( const ImageRows &image ) {
+  for (int y=0; y<image.height; y++)
+    for (int x=0; x<image.width; x++)
+      image.row(y)[x] ^= 0x00ffffff;
+}
@@ -0,0 +1,80 @@
+/*---------------------.
+| rowStream.cpp         \______________________________
+|                                                      \
+| See the header of rowStream.h for details.           |
+|                                                      |
+| The band of rows [next, next+band) is filtered once  |
+| the rows down to halo below it have arrived, along   |
+| with the halo above it, exactly as tiledApply()      |
+| filters a block with its margin: the filter treats   |
+| the margin's outer rows as the image's edges, but    |
+| they are not handed on, and the rows which are come  |
+| out as they would from the whole image.  The rows    |
+| still needed are then moved up to the top, which is  |
+| 2*halo rows copied for every band.                   |
+\_____________________________________________________*/
+
+#include "rowStream.h"
+
+#include <string.h>
+
+
+RowStream::RowStream( const TileFilter &filter, int width, int height,
+                      RowSink &sink, int bandRows )
+ : myFilter(filter), mySink(sink), myWidth(width), myHeight(height),
+   myHalo( filter.halo() ), myBandRows( bandRows > 0 ? bandRows : 1 ),
+   myTop(0), myFilled(0), myNext(0) {
+  myIn.resize( (size_t)(myBandRows + 2 * myHalo) * myWidth + 1 );
+   // a point operation runs in place
+  if ( myHalo > 0 ) myOut.resize( myIn.size() );
+}
+
+ /*
+ | A row may complete more than one band, when the halo is deeper than a band
+ | or the image has ended.
+*/
+bool RowStream::pushRow() {
+  myFilled++;
+  while ( myNext < myHeight ) {
+    int bandEnd = myNext + myBandRows < myHeight ? myNext + myBandRows
+                                                 : myHeight;
+    int needed  = bandEnd + myHalo < myHeight ? bandEnd + myHalo : myHeight;
+    if ( myTop + myFilled < needed ) break;
+    if ( !runBand() ) return false;
+  }
+  return true;
+}
+
+bool RowStream::putRow( const uint32_t *row ) {
+  memcpy( nextRow(), row, myWidth * sizeof(uint32_t) );
+  return pushRow();
+}
+
+bool RowStream::runBand() {
+  int bandEnd = myNext + myBandRows < myHeight ? myNext + myBandRows
+                                               : myHeight;
+  ImageRows src( &myIn[0], myWidth, myFilled, myWidth );
+  ImageRows dst = myHalo > 0 ? ImageRows( &myOut[0], myWidth, myFilled,
+                                          myWidth )
+                             : src;
+  myFilter.run( src, dst );
+
+  for (int y=myNext; y<bandEnd; y++)
+    if ( !mySink.putRow( dst.row( y - myTop ) ) ) return false;
+  myNext = bandEnd;
+
+  int keep = myNext - myHalo > 0 ? myNext - myHalo : 0;
+  int rows = myTop + myFilled - keep;
+  if ( rows > 0 )
+    memmove( &myIn[0], src.row( keep - myTop ),
+             (size_t)rows * myWidth * sizeof(uint32_t) );
+  myTop    = keep;
+  myFilled = rows;
+  return true;
+}
+
+int RowStream::rowsHeld() const
+ { return myBandRows + 2 * myHalo; }
+
+size_t RowStream::bytes() const
+ { return (myIn.size() + myOut.size()) * sizeof(uint32_t); }
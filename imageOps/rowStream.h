@@ -0,0 +1,82 @@
+/*---------------------.
+| rowStream.h           \______________________________
+|                                                      \
+| A filter run over an image as its rows arrive, for   |
+| images too large to hold: a RowStream is handed the  |
+| image a row at a time, from the top, and hands each  |
+| row of the result on as soon as the rows it depends  |
+| on have arrived.  It holds a band of rows and the    |
+| filter's margin above and below it, so the memory it |
+| takes depends on the width of the image and the      |
+| filter, not on the height.                           |
+|                                                      |
+| The result is the same as applying the filter to the |
+| whole image at once.  A RowStream is a RowSink       |
+| itself, so streams may be joined one into the next.  |
+\_____________________________________________________*/
+
+
+#ifndef ROWSTREAM_H
+#define ROWSTREAM_H
+
+
+#include "tiledImage.h"
+
+#include <vector>
+
+ // the rows of the result made at a time; the fewer, the less memory, but
+ // the more often the margin is filtered again
+#define streamBandRows    16
+
+
+ /*
+ | Where the rows of a stream go, from the top.
+*/
+class RowSink {
+ public:
+  virtual ~RowSink() {}
+   // Take the next row, width pixels.  Return false to stop the stream.
+  virtual bool putRow( const uint32_t *row ) = 0;
+};
+
+
+class RowStream : public RowSink {
+ public:
+   // Run the filter over an image of the given size, handing the result on
+   // to sink.  The filter and sink must last as long as the stream.
+  RowStream( const TileFilter &filter, int width, int height, RowSink &sink,
+             int bandRows = streamBandRows );
+
+   // Where to write the next row of the image, width pixels, before
+   // calling pushRow().
+  uint32_t *nextRow() { return &myIn[ myFilled * myWidth ]; }
+
+   // Take the row written into nextRow(), handing on the rows of the result
+   // it completes.  Return false if the sink stopped the stream.
+  bool pushRow();
+
+   // Copy the row into nextRow() and push it.
+  bool putRow( const uint32_t *row );
+
+   // The rows held, and the bytes of memory they take.
+  int    rowsHeld() const;
+  size_t bytes()    const;
+
+ protected:
+  bool runBand();
+
+  const TileFilter &myFilter;
+  RowSink          &mySink;
+  int myWidth, myHeight, myHalo, myBandRows;
+  int myTop;        // the row of the image held at the top of myIn
+  int myFilled;     // the rows held in myIn
+  int myNext;       // the next row of the result to hand on
+  std::vector<uint32_t> myIn, myOut;
+
+ private:
+  RowStream( const RowStream & );                // not to be copied
+  RowStream &operator=( const RowStream & );
+};
+
+
+#endif
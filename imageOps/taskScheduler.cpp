@@ -0,0 +1,140 @@
+/*---------------------.
+| taskScheduler.cpp     \______________________________
+|                                                      \
+| See the header of taskScheduler.h for details.       |
+|                                                      |
+| Each queue has its lock, so threads only meet when   |
+| one steals from another.  A thread which finds every |
+| queue empty waits for a spawn, or for the last task  |
+| to finish; it notes the spawn count before looking,  |
+| so a spawn made while it looks is never missed.      |
+\_____________________________________________________*/
+
+#include "taskScheduler.h"
+
+
+TaskScheduler::TaskScheduler( int threads ) {
+  myThreadCount = threads < 1 ? 1 : threads;
+  for (int i=0; i<myThreadCount; i++) {
+    TaskQueue *queue = new TaskQueue;
+    pthread_mutex_init( &queue->lock, 0 );
+    myQueues.push_back( queue );
+  }
+  myNextQueue = 0;
+  myPending = 0;
+  mySpawned = 0;
+  pthread_mutex_init( &myLock, 0 );
+  pthread_cond_init( &myWake, 0 );
+}
+
+ /*
+ | Delete any tasks which were never run.
+*/
+TaskScheduler::~TaskScheduler() {
+  for (unsigned i=0; i<myQueues.size(); i++) {
+    for (unsigned j=0; j<myQueues[i]->tasks.size(); j++)
+      delete myQueues[i]->tasks[j];
+    pthread_mutex_destroy( &myQueues[i]->lock );
+    delete myQueues[i];
+  }
+  pthread_cond_destroy( &myWake );
+  pthread_mutex_destroy( &myLock );
+}
+
+void TaskScheduler::spawn( Task *task, int worker ) {
+  if ( worker >= myThreadCount ) worker = -1;
+  pthread_mutex_lock( &myLock );
+  TaskQueue *queue = myQueues[ worker >= 0 ? worker : myNextQueue ];
+  if ( worker < 0 ) myNextQueue = (myNextQueue + 1) % myThreadCount;
+  myPending++;
+  pthread_mutex_unlock( &myLock );
+
+  pthread_mutex_lock( &queue->lock );
+  if ( worker >= 0 )
+    queue->tasks.push_front( task );
+  else
+    queue->tasks.push_back( task );
+  pthread_mutex_unlock( &queue->lock );
+
+  pthread_mutex_lock( &myLock );
+  mySpawned++;
+  pthread_cond_signal( &myWake );
+  pthread_mutex_unlock( &myLock );
+}
+
+ /*
+ | Take the newest task from the worker's own queue, or failing that the
+ | oldest from the next queue round which has one.  Return 0 if all are
+ | empty.
+*/
+Task *TaskScheduler::take( int worker ) {
+  for (int i=0; i<myThreadCount; i++) {
+    TaskQueue *queue = myQueues[ (worker + i) % myThreadCount ];
+    Task *task = 0;
+    pthread_mutex_lock( &queue->lock );
+    if ( !queue->tasks.empty() ) {
+      if ( i == 0 ) {
+        task = queue->tasks.front();
+        queue->tasks.pop_front();
+      } else {
+        task = queue->tasks.back();
+        queue->tasks.pop_back();
+      }
+    }
+    pthread_mutex_unlock( &queue->lock );
+    if ( task ) return task;
+  }
+  return 0;
+}
+
+ /*
+ | Run tasks until every one spawned has finished.
+*/
+void TaskScheduler::work( int worker ) {
+  for (;;) {
+    pthread_mutex_lock( &myLock );
+    unsigned long spawned = mySpawned;
+    pthread_mutex_unlock( &myLock );
+
+    Task *task = take( worker );
+    if ( task ) {
+      task->run( *this, worker );
+      delete task;
+      pthread_mutex_lock( &myLock );
+      if ( --myPending == 0 ) pthread_cond_broadcast( &myWake );
+      pthread_mutex_unlock( &myLock );
+      continue;
+    }
+
+    pthread_mutex_lock( &myLock );
+    while ( myPending > 0 && mySpawned == spawned )
+      pthread_cond_wait( &myWake, &myLock );
+    bool finished = myPending == 0;
+    pthread_mutex_unlock( &myLock );
+    if ( finished ) return;
+  }
+}
+
+struct WorkerStart {
+  TaskScheduler *scheduler;
+  int            worker;
+};
+
+void *TaskScheduler::workerMain( void *data ) {
+  WorkerStart *start = (WorkerStart*)data;
+  start->scheduler->work( start->worker );
+  return 0;
+}
+
+void TaskScheduler::run() {
+  std::vector<pthread_t>   threads( myThreadCount );
+  std::vector<WorkerStart> starts( myThreadCount );
+  for (int i=1; i<myThreadCount; i++) {
+    starts[i].scheduler = this;
+    starts[i].worker = i;
+    pthread_create( &threads[i], 0, workerMain, &starts[i] );
+  }
+  work( 0 );
+  for (int i=1; i<myThreadCount; i++)
+    pthread_join( threads[i], 0 );
+}
@@ -0,0 +1,86 @@
+/*---------------------.
+| taskScheduler.h       \______________________________
+|                                                      \
+| Threads which share out a set of tasks by work       |
+| stealing, for work which comes in pieces of very     |
+| different sizes, or which makes more work as it goes |
+| (a file read makes a filter to run, which makes a    |
+| file to write).  Each thread keeps its own queue of  |
+| tasks, runs the newest first, and when it runs out   |
+| takes the oldest from another thread's queue, so     |
+| that no thread sits idle while another has work      |
+| waiting.                                             |
+|                                                      |
+| Unlike a ThreadPool, which runs one job's bands at a |
+| time, any number of unrelated tasks may be under way |
+| at once.                                             |
+\_____________________________________________________*/
+
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+
+class TaskScheduler;
+
+ /*
+ | A piece of work.  run() is called once, on any of the scheduler's threads
+ | (given as worker), and may spawn more tasks.
+*/
+class Task {
+ public:
+  virtual ~Task() {}
+  virtual void run( TaskScheduler &scheduler, int worker ) = 0;
+};
+
+
+class TaskScheduler {
+ public:
+  TaskScheduler( int threads );
+  ~TaskScheduler();
+
+  int threadCount() const { return myThreadCount; }
+
+   // Add a task to the worker's queue, to be run next by that worker unless
+   // another takes it first.  Before run(), tasks spawned with no worker
+   // are dealt out between the queues in turn.  The scheduler deletes each
+   // task once it has run.
+  void spawn( Task *task, int worker = -1 );
+
+   // Run the tasks on threadCount() threads, counting the caller's, until
+   // they, and every task they spawn, are done.
+  void run();
+
+ protected:
+  static void *workerMain( void *data );
+  void  work( int worker );
+  Task *take( int worker );
+
+  struct TaskQueue {
+    pthread_mutex_t    lock;
+    std::deque<Task*>  tasks;   // the newest at the front
+  };
+
+  int                     myThreadCount;
+  std::vector<TaskQueue*> myQueues;
+  int                     myNextQueue;
+
+   // The tasks spawned and not yet finished, and the count of all spawned,
+   // for a thread with nothing to do to wait on; guarded by myLock.
+  pthread_mutex_t myLock;
+  pthread_cond_t  myWake;
+  long            myPending;
+  unsigned long   mySpawned;
+
+ private:
+  TaskScheduler( const TaskScheduler & );        // not to be copied
+  TaskScheduler &operator=( const TaskScheduler & );
+};
+
+
+#endif
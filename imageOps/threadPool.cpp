@@ -0,0 +1,155 @@
+/*---------------------.
+| threadPool.cpp        \______________________________
+|                                                      \
+| See the header of threadPool.h for details.          |
+\_____________________________________________________*/
+
+#include "threadPool.h"
+#include "imageOps.h"
+
+#include <unistd.h>
+
+ // bands are never made smaller than this, so that small images are not
+ // spread so thinly that handing out the bands costs more than the work.
+#define minimumBandRows    8
+ // the number of bands each thread gets, when the image is large enough.
+#define bandsPerThread     4
+
+ /*
+ | Construct a pool of the given number of threads, counting the thread which
+ | calls runRows(), so threads-1 workers are started.
+*/
+ThreadPool::ThreadPool( int threads ) {
+  myThreadCount = threads < 1 ? 1 : threads;
+  myJob = 0;
+  myNextRow = myEndRow = myBandRows = 0;
+  myBusyWorkers = 0;
+  myGeneration = 0;
+  myQuitting = false;
+
+  pthread_mutex_init( &myLock, 0 );
+  pthread_cond_init( &myWake, 0 );
+  pthread_cond_init( &myDone, 0 );
+
+  myWorkers = new pthread_t[myThreadCount];
+  for ( int i = 1; i < myThreadCount; i++ )
+    pthread_create( &myWorkers[i], 0, workerMain, this );
+}
+
+ /*
+ | Stop the workers and wait for them to exit.
+*/
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock( &myLock );
+  myQuitting = true;
+  pthread_cond_broadcast( &myWake );
+  pthread_mutex_unlock( &myLock );
+
+  for ( int i = 1; i < myThreadCount; i++ )
+    pthread_join( myWorkers[i], 0 );
+  delete [] myWorkers;
+
+  pthread_cond_destroy( &myDone );
+  pthread_cond_destroy( &myWake );
+  pthread_mutex_destroy( &myLock );
+}
+
+ /*
+ | Take bands from the current job and run them until none are left.
+ | Called, and returns, with myLock held.
+*/
+void ThreadPool::workOnBands() {
+  while ( myNextRow < myEndRow ) {
+    int yBegin = myNextRow;
+    int yEnd   = yBegin + myBandRows < myEndRow ? yBegin + myBandRows
+                                                : myEndRow;
+    myNextRow = yEnd;
+
+    pthread_mutex_unlock( &myLock );
+    myJob->run( yBegin, yEnd );
+    pthread_mutex_lock( &myLock );
+  }
+}
+
+ /*
+ | The body of each worker thread: wait for a new job, help with it, and
+ | report back when there are no bands left.
+*/
+void *ThreadPool::workerMain( void *data ) {
+  ThreadPool *pool = (ThreadPool*)data;
+  unsigned seenGeneration = 0;
+
+  pthread_mutex_lock( &pool->myLock );
+  for (;;) {
+    while ( !pool->myQuitting && pool->myGeneration == seenGeneration )
+      pthread_cond_wait( &pool->myWake, &pool->myLock );
+    if ( pool->myQuitting ) break;
+    seenGeneration = pool->myGeneration;
+
+    pool->workOnBands();
+    if ( --pool->myBusyWorkers == 0 )
+      pthread_cond_signal( &pool->myDone );
+  }
+  pthread_mutex_unlock( &pool->myLock );
+  return 0;
+}
+
+ /*
+ | Run the job over the given rows, split into bands.
+*/
+void ThreadPool::runRows( RowJob &job, int yBegin, int yEnd ) {
+  int rows = yEnd - yBegin;
+  if ( rows <= 0 ) return;
+  if ( myThreadCount == 1 || rows < 2 * minimumBandRows ) {
+    job.run( yBegin, yEnd );
+    return;
+  }
+
+  pthread_mutex_lock( &myLock );
+  myJob = &job;
+  myNextRow = yBegin;
+  myEndRow  = yEnd;
+  myBandRows = rows / (myThreadCount * bandsPerThread);
+  if ( myBandRows < minimumBandRows ) myBandRows = minimumBandRows;
+  myBusyWorkers = myThreadCount - 1;
+  myGeneration++;
+  pthread_cond_broadcast( &myWake );
+
+  workOnBands();
+  while ( myBusyWorkers > 0 )
+    pthread_cond_wait( &myDone, &myLock );
+  myJob = 0;
+  pthread_mutex_unlock( &myLock );
+}
+
+
+/*-------------------------\
+|    The imageOps pool    |
+\-------------------------*/
+
+static ThreadPool *thePool = 0;
+static int threadCountSetting = 0;
+
+ /*
+ | Return the number of processors which are online.
+*/
+static int processorCount() {
+  long count = sysconf( _SC_NPROCESSORS_ONLN );
+  return count < 1 ? 1 : (int)count;
+}
+
+ThreadPool *imageOpsPool() {
+  if ( !thePool )
+    thePool = new ThreadPool( threadCountSetting > 0 ? threadCountSetting
+                                                     : processorCount() );
+  return thePool;
+}
+
+void imageSetThreadCount( int threads ) {
+  threadCountSetting = threads < 0 ? 0 : threads;
+  delete thePool;
+  thePool = 0;
+}
+
+int imageThreadCount()
+ { return imageOpsPool()->threadCount(); }
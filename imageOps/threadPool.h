@@ -0,0 +1,68 @@
+/*---------------------.
+| threadPool.h          \______________________________
+|                                                      \
+| A small pool of worker threads which share out the   |
+| rows of an image between them.  The rows are handed  |
+| out in bands, several per thread, so that a thread   |
+| which finishes early takes another band rather than  |
+| waiting on a slower one.                             |
+\_____________________________________________________*/
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+
+#include <pthread.h>
+
+
+ /*
+ | A piece of work which can be split into bands of rows.  run() is called
+ | once for each band, from any of the pool's threads, so it must only write
+ | to the rows it is given.
+*/
+class RowJob {
+ public:
+  virtual ~RowJob() {}
+  virtual void run( int yBegin, int yEnd ) = 0;
+};
+
+
+class ThreadPool {
+ public:
+  ThreadPool( int threads );
+  ~ThreadPool();
+
+   // The number of threads working on a job, counting the caller's thread.
+  int threadCount() const { return myThreadCount; }
+
+   // Run the job over the rows yBegin <= y < yEnd, returning when every band
+   // is finished.  The calling thread works on bands too.  A job must not
+   // start another job on the same pool.
+  void runRows( RowJob &job, int yBegin, int yEnd );
+
+ protected:
+  static void *workerMain( void *pool );
+  void workOnBands();
+
+  int             myThreadCount;
+  pthread_t      *myWorkers;
+  pthread_mutex_t myLock;
+  pthread_cond_t  myWake, myDone;
+
+   // The current job, guarded by myLock.
+  RowJob  *myJob;
+  int      myNextRow, myEndRow, myBandRows;
+  int      myBusyWorkers;
+  unsigned myGeneration;
+  bool     myQuitting;
+};
+
+
+ // The pool the imageOps kernels run on.  It is created when first used,
+ // with one thread per processor unless imageSetThreadCount() (see
+ // imageOps.h) says otherwise.
+ThreadPool *imageOpsPool();
+
+
+#endif
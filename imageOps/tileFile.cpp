@@ -0,0 +1,336 @@
+/*---------------------.
+| tileFile.cpp          \______________________________
+|                                                      \
+| See the header of tileFile.h for details.            |
+|                                                      |
+| The tiles are compressed a row of them at a time,    |
+| and expanded all at once, on the imageOps threads.   |
+| An edge tile is kept whole, as it is in memory, with |
+| the part of it beyond the image's edge as well.      |
+\_____________________________________________________*/
+
+#include "tileFile.h"
+#include "lz4Block.h"
+#include "threadPool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define tileFileVersion     1
+#define tileFileByteOrder   0x01020304
+#define tileFileAlign       65536   // a whole tile starts on a multiple of this
+
+#define tileBytes   (imageTileSize * imageTileSize * sizeof(uint32_t))
+
+enum tilePacking { tileWhole, tileLz4 };
+
+struct TileFileHeader {
+  char     magic[4];          // "SBM" and the version
+  uint32_t byteOrder;
+  uint32_t width, height;
+  uint32_t tileSize, tiles;
+  uint32_t settingsBytes, unused;
+  uint64_t settingsOffset;
+  uint64_t indexOffset;
+};
+
+struct TileFileEntry {
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t packing;
+};
+
+
+static bool writeAll( int file, const void *data, size_t size, off_t offset,
+                      std::string &error ) {
+  const char *bytes = (const char*)data;
+  while ( size > 0 ) {
+    ssize_t done = pwrite( file, bytes, size, offset );
+    if ( done < 0 && errno == EINTR ) continue;
+    if ( done <= 0 ) {
+      error = std::string( "cannot write: " ) + strerror( errno );
+      return false;
+    }
+    bytes  += done;
+    size   -= done;
+    offset += done;
+  }
+  return true;
+}
+
+static bool readAll( int file, void *data, size_t size, off_t offset ) {
+  char *bytes = (char*)data;
+  while ( size > 0 ) {
+    ssize_t done = pread( file, bytes, size, offset );
+    if ( done < 0 && errno == EINTR ) continue;
+    if ( done <= 0 ) return false;
+    bytes  += done;
+    size   -= done;
+    offset += done;
+  }
+  return true;
+}
+
+static bool readHeader( int file, TileFileHeader &header ) {
+  return readAll( file, &header, sizeof(header), 0 ) &&
+         memcmp( header.magic, "SBM", 3 ) == 0;
+}
+
+bool isTileFile( const char *filename ) {
+  int file = open( filename, O_RDONLY );
+  if ( file < 0 ) return false;
+  TileFileHeader header;
+  bool is = readHeader( file, header );
+  close( file );
+  return is;
+}
+
+
+/*-------------------------\
+|    Writing              |
+\-------------------------*/
+
+ /*
+ | Compress each tile of a row into its own buffer, or leave it empty if
+ | it does not compress to under half.
+*/
+class CompressTilesJob : public RowJob {
+ public:
+  CompressTilesJob( const TiledImage &image, int row,
+                    std::vector< std::vector<unsigned char> > &packed )
+   : myImage(image), myRow(row), myPacked(packed) {}
+
+  void run( int columnBegin, int columnEnd ) {
+    for (int column=columnBegin; column<columnEnd; column++) {
+      std::vector<unsigned char> &packed = myPacked[column];
+      packed.resize( tileBytes / 2 );
+      size_t bytes = lz4Compress(
+        (const unsigned char*)myImage.tile( column, myRow ).bits, tileBytes,
+        &packed[0], packed.size() );
+      packed.resize( bytes );
+    }
+  }
+
+ protected:
+  const TiledImage &myImage;
+  int myRow;
+  std::vector< std::vector<unsigned char> > &myPacked;
+};
+
+bool writeTileFile( const TiledImage &image, const char *filename,
+                    const std::string &settings, bool compress,
+                    std::string &error ) {
+  if ( image.isNull() ) {
+    error = "there is no image to write";
+    return false;
+  }
+  std::string temporary = std::string( filename ) + ".part";
+  int file = open( temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+  if ( file < 0 ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    return false;
+  }
+
+  TileFileHeader header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.magic, "SBM", 3 );
+  header.magic[3]       = tileFileVersion;
+  header.byteOrder      = tileFileByteOrder;
+  header.width          = image.width();
+  header.height         = image.height();
+  header.tileSize       = imageTileSize;
+  header.tiles          = image.tileColumns() * image.tileRows();
+  header.settingsBytes  = settings.size();
+  header.settingsOffset = sizeof(header);
+
+  std::vector<TileFileEntry> index( header.tiles );
+  std::vector< std::vector<unsigned char> > packed( image.tileColumns() );
+  off_t at = header.settingsOffset + settings.size();
+  bool written = writeAll( file, settings.data(), settings.size(),
+                           header.settingsOffset, error );
+
+  for (int row=0; row<image.tileRows() && written; row++) {
+    if ( compress ) {
+      CompressTilesJob job( image, row, packed );
+      imageOpsPool()->runRows( job, 0, image.tileColumns() );
+    }
+    for (int column=0; column<image.tileColumns() && written; column++) {
+      TileFileEntry &entry = index[row * image.tileColumns() + column];
+      if ( !packed[column].empty() ) {
+        entry.packing = tileLz4;
+        entry.bytes   = packed[column].size();
+        written = writeAll( file, &packed[column][0], entry.bytes, at, error );
+      } else {
+        at = ( at + tileFileAlign-1 ) / tileFileAlign * tileFileAlign;
+        entry.packing = tileWhole;
+        entry.bytes   = tileBytes;
+        written = writeAll( file, image.tile( column, row ).bits, tileBytes,
+                            at, error );
+      }
+      entry.offset = at;
+      at += entry.bytes;
+    }
+    image.release( PixelRect( 0, row * imageTileSize, image.width(),
+                              (row+1) * imageTileSize ) );
+  }
+
+  header.indexOffset = at;
+  written = written &&
+            writeAll( file, &index[0], index.size() * sizeof(TileFileEntry),
+                      at, error ) &&
+            writeAll( file, &header, sizeof(header), 0, error );
+  if ( close( file ) != 0 && written ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    written = false;
+  }
+  if ( written && rename( temporary.c_str(), filename ) != 0 ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    written = false;
+  }
+  if ( !written ) unlink( temporary.c_str() );
+  return written;
+}
+
+
+/*-------------------------\
+|    Reading              |
+\-------------------------*/
+
+ /*
+ | Read in and expand the compressed tiles, and any whole tile which could
+ | not be mapped, each thread with its own buffer.
+*/
+class ExpandTilesJob : public RowJob {
+ public:
+  ExpandTilesJob( TiledImage &image, int file,
+                  const std::vector<TileFileEntry> &index,
+                  std::vector<char> &failed )
+   : myImage(image), myFile(file), myIndex(index), myFailed(failed) {}
+
+  void run( int tileBegin, int tileEnd ) {
+    std::vector<unsigned char> packed;
+    for (int i=tileBegin; i<tileEnd; i++) {
+      const TileFileEntry &entry = myIndex[i];
+      if ( entry.bytes == 0 ) continue;        // mapped
+      unsigned char *pixels = (unsigned char*)
+        myImage.tile( i % myImage.tileColumns(), i / myImage.tileColumns() )
+          .bits;
+      if ( entry.packing == tileWhole ) {
+        myFailed[i] = !readAll( myFile, pixels, tileBytes, entry.offset );
+        continue;
+      }
+      packed.resize( entry.bytes );
+      myFailed[i] = !readAll( myFile, &packed[0], entry.bytes, entry.offset )
+                    || !lz4Decompress( &packed[0], entry.bytes, pixels,
+                                       tileBytes );
+    }
+  }
+
+ protected:
+  TiledImage &myImage;
+  int myFile;
+  const std::vector<TileFileEntry> &myIndex;
+  std::vector<char> &myFailed;
+};
+
+ /*
+ | Check the header and index against the file's size before anything is
+ | mapped from it, as a page mapped beyond its end cannot be read.
+*/
+static bool readTiles( int file, TiledImage &image, std::string &settings,
+                       std::string &error ) {
+  TileFileHeader header;
+  struct stat status;
+  if ( !readHeader( file, header ) || fstat( file, &status ) != 0 ) {
+    error = "not an image of this program's";
+    return false;
+  }
+  if ( header.magic[3] != tileFileVersion ||
+       header.byteOrder != tileFileByteOrder ) {
+    error = "an image of another version, or from a machine of another "
+            "byte order";
+    return false;
+  }
+  uint64_t size = status.st_size;
+  uint64_t columns = ( (uint64_t)header.width  + imageTileSize-1 ) /
+                     imageTileSize;
+  uint64_t rows    = ( (uint64_t)header.height + imageTileSize-1 ) /
+                     imageTileSize;
+  if ( header.tileSize != imageTileSize || header.width == 0 ||
+       header.height == 0 || header.width > 0x7fffffff ||
+       header.height > 0x7fffffff || columns * rows != header.tiles ||
+       header.settingsOffset > size ||
+       header.settingsBytes > size - header.settingsOffset ||
+       header.indexOffset > size ||
+       (uint64_t)header.tiles * sizeof(TileFileEntry) >
+         size - header.indexOffset ) {
+    error = "the image's file is damaged";
+    return false;
+  }
+
+  std::vector<TileFileEntry> index( header.tiles );
+  settings.resize( header.settingsBytes );
+  if ( !readAll( file, &index[0], index.size() * sizeof(TileFileEntry),
+                 header.indexOffset ) ||
+       ( header.settingsBytes > 0 &&
+         !readAll( file, &settings[0], header.settingsBytes,
+                   header.settingsOffset ) ) ) {
+    error = "the image's file is damaged";
+    return false;
+  }
+  for (unsigned i=0; i<index.size(); i++)
+    if ( index[i].offset > size || index[i].bytes > size - index[i].offset ||
+         index[i].packing > tileLz4 || index[i].bytes > tileBytes ||
+         index[i].bytes == 0 ||
+         ( index[i].packing == tileWhole && index[i].bytes != tileBytes ) ) {
+      error = "the image's file is damaged";
+      return false;
+    }
+
+  if ( !image.create( header.width, header.height, error ) ) return false;
+  long page = sysconf( _SC_PAGESIZE );
+  bool expand = false;
+  for (unsigned i=0; i<index.size(); i++) {
+    if ( index[i].packing == tileWhole && index[i].offset % page == 0 &&
+         image.mapTile( i % image.tileColumns(), i / image.tileColumns(),
+                        file, index[i].offset, error ) ) {
+      index[i].bytes = 0;     // done
+      continue;
+    }
+    expand = true;
+  }
+  if ( !expand ) return true;
+
+  std::vector<char> failed( index.size(), 0 );
+  ExpandTilesJob job( image, file, index, failed );
+  imageOpsPool()->runRows( job, 0, index.size() );
+  for (unsigned i=0; i<failed.size(); i++)
+    if ( failed[i] ) {
+      error = "the image's file is damaged";
+      return false;
+    }
+  return true;
+}
+
+bool readTileFile( const char *filename, TiledImage &image,
+                   std::string &settings, std::string &error ) {
+  int file = open( filename, O_RDONLY );
+  if ( file < 0 ) {
+    error = std::string( "cannot open: " ) + strerror( errno );
+    return false;
+  }
+  TiledImage result;
+  std::string read;
+  bool ok = readTiles( file, result, read, error );
+  close( file );
+  if ( !ok ) return false;
+  image.swap( result );
+  settings.swap( read );
+  return true;
+}
@@ -0,0 +1,54 @@
+/*---------------------.
+| tileFile.h            \______________________________
+|                                                      \
+| The program's own file format, which keeps a         |
+| TiledImage's tiles as they are in memory, so that    |
+| saving is little more than writing them out, and     |
+| opening one maps its tiles straight from the file,   |
+| to be read only as they are shown or drawn on.       |
+|                                                      |
+| A header gives the size of the image and where the   |
+| rest is; then come the settings, as the caller gave  |
+| them, then the tiles, then an index saying where     |
+| each tile is and how it is kept.  A tile which       |
+| compresses (see lz4Block.h) to under half its size   |
+| is kept compressed, to be expanded as it is opened;  |
+| any other is kept whole, starting on a page, and is  |
+| mapped.  So an image of flat colour takes little     |
+| room, and one of detail opens at once.               |
+|                                                      |
+| The numbers and pixels are in the byte order of the  |
+| machine which wrote the file; one of the other order |
+| will not open it.                                    |
+\_____________________________________________________*/
+
+
+#ifndef TILEFILE_H
+#define TILEFILE_H
+
+
+#include "tiledImage.h"
+
+#include <string>
+
+
+ // Return true if the file starts as one of these does.
+bool isTileFile( const char *filename );
+
+ // Write the image, and the settings with it, to the file, compressing the
+ // tiles which are worth it if compress is true.  The file is written under
+ // another name and renamed when done, so an image mapped from the file it
+ // replaces is left as it was.  Return false, with the reason in error, if
+ // it cannot be written.
+bool writeTileFile( const TiledImage &image, const char *filename,
+                    const std::string &settings, bool compress,
+                    std::string &error );
+
+ // Open the file into image, made afresh, and its settings into settings.
+ // Return false, with the reason in error, leaving both as they were, if it
+ // cannot be read.
+bool readTileFile( const char *filename, TiledImage &image,
+                   std::string &settings, std::string &error );
+
+
+#endif
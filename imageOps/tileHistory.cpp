@@ -0,0 +1,260 @@
+/*---------------------.
+| tileHistory.cpp       \______________________________
+|                                                      \
+| See the header of tileHistory.h for details.         |
+\_____________________________________________________*/
+
+#include "tileHistory.h"
+#include "profiler.h"
+
+#include <string.h>
+
+ /*
+ | A copy of one tile of the image, shared by every change and latest copy
+ | holding it, and freed when the last lets it go.
+*/
+struct HistoryTile {
+  int       references;
+  int       width, height;
+  uint32_t *pixels;
+};
+
+
+TileHistory::TileHistory( size_t limit )
+ : myWidth(0), myHeight(0), myColumns(0), myLimit(limit), myBytes(0),
+   myPosition(0), myOverflow(false) {}
+
+TileHistory::~TileHistory()
+ { reset( 0, 0 ); }
+
+void TileHistory::reset( int width, int height ) {
+  forget( 0, myChanges.size() );
+  myChanges.clear();
+  myPosition = 0;
+  dropPending();
+  myOverflow = false;
+  std::map<int, HistoryTile*>::iterator latest;
+  for (latest=myLatest.begin(); latest!=myLatest.end(); ++latest)
+    release( latest->second );
+  myLatest.clear();
+
+  myWidth   = width;
+  myHeight  = height;
+  myColumns = (width + historyTileSize-1) / historyTileSize;
+  myTouched.assign( myColumns * ( (height + historyTileSize-1) /
+                                  historyTileSize ), false );
+}
+
+void TileHistory::setLimit( size_t limit ) {
+  myLimit = limit;
+  evict();
+}
+
+PixelRect TileHistory::tileRect( int tile ) const {
+  int x0 = (tile % myColumns) * historyTileSize;
+  int y0 = (tile / myColumns) * historyTileSize;
+  return PixelRect( x0, y0, x0 + historyTileSize, y0 + historyTileSize )
+           .intersected( PixelRect( 0, 0, myWidth, myHeight ) );
+}
+
+ /*
+ | Return a new copy of a tile of the image, with one reference.
+*/
+HistoryTile *TileHistory::copyTile( const TiledImage &image, int tile ) {
+  PixelRect r = tileRect( tile );
+  HistoryTile *copy = new HistoryTile;
+  copy->references = 1;
+  copy->width  = r.width();
+  copy->height = r.height();
+  copy->pixels = new uint32_t[ r.width() * r.height() ];
+  image.read( r, ImageRows( copy->pixels, r.width(), r.height(), r.width() ) );
+  myBytes += r.width() * r.height() * sizeof(uint32_t) + sizeof(HistoryTile);
+  return copy;
+}
+
+void TileHistory::release( HistoryTile *tile ) {
+  if ( --tile->references > 0 ) return;
+  myBytes -= tile->width * tile->height * sizeof(uint32_t)
+             + sizeof(HistoryTile);
+  delete [] tile->pixels;
+  delete tile;
+}
+
+ /*
+ | Let go of the copies of the change being made.
+*/
+void TileHistory::dropPending() {
+  for (unsigned i=0; i<myPending.tiles.size(); i++) {
+    release( myPending.before[i] );
+    myTouched[ myPending.tiles[i] ] = false;
+  }
+  myPending = Change();
+}
+
+ /*
+ | The tile's copy before the change is its latest copy, if it has one:
+ | that is what the last change, or undo, left in the image.  If the copies
+ | pass the limit, even with the old changes forgotten, the change is given
+ | up on, and the copies dropped; if the tiles under rect alone would pass
+ | it, it is given up on before any are copied.
+*/
+void TileHistory::touch( const TiledImage &image, const PixelRect &rect ) {
+  PixelRect r = rect.intersected( PixelRect( 0, 0, myWidth, myHeight ) );
+  if ( r.isEmpty() || myOverflow ) return;
+
+  PixelRect tiles = PixelRect(
+    r.x0 / historyTileSize * historyTileSize,
+    r.y0 / historyTileSize * historyTileSize,
+    (r.x1 + historyTileSize-1) / historyTileSize * historyTileSize,
+    (r.y1 + historyTileSize-1) / historyTileSize * historyTileSize )
+      .intersected( PixelRect( 0, 0, myWidth, myHeight ) );
+  if ( (size_t)tiles.width() * tiles.height() * sizeof(uint32_t) > myLimit ) {
+    dropPending();
+    myOverflow = true;
+    return;
+  }
+
+  for (int ty=r.y0/historyTileSize; ty*historyTileSize<r.y1; ty++)
+    for (int tx=r.x0/historyTileSize; tx*historyTileSize<r.x1; tx++) {
+      int tile = ty * myColumns + tx;
+      if ( myTouched[tile] ) continue;
+
+      HistoryTile *before;
+      std::map<int, HistoryTile*>::iterator latest = myLatest.find( tile );
+      if ( latest != myLatest.end() ) {
+        before = latest->second;
+        before->references++;
+      } else {
+        before = copyTile( image, tile );
+      }
+      myPending.tiles.push_back( tile );
+      myPending.before.push_back( before );
+      myTouched[tile] = true;
+
+      if ( myBytes > myLimit ) evict();
+      if ( myBytes > myLimit ) {
+        dropPending();
+        myOverflow = true;
+        return;
+      }
+    }
+}
+
+ /*
+ | A change which could not be kept leaves the history with no way back
+ | past it, so the history starts again after it.
+*/
+bool TileHistory::commit( const TiledImage &image ) {
+  StageTimer timer( "history" );
+  if ( myOverflow ) {
+    reset( myWidth, myHeight );
+    return false;
+  }
+  Change change;
+  for (unsigned i=0; i<myPending.tiles.size(); i++) {
+    int tile = myPending.tiles[i];
+    HistoryTile *before = myPending.before[i];
+    myTouched[tile] = false;
+    HistoryTile *after = copyTile( image, tile );
+    if ( memcmp( before->pixels, after->pixels,
+                 after->width * after->height * sizeof(uint32_t) ) == 0 ) {
+       // unchanged: the copy before becomes the latest, if it was not
+      release( after );
+      std::map<int, HistoryTile*>::iterator latest = myLatest.find( tile );
+      if ( latest == myLatest.end() ) myLatest[tile] = before;
+      else                            release( before );
+      continue;
+    }
+    change.tiles.push_back( tile );
+    change.before.push_back( before );
+    change.after.push_back( after );
+    std::map<int, HistoryTile*>::iterator latest = myLatest.find( tile );
+    if ( latest != myLatest.end() ) release( latest->second );
+    after->references++;
+    myLatest[tile] = after;
+  }
+  myPending = Change();
+  if ( change.tiles.empty() ) return false;
+
+   // a new change can't be followed by the ones which were undone
+  forget( myPosition, myChanges.size() );
+  myChanges.resize( myPosition );
+  myChanges.push_back( change );
+  myPosition++;
+  evict();
+  return true;
+}
+
+ /*
+ | Copy the tiles of a change back into the image, after them if forward
+ | else before them, and make those the tiles' latest copies.
+*/
+PixelRect TileHistory::restore( TiledImage &image, const Change &change,
+                                bool forward ) {
+  PixelRect changed;
+  for (unsigned i=0; i<change.tiles.size(); i++) {
+    HistoryTile *copy = forward ? change.after[i] : change.before[i];
+    PixelRect r = tileRect( change.tiles[i] );
+    image.write( r, ImageRows( copy->pixels, r.width(), r.height(),
+                               r.width() ) );
+    changed = changed.united( r );
+
+    HistoryTile *&latest = myLatest[ change.tiles[i] ];
+    if ( latest ) release( latest );
+    latest = copy;
+    copy->references++;
+  }
+  return changed;
+}
+
+PixelRect TileHistory::undo( TiledImage &image ) {
+  commit( image );
+  if ( !canUndo() ) return PixelRect();
+  myPosition--;
+  return restore( image, myChanges[myPosition], false );
+}
+
+PixelRect TileHistory::redo( TiledImage &image ) {
+  commit( image );
+  if ( !canRedo() ) return PixelRect();
+  myPosition++;
+  return restore( image, myChanges[myPosition-1], true );
+}
+
+ /*
+ | Let go of the tiles of changes first ... last-1.
+*/
+void TileHistory::forget( int first, int last ) {
+  for (int c=first; c<last; c++)
+    for (unsigned i=0; i<myChanges[c].tiles.size(); i++) {
+      release( myChanges[c].before[i] );
+      release( myChanges[c].after[i] );
+    }
+}
+
+ /*
+ | Forget the oldest changes until the tiles fit within the limit.  If that
+ | is not enough, let go of the latest copies no change holds: they are the
+ | same as the image, and are copied from it again when next touched.
+*/
+void TileHistory::evict() {
+  int oldest = 0;
+  while ( myBytes > myLimit && oldest < myPosition ) {
+    forget( oldest, oldest+1 );
+    oldest++;
+  }
+  if ( oldest > 0 ) {
+    myChanges.erase( myChanges.begin(), myChanges.begin() + oldest );
+    myPosition -= oldest;
+  }
+
+  std::map<int, HistoryTile*>::iterator latest = myLatest.begin();
+  while ( myBytes > myLimit && latest != myLatest.end() ) {
+    if ( latest->second->references == 1 ) {
+      release( latest->second );
+      myLatest.erase( latest++ );
+    } else {
+      ++latest;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+/*---------------------.
+| tileHistory.h         \______________________________
+|                                                      \
+| The undo and redo history of an image.  The image is |
+| cut into tiles, and each change to it keeps only the |
+| tiles it changed, as they were before and after.     |
+| The tiles are shared: the copy of a tile after one   |
+| change is the copy before the next change to it, and |
+| a tile a change left as it was is not kept at all.   |
+| A brush stroke costs only the tiles under it,        |
+| however large the image.                             |
+|                                                      |
+| A change is made in two steps: touch() each part of  |
+| the image before it is changed, which copies the     |
+| tiles under it the first time they are touched, then |
+| commit() once it is done.  When the tiles kept pass  |
+| the memory limit, the oldest changes are forgotten,  |
+| and a change too large to keep at all forgets the    |
+| whole history.                                       |
+\_____________________________________________________*/
+
+
+#ifndef TILEHISTORY_H
+#define TILEHISTORY_H
+
+
+#include "tiledImage.h"
+
+#include <map>
+#include <stddef.h>
+#include <vector>
+
+#define historyTileSize      64                    // pixels, each way
+#define defaultHistoryLimit  (256 * 1024 * 1024)   // bytes
+
+
+struct HistoryTile;
+
+class TileHistory {
+ public:
+  TileHistory( size_t limit = defaultHistoryLimit );
+  ~TileHistory();
+
+   // Forget the history, and start again from an image of the given size.
+  void reset( int width, int height );
+
+   // Keep a copy of the tiles under rect, as they are now, unless they have
+   // already been kept for the change being made.
+  void touch( const TiledImage &image, const PixelRect &rect );
+
+   // Finish the change, keeping the new contents of the tiles touched.
+   // Nothing is kept if the image is unchanged.  Return true if the change
+   // was kept, to be undone.
+  bool commit( const TiledImage &image );
+
+   // Undo or redo a change, copying the tiles back into the image, and
+   // return the rectangle they cover (empty if there was nothing to do).
+   // A change being made is committed first.
+  PixelRect undo( TiledImage &image );
+  PixelRect redo( TiledImage &image );
+
+  bool canUndo() const { return myPosition > 0; }
+  bool canRedo() const { return myPosition < (int)myChanges.size(); }
+
+   // The most memory the tiles may take, and the memory they take.
+  void   setLimit( size_t limit );
+  size_t limit() const { return myLimit; }
+  size_t bytes() const { return myBytes; }
+  int    changes() const { return (int)myChanges.size(); }
+
+ protected:
+   // The tiles a change changed, by number, before and after.
+  struct Change {
+    std::vector<int>          tiles;
+    std::vector<HistoryTile*> before, after;
+  };
+
+  PixelRect   tileRect( int tile ) const;
+  HistoryTile *copyTile( const TiledImage &image, int tile );
+  void        release( HistoryTile *tile );
+  PixelRect   restore( TiledImage &image, const Change &change,
+                       bool forward );
+  void        forget( int first, int last );
+  void        dropPending();
+  void        evict();
+
+  int    myWidth, myHeight, myColumns;
+  size_t myLimit, myBytes;
+  std::vector<Change> myChanges;
+  int    myPosition;                       // the changes which are done
+  std::map<int, HistoryTile*> myLatest;    // each tile's last copy, if any
+  Change myPending;                        // the change being made
+  std::vector<bool> myTouched;             // each tile's, if it touched it
+  bool   myOverflow;                       // too large to keep
+};
+
+
+#endif
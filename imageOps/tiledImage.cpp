@@ -0,0 +1,306 @@
+/*---------------------.
+| tiledImage.cpp        \______________________________
+|                                                      \
+| See the header of tiledImage.h for details.          |
+\_____________________________________________________*/
+
+#include "tiledImage.h"
+#include "profiler.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+ // tiledApply() works through blocks of this many tiles each way
+#define blockTiles    4
+
+#define tilePixels    (imageTileSize * imageTileSize)
+
+
+TiledImage::TiledImage()
+ : myWidth(0), myHeight(0), myColumns(0), myRows(0), myPixels(0), myBytes(0),
+   myFile(-1) {}
+
+TiledImage::~TiledImage()
+ { destroy(); }
+
+void TiledImage::destroy() {
+  if ( myPixels ) {
+    munmap( myPixels, myBytes );
+    profileMemory( -(long long)myBytes );
+  }
+  if ( myFile >= 0 ) close( myFile );
+  myPixels = 0;
+  myFile = -1;
+  myWidth = myHeight = myColumns = myRows = 0;
+  myBytes = 0;
+  myMapped.clear();
+}
+
+ /*
+ | The scratch file is unlinked as soon as it is open, so that it goes when
+ | the image does, however the program ends.  It is sparse, taking disk
+ | space only as the tiles are written.
+*/
+bool TiledImage::create( int width, int height, std::string &error ) {
+  destroy();
+  if ( width <= 0 || height <= 0 ) return true;
+
+  const char *directory = getenv( "TMPDIR" );
+  std::string name = std::string( directory && *directory ? directory
+                                                          : "/tmp" )
+                     + "/splatterBoardXXXXXX";
+  std::vector<char> path( name.begin(), name.end() );
+  path.push_back( '\0' );
+  int file = mkstemp( &path[0] );
+  if ( file < 0 ) {
+    error = "cannot make a scratch file in " + name.substr( 0, name.rfind('/') )
+            + ": " + strerror( errno );
+    return false;
+  }
+  unlink( &path[0] );
+
+  int columns = (width  + imageTileSize-1) / imageTileSize;
+  int rows    = (height + imageTileSize-1) / imageTileSize;
+  size_t bytes = (size_t)columns * rows * tilePixels * sizeof(uint32_t);
+  void *pixels = MAP_FAILED;
+  if ( ftruncate( file, bytes ) == 0 )
+    pixels = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0 );
+  if ( pixels == MAP_FAILED ) {
+    error = std::string( "cannot map a scratch file for the image: " )
+            + strerror( errno );
+    close( file );
+    return false;
+  }
+
+  myWidth   = width;
+  myHeight  = height;
+  myColumns = columns;
+  myRows    = rows;
+  myPixels  = (uint32_t*)pixels;
+  myBytes   = bytes;
+  profileMemory( bytes );
+  myFile    = file;
+  return true;
+}
+
+PixelRect TiledImage::tileRect( int column, int row ) const {
+  return PixelRect( column * imageTileSize, row * imageTileSize,
+                    (column+1) * imageTileSize, (row+1) * imageTileSize )
+           .intersected( rect() );
+}
+
+ImageRows TiledImage::tile( int column, int row ) const {
+  PixelRect r = tileRect( column, row );
+  return ImageRows( myPixels + (size_t)(row * myColumns + column) * tilePixels,
+                    r.width(), r.height(), imageTileSize );
+}
+
+ImageRows TiledImage::tileToWrite( int column, int row ) {
+  unmapTile( column, row, true );
+  return tile( column, row );
+}
+
+ /*
+ | Copy between rect and buffer, a tile at a time.
+*/
+void TiledImage::read( const PixelRect &rect, const ImageRows &out ) const {
+  for (int row=rect.y0/imageTileSize; row*imageTileSize<rect.y1; row++)
+    for (int column=rect.x0/imageTileSize; column*imageTileSize<rect.x1;
+         column++) {
+      PixelRect t = tileRect( column, row );
+      PixelRect part = rect.intersected( t );
+      ImageRows pixels = tile( column, row );
+      for (int y=part.y0; y<part.y1; y++)
+        memcpy( out.row( y - rect.y0 ) + part.x0 - rect.x0,
+                pixels.row( y - t.y0 ) + part.x0 - t.x0,
+                part.width() * sizeof(uint32_t) );
+    }
+}
+
+void TiledImage::write( const PixelRect &rect, const ImageRows &in ) {
+  for (int row=rect.y0/imageTileSize; row*imageTileSize<rect.y1; row++)
+    for (int column=rect.x0/imageTileSize; column*imageTileSize<rect.x1;
+         column++) {
+      PixelRect t = tileRect( column, row );
+      PixelRect part = rect.intersected( t );
+      ImageRows pixels = tileToWrite( column, row );
+      for (int y=part.y0; y<part.y1; y++)
+        memcpy( pixels.row( y - t.y0 ) + part.x0 - t.x0,
+                in.row( y - rect.y0 ) + part.x0 - rect.x0,
+                part.width() * sizeof(uint32_t) );
+    }
+}
+
+void TiledImage::fill( const uint32_t pixel ) {
+  for (int row=0; row<myRows; row++) {
+    for (int column=0; column<myColumns; column++) {
+      unmapTile( column, row, false );
+      ImageRows pixels = tile( column, row );
+      for (int y=0; y<pixels.height; y++) {
+        uint32_t *out = pixels.row(y);
+        for (int x=0; x<pixels.width; x++)
+          out[x] = pixel;
+      }
+    }
+    release( PixelRect( 0, row * imageTileSize, myWidth,
+                        (row+1) * imageTileSize ) );
+  }
+}
+
+ /*
+ | The pages stay in the scratch file (and in the system's cache, while it
+ | has room), only no longer in this process.
+*/
+void TiledImage::release( const PixelRect &rect ) const {
+  PixelRect r = rect.intersected( this->rect() );
+  if ( r.isEmpty() ) return;
+  for (int row=r.y0/imageTileSize; row*imageTileSize<r.y1; row++) {
+    int first = r.x0 / imageTileSize, last = (r.x1-1) / imageTileSize;
+    if ( !myMapped.empty() ) {
+       // the changes to a mapped tile would be lost, so let go of the
+       // tiles either side of it only
+      for (int column=first; column<=last; column++)
+        if ( !myMapped[row * myColumns + column] )
+          madvise( myPixels + (size_t)(row * myColumns + column) * tilePixels,
+                   tilePixels * sizeof(uint32_t), MADV_DONTNEED );
+      continue;
+    }
+    madvise( myPixels + (size_t)(row * myColumns + first) * tilePixels,
+             (size_t)(last - first + 1) * tilePixels * sizeof(uint32_t),
+             MADV_DONTNEED );
+  }
+}
+
+ /*
+ | The mapping is private, so the file is only ever read, and the pages of
+ | the tile which are changed become the process's own.
+*/
+bool TiledImage::mapTile( int column, int row, int file, off_t offset,
+                          std::string &error ) {
+  uint32_t *pixels = tile( column, row ).bits;
+  if ( mmap( pixels, tilePixels * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, file, offset ) == MAP_FAILED ) {
+    error = std::string( "cannot map the tile: " ) + strerror( errno );
+    return false;
+  }
+  if ( myMapped.empty() ) myMapped.resize( myColumns * myRows, false );
+  myMapped[row * myColumns + column] = true;
+  return true;
+}
+
+ /*
+ | Put a tile mapped from a file back in the scratch file, its pixels kept if
+ | keep is true, otherwise undefined.
+*/
+void TiledImage::unmapTile( int column, int row, bool keep ) {
+  if ( myMapped.empty() || !myMapped[row * myColumns + column] ) return;
+  uint32_t *pixels = tile( column, row ).bits;
+  std::vector<uint32_t> kept;
+  if ( keep ) kept.assign( pixels, pixels + tilePixels );
+  if ( mmap( pixels, tilePixels * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, myFile,
+             (off_t)( pixels - myPixels ) * sizeof(uint32_t) ) == MAP_FAILED )
+    return;
+  myMapped[row * myColumns + column] = false;
+  if ( keep ) memcpy( pixels, &kept[0], tilePixels * sizeof(uint32_t) );
+}
+
+void TiledImage::swap( TiledImage &other ) {
+  std::swap( myWidth,   other.myWidth );
+  std::swap( myHeight,  other.myHeight );
+  std::swap( myColumns, other.myColumns );
+  std::swap( myRows,    other.myRows );
+  std::swap( myPixels,  other.myPixels );
+  std::swap( myBytes,   other.myBytes );
+  std::swap( myFile,    other.myFile );
+  myMapped.swap( other.myMapped );
+}
+
+
+/*-------------------------\
+|    Filtering            |
+\-------------------------*/
+
+ /*
+ | A block's result depends on the pixels within the halo around it, which
+ | are copied out with it, clipped to the image, so the filter sees the
+ | image's edges where they are.  Pixels near the edges of the copy which
+ | are not the image's edges come out wrong, but they are outside the block
+ | and are thrown away.  The results go to a second image, as the blocks
+ | after still need the pixels the block replaces.  Each block's tiles are
+ | let go once it is done, so only a block is held at a time.
+*/
+bool tiledApply( TiledImage &image, const TileFilter &filter,
+                 std::string &error ) {
+  if ( image.isNull() ) return true;
+  StageTimer timer( "filter" );
+  int halo = filter.halo();
+
+   // a point operation needs nothing around it, so it runs in place
+  if ( halo == 0 ) {
+    for (int row=0; row<image.tileRows(); row++) {
+      for (int column=0; column<image.tileColumns(); column++) {
+        ImageRows pixels = image.tileToWrite( column, row );
+        filter.run( pixels, pixels );
+      }
+      image.release( PixelRect( 0, row * imageTileSize, image.width(),
+                                (row+1) * imageTileSize ) );
+    }
+    return true;
+  }
+
+  TiledImage result;
+  if ( !result.create( image.width(), image.height(), error ) ) return false;
+
+  int blockSize = blockTiles * imageTileSize;
+  std::vector<uint32_t> in, out;
+  for (int y0=0; y0<image.height(); y0+=blockSize) {
+    for (int x0=0; x0<image.width(); x0+=blockSize) {
+      PixelRect block = PixelRect( x0, y0, x0 + blockSize, y0 + blockSize )
+                          .intersected( image.rect() );
+      PixelRect window = PixelRect( block.x0 - halo, block.y0 - halo,
+                                    block.x1 + halo, block.y1 + halo )
+                           .intersected( image.rect() );
+      in.resize( window.width() * window.height() );
+      out.resize( in.size() );
+      ImageRows src( &in[0], window.width(), window.height(), window.width() );
+      ImageRows dst( &out[0], window.width(), window.height(),
+                     window.width() );
+
+      image.read( window, src );
+      filter.run( src, dst );
+      result.write( block, ImageRows( dst.row( block.y0 - window.y0 )
+                                        + block.x0 - window.x0,
+                                      block.width(), block.height(),
+                                      dst.stride ) );
+       // the next blocks read some of the same tiles again, but from the
+       // system's cache, not the disk
+      image.release( window );
+      result.release( block );
+    }
+  }
+  image.swap( result );
+  return true;
+}
+
+
+/*-------------------------\
+|    The filters          |
+\-------------------------*/
+
+void PointTileFilter::run( const ImageRows &src, const ImageRows &dst ) const {
+  if ( src.bits != dst.bits )
+    for (int y=0; y<src.height; y++)
+      memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+  imageApplyTable( dst, table );
+}
+
+int BoxBlurTileFilter::halo() const {
+  int r = radius > maxBlurRadius ? maxBlurRadius : radius < 0 ? 0 : radius;
+  return r * passes;
+}
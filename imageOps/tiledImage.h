@@ -0,0 +1,178 @@
+/*---------------------.
+| tiledImage.h          \______________________________
+|                                                      \
+| An image kept in square tiles in a scratch file,     |
+| mapped into memory, so that it may be far larger     |
+| than the memory there is: the tiles are read in as   |
+| they are used, and written back out and dropped by   |
+| the system when memory is wanted.  Each tile is held |
+| a row at a time, so a tile is an ImageRows of its    |
+| own, and the kernels can work on it in place.        |
+|                                                      |
+| Filters which read around each pixel are run a block |
+| of tiles at a time (see tiledApply()), on a copy of  |
+| the block and the margin around it, into a second    |
+| scratch file, so the memory they take is the same    |
+| whatever the size of the image.                      |
+\_____________________________________________________*/
+
+
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+
+#include "imageOps.h"
+#include "filterChain.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#define imageTileSize    256    // pixels, each way; a tile is 256 KB
+
+
+class TiledImage {
+ public:
+  TiledImage();
+  ~TiledImage();
+
+   // Make a new image of the given size, in a new scratch file in $TMPDIR
+   // (or /tmp), its pixels undefined.  Return false, with the reason in
+   // error, and leave the image empty, if the file cannot be made.
+  bool create( int width, int height, std::string &error );
+
+  bool isNull() const { return myPixels == 0; }
+  int  width()  const { return myWidth; }
+  int  height() const { return myHeight; }
+  PixelRect rect() const { return PixelRect( 0, 0, myWidth, myHeight ); }
+
+   // The tiles, columns x rows of them.
+  int       tileColumns() const { return myColumns; }
+  int       tileRows()    const { return myRows; }
+  PixelRect tileRect( int column, int row ) const;
+  ImageRows tile( int column, int row ) const;
+
+   // The tile, to be changed: one mapped from a file (see mapTile()) is
+   // first put back in the scratch file, its pixels as they were, so that
+   // release() may let the memory its changes take go.
+  ImageRows tileToWrite( int column, int row );
+
+   // Copy the pixels of rect, which must lie within the image, out into
+   // the top-left of out, or in from the top-left of in, each tile written
+   // to as tileToWrite() gives it.
+  void read ( const PixelRect &rect, const ImageRows &out ) const;
+  void write( const PixelRect &rect, const ImageRows &in );
+
+  void fill( const uint32_t pixel );
+
+   // Let the memory holding the tiles under rect go, to be read back from
+   // the scratch file when next used.
+  void release( const PixelRect &rect ) const;
+
+   // Map the tile from the file at offset, a multiple of the page size, in
+   // place of its part of the scratch file, so that its pixels are read
+   // from the file only as they are used.  It is never written to: the
+   // tile is put back in the scratch file before it is changed through
+   // tileToWrite(), write() or fill(), and release() leaves it be until
+   // then.  The file may be closed after, but must not be written to while
+   // the image is in use.
+  bool mapTile( int column, int row, int file, off_t offset,
+                std::string &error );
+
+  void swap( TiledImage &other );
+
+ protected:
+  void destroy();
+  void unmapTile( int column, int row, bool keep );
+
+  int       myWidth, myHeight, myColumns, myRows;
+  uint32_t *myPixels;           // the mapping, tile after tile, row by row
+  size_t    myBytes;
+  int       myFile;
+  std::vector<bool> myMapped;   // each tile's, if any is mapped from a file
+
+ private:
+  TiledImage( const TiledImage & );              // not to be copied
+  TiledImage &operator=( const TiledImage & );
+};
+
+
+ /*
+ | A filter of a whole image, src into dst, whose result at each pixel depends
+ | only on the pixels within halo() of it, and on where the image's edges are.
+ | A filter with no halo must allow src and dst to be the same rows.
+*/
+class TileFilter {
+ public:
+  virtual ~TileFilter() {}
+  virtual int  halo() const = 0;
+  virtual void run( const ImageRows &src, const ImageRows &dst ) const = 0;
+};
+
+ // Apply the filter to the image, a block of tiles at a time, with the same
+ // result as applying it to the whole image at once.  Return false, with
+ // the reason in error, if the scratch file for the result cannot be made.
+bool tiledApply( TiledImage &image, const TileFilter &filter,
+                 std::string &error );
+
+
+ // The image filters, as TileFilters.
+class ConvoluteTileFilter : public TileFilter {
+ public:
+  ConvoluteTileFilter( const convolutionType t, const convolutionEngine e )
+   : type(t), engine(e) {}
+   // the last two rows and columns are left alone, so a margin of two
+  int  halo() const { return 2; }
+  void run( const ImageRows &src, const ImageRows &dst ) const
+   { imageConvolute( src, dst, type, engine ); }
+
+  convolutionType   type;
+  convolutionEngine engine;
+};
+
+class PointTileFilter : public TileFilter {
+ public:
+  PointTileFilter( const PointTable &t ) : table(t) {}
+  int  halo() const { return 0; }
+  void run( const ImageRows &src, const ImageRows &dst ) const;
+
+  PointTable table;
+};
+
+class BoxBlurTileFilter : public TileFilter {
+ public:
+  BoxBlurTileFilter( const int r, const int p ) : radius(r), passes(p) {}
+  int  halo() const;
+  void run( const ImageRows &src, const ImageRows &dst ) const
+   { imageBoxBlur( src, dst, radius, passes ); }
+
+  int radius, passes;
+};
+
+class KernelTileFilter : public TileFilter {
+ public:
+  KernelTileFilter( const ConvolutionKernel &k, const kernelMethod m )
+   : kernel(k), method(m) {}
+  int  halo() const { return kernel.size / 2; }
+  void run( const ImageRows &src, const ImageRows &dst ) const
+   { imageConvoluteKernel( src, dst, kernel.matrix(), kernel.size, method ); }
+
+  const ConvolutionKernel &kernel;
+  kernelMethod             method;
+};
+
+class ChainTileFilter : public TileFilter {
+ public:
+  ChainTileFilter( const FilterChain &c, const convolutionEngine e )
+   : chain(c), engine(e) {}
+  int  halo() const { return 2 * chain.halo(); }
+  void run( const ImageRows &src, const ImageRows &dst ) const
+   { chain.run( src, dst, engine ); }
+
+  const FilterChain &chain;
+  convolutionEngine  engine;
+};
+
+
+#endif
@@ -0,0 +1,630 @@
+/*---------------------.
+| journal.cpp           \______________________________
+|                                                      \
+| See the header of journal.h for details.             |
+|                                                      |
+| The file is "SBJ" and a version byte, then records:  |
+| a type byte, the length of the rest as a number, and |
+| the rest.  Numbers are 7 bits a byte, the low bits   |
+| first, with the top bit set on all but the last, and |
+| signed ones are folded so that small negatives stay  |
+| short; a pen's points are each kept as the step from |
+| the one before.  Colors are three bytes, and the     |
+| weights of a kernel four, as IEEE floats, the low    |
+| byte first.                                          |
+|                                                      |
+| The undo history forgets changes to keep within its  |
+| memory, and keeps none which leave the image as it   |
+| was, so an undo is recorded only when it undid       |
+| something, and each commit says whether the change   |
+| was kept; the replay undoes the last change kept.    |
+\_____________________________________________________*/
+
+#include "journal.h"
+
+#include <qfileinfo.h>
+#include <qimage.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#define journalVersion  1
+
+
+/*-------------------------\
+|    Encoding             |
+\-------------------------*/
+
+static void putNumber( std::string &out, uint32_t n ) {
+  while ( n >= 0x80 ) {
+    out += (char)( (n & 0x7f) | 0x80 );
+    n >>= 7;
+  }
+  out += (char)n;
+}
+
+static void putSigned( std::string &out, int32_t n )
+ { putNumber( out, ( (uint32_t)n << 1 ) ^ (uint32_t)( n >> 31 ) ); }
+
+static void putColor( std::string &out, const QColor &color ) {
+  out += (char)color.red();
+  out += (char)color.green();
+  out += (char)color.blue();
+}
+
+static void putString( std::string &out, const std::string &s ) {
+  putNumber( out, s.size() );
+  out += s;
+}
+
+static void putReal( std::string &out, float real ) {
+  uint32_t bits;
+  memcpy( &bits, &real, sizeof(bits) );
+  for (int i=0; i<4; i++) out += (char)( bits >> (8*i) );
+}
+
+ /*
+ | Reads a record's contents, noting if it runs off the end.
+*/
+class JournalReader {
+ public:
+  JournalReader( const std::string &data ) : myData(data), myAt(0),
+                                             myFailed(false) {}
+
+  bool ok() const { return !myFailed; }
+
+  int byte() {
+    if ( myAt >= myData.size() ) { myFailed = true;  return 0; }
+    return (unsigned char)myData[myAt++];
+  }
+
+  uint32_t number() {
+    uint32_t n = 0;
+    for (int shift=0; shift<35; shift+=7) {
+      int b = byte();
+      n |= (uint32_t)( b & 0x7f ) << shift;
+      if ( !(b & 0x80) ) return n;
+    }
+    myFailed = true;
+    return 0;
+  }
+
+  int32_t signedNumber() {
+    uint32_t n = number();
+    return (int32_t)( n >> 1 ) ^ -(int32_t)( n & 1 );
+  }
+
+  QColor color() {
+    int r = byte(), g = byte(), b = byte();
+    return QColor( r, g, b );
+  }
+
+  std::string string() {
+    uint32_t length = number();
+    if ( length > myData.size() - myAt ) { myFailed = true;  return ""; }
+    myAt += length;
+    return myData.substr( myAt - length, length );
+  }
+
+  float real() {
+    uint32_t bits = 0;
+    for (int i=0; i<4; i++) bits |= (uint32_t)byte() << (8*i);
+    float value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+  }
+
+ protected:
+  const std::string &myData;
+  size_t             myAt;
+  bool               myFailed;
+};
+
+bool journalStrokeOf( const std::string &payload, ToolStroke &stroke ) {
+  JournalReader in( payload );
+  stroke.tool           = (CanvasTool)in.byte();
+  stroke.x1             = in.signedNumber();
+  stroke.y1             = in.signedNumber();
+  stroke.x2             = in.signedNumber();
+  stroke.y2             = in.signedNumber();
+  stroke.penColor       = in.color();
+  stroke.fillColor      = in.color();
+  stroke.brushSize      = in.number();
+  stroke.gradientDegree = in.number();
+  stroke.magnification  = in.number();
+  uint32_t count = in.number();
+  if ( !in.ok() || count > payload.size() ) return false;
+  stroke.points.resize( count );
+  int x = 0, y = 0;
+  for (uint32_t i=0; i<count; i++) {
+    x += in.signedNumber();
+    y += in.signedNumber();
+    stroke.points.setPoint( i, x, y );
+  }
+  return in.ok();
+}
+
+bool journalFilterOf( const std::string &payload, CanvasFilter &filter ) {
+  JournalReader in( payload );
+  filter.kind  = (canvasFilterKind)in.byte();
+  filter.value = in.signedNumber();
+  if ( filter.kind == filterKernel ) {
+    filter.kernel.size = in.number();
+    uint32_t weights = (uint32_t)filter.kernel.size * filter.kernel.size;
+    if ( !in.ok() || weights > payload.size() ) return false;
+    filter.kernel.weights.resize( weights );
+    for (uint32_t i=0; i<weights; i++) filter.kernel.weights[i] = in.real();
+  } else if ( filter.kind == filterChain ) {
+    filter.chain.clear();
+    uint32_t steps = in.number();
+    for (uint32_t s=0; s<steps && in.ok(); s++) {
+      if ( in.byte() == chainConvolute ) {
+        filter.chain.addConvolution( (convolutionType)in.number() );
+        continue;
+      }
+      PointTable table;
+      for (int c=0; c<4; c++)
+        for (int i=0; i<256; i++) table.channel[c][i] = in.byte();
+      filter.chain.addTable( table );
+    }
+  }
+  return in.ok();
+}
+
+
+/*-------------------------\
+|    Recording            |
+\-------------------------*/
+
+Journal::Journal() : myFile(0), myBytes(0), myPending(0) {}
+
+Journal::~Journal() {
+  if ( myFile ) fclose( myFile );
+}
+
+ /*
+ | Read the records in the file into memory.  found is false if there is no
+ | file, and length is how much of it is whole records.
+*/
+bool Journal::load( const char *filename, bool &found, long &length,
+                    std::string &error ) {
+  myTypes.clear();
+  myPayloads.clear();
+  myPending = 0;
+  length = 0;
+  FILE *file = fopen( filename, "rb" );
+  found = file != 0;
+  if ( !file ) {
+    if ( errno == ENOENT ) return true;
+    error = std::string( "cannot open: " ) + strerror( errno );
+    return false;
+  }
+
+  std::string data;
+  char block[65536];
+  size_t got;
+  while ( (got = fread( block, 1, sizeof(block), file )) > 0 )
+    data.append( block, got );
+  fclose( file );
+  if ( data.size() < 4 || data.compare( 0, 3, "SBJ" ) != 0 ) {
+    error = "not a journal";
+    return false;
+  }
+  if ( (unsigned char)data[3] != journalVersion ) {
+    error = "a journal of another version";
+    return false;
+  }
+
+  size_t at = 4;
+  length = at;
+  while ( at < data.size() ) {
+    journalRecord type = (journalRecord)(unsigned char)data[at];
+    size_t start = at + 1;
+    uint32_t size = 0;
+    bool sized = false;
+    for (int shift=0; start < data.size() && shift < 35 && !sized; shift+=7) {
+      unsigned char b = data[start++];
+      size |= (uint32_t)( b & 0x7f ) << shift;
+      sized = !(b & 0x80);
+    }
+    if ( !sized || size > data.size() - start )
+      break;                  // cut short as it was written
+    myTypes.push_back( type );
+    myPayloads.push_back( data.substr( start, size ) );
+    at = start + size;
+    length = at;
+
+    if ( type == journalStroke || type == journalFilter ||
+         type == journalClear )
+      myPending++;
+    else if ( type == journalCommit || type == journalNew ||
+              type == journalOpen )
+      myPending = 0;
+  }
+  myBytes = length;
+  return true;
+}
+
+bool Journal::read( const char *filename, std::string &error ) {
+  bool found;
+  long length;
+  if ( !load( filename, found, length, error ) ) return false;
+  if ( !found ) {
+    error = "no such file";
+    return false;
+  }
+  return true;
+}
+
+ /*
+ | A record half written is cut off, and a change left open is closed, as
+ | one the restored session's history cannot undo.
+*/
+bool Journal::open( const char *filename, std::string &error ) {
+  bool found;
+  long length;
+  if ( !load( filename, found, length, error ) ) return false;
+
+  myFile = fopen( filename, found ? "r+b" : "wb" );
+  if ( !myFile ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    return false;
+  }
+  if ( found ) {
+    if ( ftruncate( fileno( myFile ), length ) != 0 ) {
+      error = std::string( "cannot write: " ) + strerror( errno );
+      return false;
+    }
+    fseek( myFile, length, SEEK_SET );
+  } else {
+    fputs( "SBJ", myFile );
+    fputc( journalVersion, myFile );
+    myBytes = 4;
+  }
+  recordCommit( false );
+  fflush( myFile );
+  return true;
+}
+
+ /*
+ | Keep the record, and write it to the file.  The strokes come many a
+ | second while the pen is drawing, so they are written out along with the
+ | next record of another kind.
+*/
+void Journal::record( journalRecord type, const std::string &payload ) {
+  myTypes.push_back( type );
+  myPayloads.push_back( payload );
+  std::string head( 1, (char)type );
+  putNumber( head, payload.size() );
+  myBytes += head.size() + payload.size();
+  if ( !myFile ) return;
+  fwrite( head.data(), 1, head.size(), myFile );
+  fwrite( payload.data(), 1, payload.size(), myFile );
+  if ( type != journalStroke ) fflush( myFile );
+}
+
+void Journal::recordNew( int width, int height, const QColor &background ) {
+  std::string out;
+  putNumber( out, width );
+  putNumber( out, height );
+  putColor( out, background );
+  record( journalNew, out );
+  myPending = 0;
+}
+
+ /*
+ | The file is kept by its full path, so the journal may be replayed from
+ | anywhere.
+*/
+void Journal::recordOpen( const QString &filename, int width, int height ) {
+  std::string out;
+  putNumber( out, width );
+  putNumber( out, height );
+  putString( out, (const char*)QFileInfo( filename ).absFilePath().local8Bit() );
+  record( journalOpen, out );
+  myPending = 0;
+}
+
+void Journal::recordSave( const QString &filename, int width, int height ) {
+  std::string out;
+  putNumber( out, width );
+  putNumber( out, height );
+  putString( out, (const char*)QFileInfo( filename ).absFilePath().local8Bit() );
+  record( journalSave, out );
+}
+
+void Journal::recordStroke( const ToolStroke &stroke ) {
+  std::string out;
+  out += (char)stroke.tool;
+  putSigned( out, stroke.x1 );
+  putSigned( out, stroke.y1 );
+  putSigned( out, stroke.x2 );
+  putSigned( out, stroke.y2 );
+  putColor( out, stroke.penColor );
+  putColor( out, stroke.fillColor );
+  putNumber( out, stroke.brushSize );
+  putNumber( out, stroke.gradientDegree );
+  putNumber( out, stroke.magnification );
+  putNumber( out, stroke.points.size() );
+  int x = 0, y = 0;
+  for (unsigned i=0; i<stroke.points.size(); i++) {
+    putSigned( out, stroke.points[i].x() - x );
+    putSigned( out, stroke.points[i].y() - y );
+    x = stroke.points[i].x();
+    y = stroke.points[i].y();
+  }
+  record( journalStroke, out );
+  myPending++;
+}
+
+void Journal::recordFilter( const CanvasFilter &filter ) {
+  std::string out;
+  out += (char)filter.kind;
+  putSigned( out, filter.value );
+  if ( filter.kind == filterKernel ) {
+    putNumber( out, filter.kernel.size );
+    for (unsigned i=0; i<filter.kernel.weights.size(); i++)
+      putReal( out, filter.kernel.weights[i] );
+  } else if ( filter.kind == filterChain ) {
+    putNumber( out, filter.chain.count() );
+    for (int s=0; s<filter.chain.count(); s++) {
+      const ChainStep &step = filter.chain.step(s);
+      out += (char)step.operation;
+      if ( step.operation == chainConvolute ) {
+        putNumber( out, step.type );
+        continue;
+      }
+      for (int c=0; c<4; c++)
+        out.append( (const char*)step.table.channel[c], 256 );
+    }
+  }
+  record( journalFilter, out );
+  myPending++;
+}
+
+void Journal::recordClear( const QColor &color ) {
+  std::string out;
+  putColor( out, color );
+  record( journalClear, out );
+  myPending++;
+}
+
+ /*
+ | Nothing is recorded if nothing has changed since the last commit.
+*/
+void Journal::recordCommit( bool kept ) {
+  if ( myPending == 0 ) return;
+  record( journalCommit, std::string( 1, (char)kept ) );
+  myPending = 0;
+}
+
+void Journal::recordUndo()
+ { record( journalUndo, "" ); }
+
+void Journal::recordRedo()
+ { record( journalRedo, "" ); }
+
+
+/*-------------------------\
+|    Replaying            |
+\-------------------------*/
+
+ /*
+ | One change: the records drawn in it, and whether the undo history kept it.
+*/
+struct ReplayChange {
+  std::vector<int> records;
+  bool             kept;
+};
+
+ /*
+ | A file saved, and how many of the changes it holds.
+*/
+struct ReplayCheckpoint {
+  int    record;
+  size_t changes;
+};
+
+static int scaled( int value, double scale )
+ { return (int)floor( value * scale + 0.5 ); }
+
+ /*
+ | Read the image file into image, scaled.  Return false if it cannot be
+ | read, or is not the size recorded.
+*/
+static bool loadScaled( const std::string &filename, int width, int height,
+                        double scale, TiledImage &image,
+                        std::string &error ) {
+  if ( !loadImage( QString::fromLocal8Bit( filename.c_str() ), image, error ) )
+    return false;
+  if ( image.width() != width || image.height() != height ) {
+    error = "not the size it was";
+    return false;
+  }
+  if ( scale != 1.0 ) {
+    QImage whole( width, height, 32 );
+    image.read( image.rect(), imageRows(whole) );
+    whole = whole.smoothScale( scaled( width, scale ),
+                               scaled( height, scale ) );
+    if ( !image.create( whole.width(), whole.height(), error ) ) return false;
+    image.write( image.rect(), imageRows(whole) );
+  }
+  return true;
+}
+
+ /*
+ | Draw a record of a change into the image.
+*/
+static bool replayRecord( const Journal &journal, int i, TiledImage &image,
+                          double scale, ReplayReport &report,
+                          std::string &error ) {
+  const std::string &payload = journal.payload(i);
+  if ( journal.type(i) == journalStroke ) {
+    ToolStroke stroke;
+    if ( !journalStrokeOf( payload, stroke ) ) {
+      error = "a stroke is damaged";
+      return false;
+    }
+    if ( scale != 1.0 ) {
+      stroke.x1 = scaled( stroke.x1, scale );
+      stroke.y1 = scaled( stroke.y1, scale );
+      stroke.x2 = scaled( stroke.x2, scale );
+      stroke.y2 = scaled( stroke.y2, scale );
+      for (unsigned p=0; p<stroke.points.size(); p++)
+        stroke.points.setPoint( p, scaled( stroke.points[p].x(), scale ),
+                                   scaled( stroke.points[p].y(), scale ) );
+      stroke.brushSize = scaled( stroke.brushSize, scale );
+      if ( stroke.brushSize < 1 ) stroke.brushSize = 1;
+    }
+    ImageToolPainter painter( image );
+    drawToolStroke( painter, stroke );
+    report.strokes++;
+  } else if ( journal.type(i) == journalFilter ) {
+    CanvasFilter filter;
+    if ( !journalFilterOf( payload, filter ) ) {
+      error = "a filter is damaged";
+      return false;
+    }
+    TileFilter *tileFilter = filter.tileFilter( scale );
+    bool applied = tiledApply( image, *tileFilter, error );
+    delete tileFilter;
+    if ( !applied ) return false;
+    report.filters++;
+  } else if ( journal.type(i) == journalClear ) {
+    JournalReader in( payload );
+    image.fill( in.color().rgb() );
+  }
+  return true;
+}
+
+ /*
+ | Work out from the records which changes are left in the image, then draw
+ | them onto the image they start from.
+*/
+bool replayJournal( const Journal &journal, TiledImage &image,
+                    const ReplayOptions &options, std::string &error,
+                    ReplayReport *report ) {
+  int end = options.until >= 0 && options.until < journal.count()
+              ? options.until : journal.count();
+  int base = -1;
+  std::vector<ReplayChange>     applied, undone;
+  std::vector<ReplayCheckpoint> checkpoints;
+  ReplayChange pending;
+  pending.kept = false;
+
+  for (int i=0; i<end; i++) {
+    switch ( journal.type(i) ) {
+      case journalNew :
+      case journalOpen :
+        base = i;
+        applied.clear();
+        undone.clear();
+        checkpoints.clear();
+        pending.records.clear();
+        break;
+      case journalStroke :
+      case journalFilter :
+      case journalClear :
+        pending.records.push_back( i );
+        break;
+      case journalCommit :
+        if ( pending.records.empty() ) break;
+        pending.kept = !journal.payload(i).empty() && journal.payload(i)[0];
+        if ( pending.kept ) undone.clear();
+        applied.push_back( pending );
+        pending.records.clear();
+        break;
+      case journalUndo :
+        for (int c=(int)applied.size()-1; c>=0; c--) {
+          if ( !applied[c].kept ) continue;
+          undone.push_back( applied[c] );
+          applied.erase( applied.begin() + c );
+          while ( !checkpoints.empty() &&
+                  checkpoints.back().changes > (size_t)c )
+            checkpoints.pop_back();
+          break;
+        }
+        break;
+      case journalRedo :
+        if ( undone.empty() ) break;
+        applied.push_back( undone.back() );
+        undone.pop_back();
+        break;
+      case journalSave : {
+        if ( !pending.records.empty() ) break;
+         // a file saved again holds only the latest
+        for (unsigned c=0; c<checkpoints.size(); c++)
+          if ( journal.payload( checkpoints[c].record ) ==
+               journal.payload(i) )
+            checkpoints.erase( checkpoints.begin() + c-- );
+        ReplayCheckpoint checkpoint = { i, applied.size() };
+        checkpoints.push_back( checkpoint );
+        break;
+      }
+    }
+  }
+  if ( !pending.records.empty() ) applied.push_back( pending );
+  if ( base < 0 ) {
+    error = "the journal has no image to start from";
+    return false;
+  }
+
+  ReplayReport done;
+  size_t first = 0;
+  TiledImage result;
+  if ( options.fromCheckpoint )
+    while ( !checkpoints.empty() ) {
+      JournalReader in( journal.payload( checkpoints.back().record ) );
+      int width = in.number(), height = in.number();
+      std::string filename = in.string(), failed;
+      if ( in.ok() && loadScaled( filename, width, height, options.scale,
+                                  result, failed ) ) {
+        first = checkpoints.back().changes;
+        done.start = filename;
+        break;
+      }
+      checkpoints.pop_back();
+    }
+
+  if ( done.start.empty() ) {
+    JournalReader in( journal.payload( base ) );
+    int width = in.number(), height = in.number();
+    if ( journal.type( base ) == journalNew ) {
+      QColor background = in.color();
+      if ( !in.ok() ) {
+        error = "the journal's first image is damaged";
+        return false;
+      }
+      if ( !result.create( scaled( width, options.scale ),
+                           scaled( height, options.scale ), error ) )
+        return false;
+      result.fill( background.rgb() );
+      done.start = "a blank image";
+    } else {
+      std::string filename = in.string();
+      if ( !in.ok() ) {
+        error = "the journal's first image is damaged";
+        return false;
+      }
+      if ( !loadScaled( filename, width, height, options.scale, result,
+                        error ) ) {
+        error = filename + ": " + error;
+        return false;
+      }
+      done.start = filename;
+    }
+  }
+
+  for (size_t c=first; c<applied.size(); c++) {
+    for (unsigned r=0; r<applied[c].records.size(); r++)
+      if ( !replayRecord( journal, applied[c].records[r], result,
+                          options.scale, done, error ) )
+        return false;
+    done.changes++;
+  }
+  image.swap( result );
+  if ( report ) *report = done;
+  return true;
+}
@@ -0,0 +1,119 @@
+/*---------------------.
+| journal.h             \______________________________
+|                                                      \
+| A record of a session's changes to the canvas: each  |
+| stroke of a tool, with its points and the colors,    |
+| brush size and gradient it was drawn with, each      |
+| filter, clear and opened file, and the undos and     |
+| redos in between.  It takes a few bytes a stroke,    |
+| where the image takes four a pixel.                  |
+|                                                      |
+| Replayed, it draws the image again without a window: |
+| to the pixel, since the tools and filters give the   |
+| same result on every machine, or at another size, or |
+| up to any record in it, or from the last image saved |
+| on the way.  Strokes replay as fast as the image can |
+| be drawn on, with none of the waiting for the mouse, |
+| the screen or the undo history.                      |
+|                                                      |
+| The file is added to as the session goes, so a      |
+| session cut short can be restored from it; a record  |
+| left half written is dropped.                        |
+\_____________________________________________________*/
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+
+#include "splatterBoardManip.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+enum journalRecord { journalNew = 1, journalOpen, journalSave, journalStroke,
+                     journalFilter, journalClear, journalCommit, journalUndo,
+                     journalRedo };
+
+class Journal {
+ public:
+  Journal();
+  ~Journal();
+
+   // Read the journal in the file, if there is one, and add the records
+   // made from now on to the end of it.  Return false, with the reason in
+   // error, if it cannot be read or written.
+  bool open( const char *filename, std::string &error );
+
+   // Read the journal in the file, only to replay it.
+  bool read( const char *filename, std::string &error );
+
+  int    count() const { return (int)myTypes.size(); }
+  size_t bytes() const { return myBytes; }
+
+  journalRecord      type( int i )    const { return myTypes[i]; }
+  const std::string &payload( int i ) const { return myPayloads[i]; }
+
+   // A blank image, or one opened from a file, which the changes after it
+   // start from; a file saved, which a replay may start from.
+  void recordNew( int width, int height, const QColor &background );
+  void recordOpen( const QString &filename, int width, int height );
+  void recordSave( const QString &filename, int width, int height );
+
+   // The changes.  The strokes, filters and clears since the last commit
+   // are one change, which the undo history kept to be undone or did not.
+  void recordStroke( const ToolStroke &stroke );
+  void recordFilter( const CanvasFilter &filter );
+  void recordClear( const QColor &color );
+  void recordCommit( bool kept );
+  void recordUndo();
+  void recordRedo();
+
+ protected:
+  bool load( const char *filename, bool &found, long &length,
+             std::string &error );
+  void record( journalRecord type, const std::string &payload );
+
+  FILE *myFile;
+  std::vector<journalRecord> myTypes;
+  std::vector<std::string>   myPayloads;
+  size_t myBytes;
+  int    myPending;      // strokes, filters and clears not yet committed
+
+ private:
+  Journal( const Journal & );                    // not to be copied
+  Journal &operator=( const Journal & );
+};
+
+
+ // Read a record's contents back.  Return false if it is not a whole one.
+bool journalStrokeOf( const std::string &payload, ToolStroke &stroke );
+bool journalFilterOf( const std::string &payload, CanvasFilter &filter );
+
+
+struct ReplayOptions {
+  double scale;            // the size to draw at, times the size recorded
+  int    until;            // replay the records before this one, or all
+  bool   fromCheckpoint;   // start from the last file saved, if there is one
+
+  ReplayOptions() : scale(1.0), until(-1), fromCheckpoint(false) {}
+};
+
+struct ReplayReport {
+  int         changes, strokes, filters;   // those replayed
+  std::string start;                       // what they were replayed onto
+
+  ReplayReport() : changes(0), strokes(0), filters(0) {}
+};
+
+ // Draw the image the journal's records leave into image, which is made
+ // afresh.  Return false, with the reason in error, if there is no image to
+ // start from or it cannot be read.
+bool replayJournal( const Journal &journal, TiledImage &image,
+                    const ReplayOptions &options, std::string &error,
+                    ReplayReport *report = 0 );
+
+
+#endif
@@ -1,10 +1,32 @@
 #include <qapplication.h>
 #include "splatterBoardManip.h"
+#include "batchMode.h"
+#include "verifyMode.h"
+#include "replayMode.h"
+#include "profiler.h"
+
+#include <stdio.h>
+
+ /*
+ | Run the batch mode, the verify mode, the replay mode or the window, as the
+ | command line asks, returning the exit status.
+*/
+static int run( int argc, char **argv ) {
+  if ( isBatchCommand( argc, argv ) )
+    return runBatch( argc, argv );
+  if ( isVerifyCommand( argc, argv ) )
+    return runVerify( argc, argv );
+  if ( isReplayCommand( argc, argv ) )
+    return runReplay( argc, argv );
 
-int main( int argc, char **argv ) {
   QApplication a( argc, argv );
 
   splatterBoardManip paintwin;
+  for ( int i = 1; i+1 < argc; i++ )
+    if ( QString( argv[i] ) == "--history-mb" )
+      paintwin.setHistoryLimit( QString( argv[i+1] ).toInt() );
+    else if ( QString( argv[i] ) == "--journal" )
+      paintwin.setJournal( argv[i+1] );
 
   paintwin.resize( 500, 500 );
   paintwin.setCaption("SplatterBoardManip");
@@ -12,3 +34,24 @@ int main( int argc, char **argv ) {
   paintwin.show();
   return a.exec();
 }
+
+int main( int argc, char **argv ) {
+   // the number of threads the image manipulation filters use, and the
+   // file to write the timings to, as a trace, at the end
+  const char *traceFile = 0;
+  for ( int i = 1; i+1 < argc; i++ )
+    if ( QString( argv[i] ) == "--threads" )
+      imageSetThreadCount( QString( argv[i+1] ).toInt() );
+    else if ( QString( argv[i] ) == "--trace" )
+      traceFile = argv[i+1];
+  if ( traceFile ) profileEnable( true, true );
+
+  int status = run( argc, argv );
+
+  std::string error;
+  if ( traceFile && !profileWriteTrace( traceFile, error ) ) {
+    fprintf( stderr, "%s\n", error.c_str() );
+    if ( status == 0 ) status = 1;
+  }
+  return status;
+}
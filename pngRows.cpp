@@ -0,0 +1,206 @@
+/*---------------------.
+| pngRows.cpp           \______________________________
+|                                                      \
+| See the header of pngRows.h for details.             |
+|                                                      |
+| libpng reports errors by jumping back to the last    |
+| setjmp(), so each call into it is made from a member |
+| with nothing to destroy on the way back, and the     |
+| message is kept in myError for it to report.         |
+\_____________________________________________________*/
+
+#include "pngRows.h"
+
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+
+static void pngError( png_structp png, png_const_charp message ) {
+  char *error = (char*)png_get_error_ptr( png );
+  strncpy( error, message, 255 );
+  error[255] = '\0';
+  longjmp( png_jmpbuf( png ), 1 );
+}
+
+static void pngWarning( png_structp, png_const_charp ) {}
+
+
+PngReader::PngReader()
+ : myFile(0), myPng(0), myInfo(0), myWidth(0), myHeight(0), myAlpha(false)
+ { myError[0] = '\0'; }
+
+PngReader::~PngReader()
+ { close(); }
+
+void PngReader::close() {
+  if ( myPng ) png_destroy_read_struct( &myPng, myInfo ? &myInfo : 0, 0 );
+  if ( myFile ) fclose( myFile );
+  myFile = 0;
+  myPng = 0;
+  myInfo = 0;
+}
+
+ /*
+ | Every kind of PNG is read as 8 bits a channel, blue, green, red and alpha
+ | in memory: palettes and grey are expanded, 16 bits cut to 8, and a
+ | transparent colour made into an alpha channel.
+*/
+bool PngReader::open( const char *filename, std::string &error ) {
+  close();
+  myFile = fopen( filename, "rb" );
+  if ( !myFile ) {
+    error = std::string( "cannot open: " ) + strerror( errno );
+    return false;
+  }
+  png_byte signature[8];
+  if ( fread( signature, 1, 8, myFile ) != 8 ||
+       png_sig_cmp( signature, 0, 8 ) != 0 ) {
+    error = "not a PNG file";
+    close();
+    return false;
+  }
+
+  myPng  = png_create_read_struct( PNG_LIBPNG_VER_STRING, myError, pngError,
+                                   pngWarning );
+  myInfo = myPng ? png_create_info_struct( myPng ) : 0;
+  if ( !myInfo ) {
+    error = "out of memory";
+    close();
+    return false;
+  }
+  if ( setjmp( png_jmpbuf( myPng ) ) ) {
+    error = myError;
+    close();
+    return false;
+  }
+  png_init_io( myPng, myFile );
+  png_set_sig_bytes( myPng, 8 );
+  png_read_info( myPng, myInfo );
+
+  if ( png_get_interlace_type( myPng, myInfo ) != PNG_INTERLACE_NONE ) {
+    error = "interlaced, so cannot be read a row at a time";
+    close();
+    return false;
+  }
+  int type = png_get_color_type( myPng, myInfo );
+  myAlpha = (type & PNG_COLOR_MASK_ALPHA) ||
+            png_get_valid( myPng, myInfo, PNG_INFO_tRNS );
+  png_set_expand( myPng );
+  png_set_strip_16( myPng );
+  if ( !(type & PNG_COLOR_MASK_COLOR) ) png_set_gray_to_rgb( myPng );
+  if ( !myAlpha ) png_set_filler( myPng, 0xff, PNG_FILLER_AFTER );
+  png_set_bgr( myPng );
+  png_read_update_info( myPng, myInfo );
+
+  myWidth  = png_get_image_width( myPng, myInfo );
+  myHeight = png_get_image_height( myPng, myInfo );
+  return true;
+}
+
+bool PngReader::readRow( uint32_t *row, std::string &error ) {
+  if ( setjmp( png_jmpbuf( myPng ) ) ) {
+    error = myError;
+    return false;
+  }
+  png_read_row( myPng, (png_bytep)row, 0 );
+  return true;
+}
+
+bool PngReader::readInto( RowSink &sink, std::string &error ) {
+  std::vector<uint32_t> row( myWidth );
+  for (int y=0; y<myHeight; y++) {
+    if ( !readRow( &row[0], error ) ) return false;
+    if ( !sink.putRow( &row[0] ) ) {
+      error = "stopped";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+PngWriter::PngWriter()
+ : myFile(0), myPng(0), myInfo(0), myFailed(false)
+ { myError[0] = '\0'; }
+
+PngWriter::~PngWriter()
+ { close(); }
+
+void PngWriter::close() {
+  if ( myPng ) png_destroy_write_struct( &myPng, myInfo ? &myInfo : 0 );
+  if ( myFile ) fclose( myFile );
+  myFile = 0;
+  myPng = 0;
+  myInfo = 0;
+}
+
+bool PngWriter::open( const char *filename, int width, int height,
+                      bool alpha, std::string &error ) {
+  close();
+  myFailed = false;
+  myFile = fopen( filename, "wb" );
+  if ( !myFile ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    return false;
+  }
+
+  myPng  = png_create_write_struct( PNG_LIBPNG_VER_STRING, myError, pngError,
+                                    pngWarning );
+  myInfo = myPng ? png_create_info_struct( myPng ) : 0;
+  if ( !myInfo ) {
+    error = "out of memory";
+    close();
+    return false;
+  }
+  if ( setjmp( png_jmpbuf( myPng ) ) ) {
+    error = myError;
+    close();
+    return false;
+  }
+  png_init_io( myPng, myFile );
+  png_set_IHDR( myPng, myInfo, width, height, 8,
+                alpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                PNG_FILTER_TYPE_DEFAULT );
+  png_write_info( myPng, myInfo );
+  png_set_bgr( myPng );
+  if ( !alpha ) png_set_filler( myPng, 0, PNG_FILLER_AFTER );
+  return true;
+}
+
+bool PngWriter::putRow( const uint32_t *row ) {
+  if ( myFailed || !myPng ) return false;
+  if ( setjmp( png_jmpbuf( myPng ) ) ) {
+    myFailed = true;
+    return false;
+  }
+  png_write_row( myPng, (png_bytep)row );
+  return true;
+}
+
+bool PngWriter::finish( std::string &error ) {
+  if ( !myPng ) {
+    error = "not open";
+    return false;
+  }
+  if ( !myFailed ) {
+    if ( setjmp( png_jmpbuf( myPng ) ) )
+      myFailed = true;
+    else
+      png_write_end( myPng, 0 );
+  }
+  if ( myFailed ) {
+    error = myError;
+    close();
+    return false;
+  }
+  png_destroy_write_struct( &myPng, &myInfo );
+  int closed = fclose( myFile );
+  myFile = 0;
+  if ( closed != 0 ) {
+    error = std::string( "cannot write: " ) + strerror( errno );
+    return false;
+  }
+  return true;
+}
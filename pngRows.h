@@ -0,0 +1,97 @@
+/*---------------------.
+| pngRows.h             \______________________________
+|                                                      \
+| PNG files read and written a row at a time, through  |
+| libpng, for images too large to decode whole into a  |
+| QImage.  Rows are 0xAARRGGBB pixels, as everywhere   |
+| else; images with no alpha channel are read as       |
+| opaque.                                              |
+|                                                      |
+| Interlaced files keep the rows of each pass apart,   |
+| so cannot be read a row at a time; PngReader refuses |
+| them, and they must be read whole.                   |
+\_____________________________________________________*/
+
+
+#ifndef PNGROWS_H
+#define PNGROWS_H
+
+
+#include "rowStream.h"
+
+#include <stdio.h>
+#include <png.h>
+#include <string>
+
+
+class PngReader {
+ public:
+  PngReader();
+  ~PngReader();
+
+   // Open the file and read its header.  Return false, with the reason in
+   // error, if it is not a PNG file that can be read a row at a time.
+  bool open( const char *filename, std::string &error );
+
+  int  width()    const { return myWidth; }
+  int  height()   const { return myHeight; }
+  bool hasAlpha() const { return myAlpha; }
+
+   // Read the next row into row, width() pixels.  Return false, with the
+   // reason in error, if it cannot be read.
+  bool readRow( uint32_t *row, std::string &error );
+
+   // Read every row left into sink.  Return false, with the reason in error,
+   // if a row cannot be read or the sink stops.
+  bool readInto( RowSink &sink, std::string &error );
+
+ protected:
+  void close();
+
+  FILE       *myFile;
+  png_structp myPng;
+  png_infop   myInfo;
+  int         myWidth, myHeight;
+  bool        myAlpha;
+  char        myError[256];
+
+ private:
+  PngReader( const PngReader & );                // not to be copied
+  PngReader &operator=( const PngReader & );
+};
+
+
+class PngWriter : public RowSink {
+ public:
+  PngWriter();
+  ~PngWriter();
+
+   // Create the file and write its header, for an image of the given size,
+   // with an alpha channel or not.  Return false, with the reason in error,
+   // if it cannot be written.
+  bool open( const char *filename, int width, int height, bool alpha,
+             std::string &error );
+
+   // Write the next row.  A failure is kept, for finish() to report.
+  bool putRow( const uint32_t *row );
+
+   // Write the end of the file, and close it.  Return false, with the reason
+   // in error, if it, or any row, could not be written.
+  bool finish( std::string &error );
+
+ protected:
+  void close();
+
+  FILE       *myFile;
+  png_structp myPng;
+  png_infop   myInfo;
+  bool        myFailed;
+  char        myError[256];
+
+ private:
+  PngWriter( const PngWriter & );                // not to be copied
+  PngWriter &operator=( const PngWriter & );
+};
+
+
+#endif
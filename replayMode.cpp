@@ -0,0 +1,134 @@
+/*---------------------.
+| replayMode.cpp        \______________________________
+|                                                      \
+| See the header of replayMode.h for details.          |
+\_____________________________________________________*/
+
+#include "replayMode.h"
+#include "journal.h"
+
+#include <qapplication.h>
+#include <qdatetime.h>
+#include <qfileinfo.h>
+
+#include <stdio.h>
+#include <string.h>
+
+
+static void printUsage( const char *program ) {
+  fprintf( stderr,
+    "usage: %s --replay <journal> <output> [--scale <f>] [--until <n>]\n"
+    "       %*s [--checkpoint] [--threads <n>] [--trace <file>]\n"
+    "   or: %s --replay <journal> --list\n",
+    program, (int)strlen(program), "", program );
+}
+
+ /*
+ | Print each record, numbered as --until counts them.
+*/
+static void listRecords( const Journal &journal ) {
+  static const char *names[] = { "", "new", "open", "save", "stroke",
+                                 "filter", "clear", "commit", "undo", "redo" };
+  static const char *tools[] = { "none", "pen", "line", "rectangle",
+                                 "rectangleFilled", "circle", "circleFilled",
+                                 "triangle", "triangleFilled" };
+  for ( int i = 0; i < journal.count(); i++ ) {
+    journalRecord type = journal.type(i);
+    printf( "%6d  %-7s", i, type <= journalRedo ? names[type] : "?" );
+    ToolStroke stroke;
+    CanvasFilter filter;
+    if ( type == journalStroke && journalStrokeOf( journal.payload(i), stroke )
+         && stroke.tool <= triangleFilled )
+      printf( " %s, %d points", tools[stroke.tool],
+              stroke.tool == pen ? (int)stroke.points.size() : 2 );
+    else if ( type == journalFilter &&
+              journalFilterOf( journal.payload(i), filter ) )
+      printf( " kind %d, %d", filter.kind, filter.value );
+    else if ( type == journalCommit && !journal.payload(i).empty() &&
+              !journal.payload(i)[0] )
+      printf( " (not undoable)" );
+    printf( "\n" );
+  }
+}
+
+
+bool isReplayCommand( int argc, char **argv )
+ { return argc > 1 && QString( argv[1] ) == "--replay"; }
+
+ /*
+ | Read the journal, and draw what it records into the output file.
+*/
+int runReplay( int argc, char **argv ) {
+  QApplication app( argc, argv, FALSE );
+  ReplayOptions options;
+  QString output;
+  bool list = false;
+
+  if ( argc < 3 ) {
+    printUsage( argv[0] );
+    return 2;
+  }
+  for ( int i = 3; i < argc; i++ ) {
+    if ( QString( argv[i] ) == "--scale" && i+1 < argc )
+      options.scale = QString( argv[++i] ).toDouble();
+    else if ( QString( argv[i] ) == "--until" && i+1 < argc )
+      options.until = QString( argv[++i] ).toInt();
+    else if ( QString( argv[i] ) == "--checkpoint" )
+      options.fromCheckpoint = true;
+    else if ( QString( argv[i] ) == "--list" )
+      list = true;
+    else if ( ( QString( argv[i] ) == "--threads" ||
+                QString( argv[i] ) == "--trace" ) && i+1 < argc )
+      i++;   // already applied by main()
+    else if ( output.isEmpty() )
+      output = argv[i];
+    else {
+      printUsage( argv[0] );
+      return 2;
+    }
+  }
+  if ( ( output.isEmpty() && !list ) || options.scale <= 0.0 ) {
+    printUsage( argv[0] );
+    return 2;
+  }
+
+  std::string error;
+  Journal journal;
+  if ( !journal.read( argv[2], error ) ) {
+    fprintf( stderr, "%s: %s\n", argv[2], error.c_str() );
+    return 1;
+  }
+  if ( list ) {
+    listRecords( journal );
+    if ( output.isEmpty() ) return 0;
+  }
+
+  QTime stage;
+  stage.start();
+  TiledImage image;
+  ReplayReport report;
+  {
+    StageTimer timer( "replay" );
+    if ( !replayJournal( journal, image, options, error, &report ) ) {
+      fprintf( stderr, "%s: %s\n", argv[2], error.c_str() );
+      return 1;
+    }
+  }
+  int replayed = stage.elapsed();
+  printf( "%s: %d records, %.1f KB, onto %s\n", argv[2], journal.count(),
+          journal.bytes() / 1024.0, report.start.c_str() );
+  printf( "  %d changes (%d strokes, %d filters) in %d ms, %dx%d\n",
+          report.changes, report.strokes, report.filters, replayed,
+          image.width(), image.height() );
+
+  stage.start();
+  QString format = QFileInfo( output ).extension( FALSE ).upper();
+  if ( format == "JPG" ) format = "JPEG";
+  if ( !saveImage( image, output, format, error ) ) {
+    fprintf( stderr, "%s: %s\n", output.latin1(), error.c_str() );
+    return 1;
+  }
+  printf( "  %-12s %8d ms, %.1f MB as pixels\n", "save", stage.elapsed(),
+          image.width() * (double)image.height() * 4 / 1048576.0 );
+  return 0;
+}
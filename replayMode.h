@@ -0,0 +1,29 @@
+/*---------------------.
+| replayMode.h          \______________________________
+|                                                      \
+| A headless command-line mode which draws the image a |
+| session's journal records (see journal.h), without   |
+| opening a window or an OpenGL context.               |
+|                                                      |
+|   splatterBoardManip --replay session.sbj out.png    |
+|                                                      |
+| --scale <f> draws it at f times the size it was      |
+| drawn at; --until <n> stops before the n'th record,  |
+| as the session was at that point; --checkpoint       |
+| starts from the last image saved on the way instead  |
+| of from the start; --list prints the records.        |
+\_____________________________________________________*/
+
+
+#ifndef REPLAYMODE_H
+#define REPLAYMODE_H
+
+
+ // Return true if the command line asks for the replay mode.
+bool isReplayCommand( int argc, char **argv );
+
+ // Run the replay mode, returning the process exit status.
+int  runReplay( int argc, char **argv );
+
+
+#endif
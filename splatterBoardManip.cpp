@@ -23,6 +23,37 @@
 #include <qfiledialog.h>
 #include <qimage.h>
 #include <qcolordialog.h> 
+#include <qmessagebox.h>
+#include <qstatusbar.h>
+#include <qtimer.h>
+
+#include "toolPainter.h"
+#include "pngRows.h"
+#include "journal.h"
+#include "tileFile.h"
+
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+ /*
+ | Rows handed into a TiledImage, from the top.
+*/
+class TiledRowSink : public RowSink {
+ public:
+  TiledRowSink( TiledImage &image ) : myImage(image), myY(0) {}
+  bool putRow( const uint32_t *row ) {
+    myImage.write( PixelRect( 0, myY, myImage.width(), myY+1 ),
+                   ImageRows( (uint32_t*)row, myImage.width(), 1, 0 ) );
+    myY++;
+    return true;
+  }
+
+ protected:
+  TiledImage &myImage;
+  int         myY;
+};
 
  /*
  | Construct a canvas, initializing its name and member values.
@@ -35,129 +66,261 @@ Canvas::Canvas( QWidget *parent, const char *name ) : QGLWidget(parent, name) {
   myBackgroundColor = new QColor(214,236,233);
   myBrushSize = 6;
   myGradientDegree = 95;
-  myFadeDegree = 128;
+  myFadeDegree = defaultFadeDegree;
   myActiveTool = none;
+  mousePressed = false;
+  panning = false;
+  tablePreview = false;
+  myMotionEvents = myStrokeFrames = 0;
+  myZoom = myViewX = myViewY = 0;
+  myJournal = 0;
+
+  myFrameTimer = new QTimer( this );
+  connect( myFrameTimer, SIGNAL( timeout() ), this, SLOT( drawStroke() ) );
+}
 
-  buffer = grabFrameBuffer(true);
-  workingBuffer = buffer;
+ /*
+ | Make the canvas's context current, so that the textures can be deleted.
+*/
+Canvas::~Canvas() {
+  makeCurrent();
+  delete myJournal;
 }
 
  /*
- | Save the buffer into the specified image.
+ | Save the buffer into the specified image, and note it in the journal.
 */
-void Canvas::save( const QString &filename, const QString &format )
- { buffer.save( filename, format.upper() ); }
+void Canvas::save( const QString &filename, const QString &format ) {
+  StageTimer timer( "save" );
+  std::string error;
+  if ( !saveImage( buffer, filename, format, error, settings() ) ) {
+    qWarning( "%s: %s", filename.latin1(), error.c_str() );
+    return;
+  }
+  if ( myJournal )
+    myJournal->recordSave( filename, buffer.width(), buffer.height() );
+}
 
  /*
- | Open the specified image into buffer and call paintGL to display it.
+ | Open the specified image into buffer, at its own size whatever the size
+ | of the canvas, and call paintGL to display it.  The buffer is left as it
+ | was if the image cannot be read.
 */
 void Canvas::open( const QString &filename ) {
-  buffer.load( filename );
-  openPic=true;
+  StageTimer timer( "open" );
+  std::string error, settings;
+  TiledImage image;
+  if ( !loadImage( filename, image, error, &settings ) ) {
+    qWarning( "%s: %s", filename.latin1(), error.c_str() );
+    return;
+  }
+  setSettings( settings );
+  buffer.swap( image );
+  myHistory.reset( buffer.width(), buffer.height() );
+  myPyramid.reset( buffer );
+  if ( myJournal )
+    myJournal->recordOpen( filename, buffer.width(), buffer.height() );
+  setView( 0, 0, 0 );
   updateGL();
 }
 
  /*
- | Clear the canvas with the background color
+ | The settings are kept as text, so that ones added later are simply
+ | missing from older files.
 */
-void Canvas::clear() {
-  buffer.fill( myBackgroundColor->pixel() );
-  openPic=true;
-  updateGL();
+std::string Canvas::settings() const {
+  char text[256];
+  snprintf( text, sizeof(text),
+            "tool %d\npen %02x%02x%02x\nfill %02x%02x%02x\n"
+            "background %02x%02x%02x\nbrush %d\ngradient %d\nfade %d\n",
+            myActiveTool,
+            myPenColor->red(), myPenColor->green(), myPenColor->blue(),
+            myFillColor->red(), myFillColor->green(), myFillColor->blue(),
+            myBackgroundColor->red(), myBackgroundColor->green(),
+            myBackgroundColor->blue(),
+            myBrushSize, myGradientDegree, myFadeDegree );
+  return text;
 }
 
+void Canvas::setSettings( const std::string &settings ) {
+  size_t at = 0;
+  while ( at < settings.size() ) {
+    size_t end = settings.find( '\n', at );
+    if ( end == std::string::npos ) end = settings.size();
+    std::string line = settings.substr( at, end - at );
+    at = end + 1;
+
+    char name[32];
+    int value;
+    unsigned r, g, b;
+    if ( sscanf( line.c_str(), "%31s %2x%2x%2x", name, &r, &g, &b ) == 4 &&
+         line.size() == strlen( name ) + 7 ) {
+      QColor color( r, g, b );
+      if      ( !strcmp( name, "pen" ) )        *myPenColor        = color;
+      else if ( !strcmp( name, "fill" ) )       *myFillColor       = color;
+      else if ( !strcmp( name, "background" ) ) *myBackgroundColor = color;
+    } else if ( sscanf( line.c_str(), "%31s %d", name, &value ) == 2 ) {
+      if      ( !strcmp( name, "tool" ) && value >= none &&
+                value <= triangleFilled )     myActiveTool     = value;
+      else if ( !strcmp( name, "brush" ) )    myBrushSize      = value;
+      else if ( !strcmp( name, "gradient" ) ) myGradientDegree = value;
+      else if ( !strcmp( name, "fade" ) )     myFadeDegree     = value;
+    }
+  }
+}
 
  /*
- | Apply the given convolution matrix to the pixel at the given location, and
- | set the rgb color to the color for the pixel at that location.
+ | Keep a journal in the file.  If it already holds one, the session is
+ | restored from it when the buffer is first made, in place of a blank one,
+ | and the new changes are added to it.
 */
-void Canvas::convolute(const convolutionType type) {
-  color3f255 rgb;
-  unsigned int pix;
+void Canvas::setJournal( const QString &filename ) {
+  std::string error;
+  Journal *journal = new Journal;
+  if ( !journal->open( filename.local8Bit(), error ) ) {
+    qWarning( "%s: %s", filename.latin1(), error.c_str() );
+    delete journal;
+    return;
+  }
+  delete myJournal;
+  myJournal = journal;
+}
 
-  buffer = grabFrameBuffer(true);
-  workingBuffer = buffer;
+ /*
+ | Make the buffer: the session in the journal, if there is one, or else a
+ | blank image of the given size.
+*/
+void Canvas::createBuffer( int w, int h ) {
+  std::string error;
+  if ( myJournal && myJournal->count() > 0 ) {
+    StageTimer timer( "restore" );
+    if ( !replayJournal( *myJournal, buffer, ReplayOptions(), error ) )
+      qWarning( "%s", error.c_str() );
+  }
+  if ( buffer.isNull() ) {
+    if ( buffer.create( w, h, error ) )
+      buffer.fill( myBackgroundColor->rgb() );
+    else
+      qWarning( "%s", error.c_str() );
+    if ( myJournal ) myJournal->recordNew( w, h, *myBackgroundColor );
+  }
+  myHistory.reset( buffer.width(), buffer.height() );
+  myPyramid.reset( buffer );
+}
 
-  for (int x=1; x<(buffer.width()-2); x++)
-    for (int y=1; y<(buffer.height()-2); y++) {
+ /*
+ | Clear the canvas with the background color
+*/
+void Canvas::clear() {
+  beginChange();
+  buffer.fill( myBackgroundColor->rgb() );
+  if ( myJournal ) myJournal->recordClear( *myBackgroundColor );
+  endChange();
+  myDirtyRect = buffer.rect();
+  openPic=true;
+  updateGL();
+}
 
-      rgb[0] = rgb[1] = rgb[2] = 0.0;
-      for( int row = -1;  row <= 1;  row++ ) {
-        for( int col = -1;  col <= 1;  col++ ) {
-          pix = buffer.pixel( x+row, y+col );
-          rgb[0] += (double)qRed(pix)   * convolutionMatrix[type][col+1][row+1];
-          rgb[1] += (double)qGreen(pix) * convolutionMatrix[type][col+1][row+1];
-          rgb[2] += (double)qBlue(pix)  * convolutionMatrix[type][col+1][row+1];
-        }
-      }
 
-      workingBuffer.setPixel( x, y,
-       qRgb(limit0_255((int)rgb[0]),
-            limit0_255((int)rgb[1]),
-            limit0_255((int)rgb[2])) );
+ /*
+ | Keep the whole buffer, as it is before a change, in the history.
+*/
+void Canvas::beginChange()
+ { myHistory.touch( buffer, buffer.rect() ); }
 
-    }
+ /*
+ | Keep the tiles the change changed in the history, as one change, and mark
+ | the end of it in the journal, with whether it can be undone.
+*/
+void Canvas::endChange() {
+  bool kept = myHistory.commit( buffer );
+  if ( myJournal ) myJournal->recordCommit( kept );
+}
 
-  buffer = workingBuffer;
+ /*
+ | Run the filter over the whole buffer, a block of tiles at a time, as one
+ | change, and draw the result.
+*/
+void Canvas::applyFilter(const CanvasFilter &filter) {
+  std::string error;
+  TileFilter *tileFilter = filter.tileFilter();
+  beginChange();
+  if ( tiledApply( buffer, *tileFilter, error ) ) {
+    if ( myJournal ) myJournal->recordFilter( filter );
+  } else {
+    qWarning( "%s", error.c_str() );
+  }
+  delete tileFilter;
+  endChange();
+  myDirtyRect = buffer.rect();
   openPic=true;
   updateGL();
 }
 
-
  /*
- | Invert the colors in the image.
+ | Undo the last change to the buffer (or redo the last undone), drawing
+ | just the tiles it puts back.  A change still being made is ended first.
 */
-void Canvas::invert() {
-  buffer.invertPixels();
-  openPic=true;
+void Canvas::undo() {
+  StageTimer timer( "undo" );
+  endChange();
+  PixelRect restored = myHistory.undo(buffer);
+  if ( myJournal && !restored.isEmpty() ) myJournal->recordUndo();
+  myDirtyRect = myDirtyRect.united( restored );
   updateGL();
 }
 
+void Canvas::redo() {
+  StageTimer timer( "redo" );
+  endChange();
+  PixelRect restored = myHistory.redo(buffer);
+  if ( myJournal && !restored.isEmpty() ) myJournal->recordRedo();
+  myDirtyRect = myDirtyRect.united( restored );
+  updateGL();
+}
 
  /*
- | Fade the colors in the image towards white.
- | Approximately the opposite of intensify().
+ | Set the most memory the undo history may take, in megabytes.
 */
-void Canvas::fade() {
-  unsigned int pix;
+void Canvas::setHistoryLimit(int megabytes)
+ { myHistory.setLimit( (size_t)megabytes * 1024 * 1024 ); }
 
-  buffer = grabFrameBuffer(true);
 
-  for (int y=0; y<buffer.height(); y++)
-    for (int x=0; x<buffer.width(); x++) {
-      pix = buffer.pixel(x,y);
-      buffer.setPixel(x, y, 
-       qRgb(limit0_255( qRed(pix)/2   + myFadeDegree ),
-            limit0_255( qGreen(pix)/2 + myFadeDegree ),
-            limit0_255( qBlue(pix)/2  + myFadeDegree )) );
-    }
+ /*
+ | Apply the given convolution matrix to the image in the buffer.
+*/
+void Canvas::convolute(const convolutionType type)
+ { applyFilter( CanvasFilter(filterConvolute, type) ); }
 
-  openPic=true;
-  updateGL();
-}
+
+ /*
+ | Blur the image with a box of the given radius.
+*/
+void Canvas::boxBlur(const int radius)
+ { applyFilter( CanvasFilter(filterBoxBlur, radius) ); }
 
 
  /*
- | Intensify the colors in the image towards black.
- | Approximately the opposite of fade().
+ | Invert the colors in the image.
 */
-void Canvas::intensify() {
-  unsigned int pix;
+void Canvas::invert()
+ { applyFilter( CanvasFilter(filterInvert) ); }
 
-  buffer = grabFrameBuffer(true);
 
-  for (int y=0; y<buffer.height(); y++)
-    for (int x=0; x<buffer.width(); x++) {
-      pix = buffer.pixel(x,y);
-      buffer.setPixel(x, y, 
-       qRgb(limit0_255( (qRed(pix)   - myFadeDegree) * 2),
-            limit0_255( (qGreen(pix) - myFadeDegree) * 2),
-            limit0_255( (qBlue(pix)  - myFadeDegree) * 2)) );
-    }
+ /*
+ | Fade the colors in the image towards white.
+ | Approximately the opposite of intensify().
+*/
+void Canvas::fade()
+ { applyFilter( CanvasFilter(filterFade, myFadeDegree) ); }
 
-  openPic=true;
-  updateGL();
-}
+
+ /*
+ | Intensify the colors in the image towards black.
+ | Approximately the opposite of fade().
+*/
+void Canvas::intensify()
+ { applyFilter( CanvasFilter(filterIntensify, myFadeDegree) ); }
 
 
  /*
@@ -165,64 +328,137 @@ void Canvas::intensify() {
  | Store the location at which the mouse was pressed for drawing purposes.
 */
 void Canvas::mousePressEvent( QMouseEvent *e ) {
+  StageTimer timer( "mouse" );
+  if ( e->button() == MidButton ) {   // the middle button drags the view
+    panning = true;
+    myPanX = e->x();
+    myPanY = e->y();
+    return;
+  }
   mousePressed = true;
-  x1 = e->x();
-  y1 = height() - e->y();
+  QPoint p = toImage( e->x(), e->y() );
+  x1 = p.x();
+  y1 = buffer.height() - p.y();
   x2 = x1;
   y2 = y1;
+  myStroke.resize(1);
+  myStroke.setPoint(0, x1, y1);
+  myMotionEvents = myStrokeFrames = 0;
+  updatePreview();
 }
 
  /* 
  | Receive a mouse release event.
- | With the active tool, clear any XOR drawings and make a regular drawing.
+ | With the active tool, drop the preview and draw the final drawing into
+ | the buffer.
 */
-void Canvas::mouseReleaseEvent( QMouseEvent * ) {
+void Canvas::mouseReleaseEvent( QMouseEvent *e ) {
+  StageTimer timer( "mouse" );
+  if ( e->button() == MidButton ) {
+    panning = false;
+    return;
+  }
+  if ( !mousePressed ) return;
+  mousePressed = false;
+  if ( myActiveTool == none ) return;   // nothing drawn, nothing to keep
 
    // rubber-banding tools only:
   if ( myActiveTool != pen ) {
-     //draw over previous XOR drawing, cancelling it out
-    glLogicOp(GL_XOR);              // draw in XOR mode
-    drawWithActiveTool();
-     // draw the final drawing, for the current mouse location
-    glLogicOp(GL_COPY);  // switch back to drawing in COPY mode, the default
-    drawWithActiveTool();
+    myRedrawRect = myRedrawRect.united( previewRect() );
+    myPreview.clear();
+    drawIntoBuffer();
     updateGL();
+  } else {
+     // draw whatever of the stroke is still waiting for its frame
+    myFrameTimer->stop();
+    drawStroke();
   }
+  endChange();   // the stroke is one change
+}
+
+ /*
+ | Apply the given matrix of weights, of any size, to the image in the buffer.
+*/
+void Canvas::convoluteKernel(const ConvolutionKernel &kernel) {
+  CanvasFilter filter( filterKernel );
+  filter.kernel = kernel;
+  applyFilter( filter );
+}
 
-  mousePressed = false;
-  buffer=grabFrameBuffer();	// save image for resizing
 
+ /*
+ | Run the chain of filters over the image in the buffer, in one pass, with
+ | a single redraw.
+*/
+void Canvas::runChain(const FilterChain &chain) {
+  CanvasFilter filter( filterChain );
+  filter.chain = chain;
+  applyFilter( filter );
 }
 
+
  /*
  | Receive a mouse motion event
  | Store the new mouse location as the destination drawing point.
- | With the active tool, remove any previous XOR drawing and draw a new one.
+ | With the active tool, add to the pen's stroke, or move the preview.
+ | The pen's stroke is drawn a frame at a time, by drawStroke(), however many
+ | motion events arrive in between.
 */
 void Canvas::mouseMoveEvent( QMouseEvent *e ) {
+  StageTimer timer( "mouse" );
+  profileCount( "motion events" );
+
+  if ( panning ) {
+     // whole pixels of the image, so the moves which are less are kept
+    int level = viewLevel(), m = viewMagnification();
+    int dx = (e->x() - myPanX) / m * m, dy = (e->y() - myPanY) / m * m;
+    setView( myZoom, myViewX - dx * (1 << level) / m,
+                     myViewY - dy * (1 << level) / m );
+    myPanX += dx;
+    myPanY += dy;
+    updateGL();
+    return;
+  }
 
+  QPoint p = toImage( e->x(), e->y() );
   if ( mousePressed ) {  // drawing is currently occurring
     if ( myActiveTool == pen ) {
-      x1 = x2;
-      y1 = y2;
-      x2 = e->x();
-      y2 = height() - e->y();
-      drawWithActiveTool();
+      x2 = p.x();
+      y2 = buffer.height() - p.y();
+      int count = myStroke.size();
+      myStroke.resize(count+1);
+      myStroke.setPoint(count, x2, y2);
+      myMotionEvents++;
+      if ( !myFrameTimer->isActive() )
+        myFrameTimer->start(penFrameInterval, TRUE);
     } else {
-      glLogicOp(GL_XOR);      // draw in XOR mode
-       //draw over previous XOR drawing, cancelling it out
-      drawWithActiveTool();
-       //draw new XOR drawing, for the current mouse location
-      x2 = e->x();
-      y2 = height() - e->y();
-      drawWithActiveTool();
-      glLogicOp(GL_COPY);    // switch back to drawing in COPY mode, the default
+      x2 = p.x();
+      y2 = buffer.height() - p.y();
+      updatePreview();
+      updateGL();
     }
-    updateGL();
   }
 
 }
 
+ /*
+ | Draw the pen's stroke since the last frame into the buffer, in one batch,
+ | and keep its last point to carry the stroke on from.
+*/
+void Canvas::drawStroke() {
+  if ( myStroke.size() < 2 ) return;
+  drawIntoBuffer();
+  updateGL();
+  QPoint last = myStroke.point(myStroke.size()-1);
+  myStroke.resize(1);
+  myStroke.setPoint(0, last);
+
+  myStrokeFrames++;
+  profileCount( "pen frames" );
+  emit statsChanged( QString("pen: %1 motion events, %2 frames drawn")
+                     .arg(myMotionEvents).arg(myStrokeFrames) );
+}
+
 
  /* 
  | Initialize OpenGL settings.
@@ -233,19 +469,19 @@ void Canvas::initializeGL() {
 
   glEnable(GL_POINT_SMOOTH);       //use smooth, rounded points
   glShadeModel(GL_SMOOTH);         //set default shading model
-  glEnable(GL_COLOR_LOGIC_OP);     //enable color logic operations (ex: XOR)
   glPolygonMode(GL_FRONT,GL_FILL); //draw filled polygons, front only
 
   glClearColor( myBackgroundColor->red() / 255.0,
                 myBackgroundColor->green() / 255.0,
                 myBackgroundColor->blue() / 255.0, 1.0 );
   glClear(GL_COLOR_BUFFER_BIT);
-  buffer.fill( myBackgroundColor->pixel() );
   openPic=true;
 }
 
  /*
- | Resize this canvas to fit the current window size.
+ | Resize this canvas to fit the current window size.  The image keeps its
+ | size, and the canvas shows as much of it as fits at the zoom; the first
+ | time, the buffer is made, the size of the canvas if it is blank.
 */
 void Canvas::resizeGL( int w, int h ) {
   glClear(GL_COLOR_BUFFER_BIT);
@@ -254,47 +490,352 @@ void Canvas::resizeGL( int w, int h ) {
   glLoadIdentity();
   glOrtho(0, w, 0, h, -2, 2);
 
-  buffer = buffer.scale(w, h);	//stretch or shrink image
-  openPic = true;
+  if ( buffer.isNull() ) createBuffer( w, h );
+  setView( myZoom, myViewX, myViewY );
   updateGL();
 }
 
  /*
  | If the buffer has been changed, by opening a picture from a file or by 
- | a manipulation function, draw the pixels from the buffer into the screen.
+ | a manipulation function, or the view has moved, copy the part of the
+ | buffer in view into the textures, from the level of the pyramid for the
+ | zoom, and draw them into the screen.  If only a tool has drawn into it,
+ | copy and draw just the part it drew on.  Then draw the preview of the
+ | shape being dragged out over it.
 */
 void Canvas::paintGL( ) {
+  StageTimer timer( "paint" );
+  int level = viewLevel(), m = viewMagnification();
+  int originX = myViewX >> level, originY = myViewY >> level;
+  const TiledImage *image = &buffer;
+  const PointTable *table = tablePreview ? &myTablePreview : 0;
+  std::string error;
+
+  myPyramid.invalidate( myDirtyRect );
+   // the pixels of the level, y downwards, each m screen pixels wide
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glTranslatef(0, height(), 0);
+  glScalef(m, -m, 1);
+  glTranslatef(-originX, -originY, 0);
+
   if (openPic) {
-    QImage gl_buffer = convertToGLFormat(buffer);
-    glRasterPos2i(0,0);
-    glDrawPixels(buffer.width(), buffer.height(), GL_RGBA, 
-      GL_UNSIGNED_BYTE, gl_buffer.bits());
-    glFlush();
+    myTexture.resize((width() + m-1) / m, (height() + m-1) / m);
+    myTexture.setOrigin(originX, originY);
+    PixelRect shown(originX, originY, originX + myTexture.width(),
+                    originY + myTexture.height());
+    glClear(GL_COLOR_BUFFER_BIT);
+    image = myPyramid.level(level, shown, error);
+    if ( image ) {
+      myTexture.upload(*image, shown, table);
+      myTexture.draw(shown);
+    }
     openPic = false;
+  } else {
+    PixelRect shown(originX, originY, originX + myTexture.width(),
+                    originY + myTexture.height());
+    PixelRect dirty = MipPyramid::scaled(myDirtyRect, level)
+                        .intersected(shown);
+    if ( !dirty.isEmpty() ) {
+      image = myPyramid.level(level, dirty, error);
+      if ( image ) myTexture.upload(*image, dirty, table);
+    }
+    PixelRect redraw = myRedrawRect.united( myDirtyRect );
+    PixelRect screen = toScreen( redraw ).intersected(
+                                        PixelRect(0, 0, width(), height()) );
+    if ( !screen.isEmpty() ) {
+       // only the rectangle is drawn over, background beyond the image too
+      glEnable(GL_SCISSOR_TEST);
+      glScissor(screen.x0, height() - screen.y1,
+                screen.width(), screen.height());
+      glClear(GL_COLOR_BUFFER_BIT);
+      myTexture.draw( MipPyramid::scaled(redraw, level) );
+      glDisable(GL_SCISSOR_TEST);
+    }
   }
+  if ( !image )
+    qWarning( "%s", error.c_str() );
+  myDirtyRect = myRedrawRect = PixelRect();
+
+  if ( !myPreview.isEmpty() ) {
+     // the tools' coordinates, y upwards from the bottom of the buffer
+    float scale = (float)m / (1 << level);
+    glLoadIdentity();
+    glTranslatef(-myViewX * scale,
+                 height() - (buffer.height() - myViewY) * scale, 0);
+    glScalef(scale, scale, 1);
+    GLToolPainter screen(scale);
+    myPreview.replay(screen);
+  }
+  glFlush();
+}
+
+ /*
+ | Return the rectangle of the buffer the preview covers (some of which may
+ | be beyond the buffer).
+*/
+PixelRect Canvas::previewRect() const {
+  PixelRect b = myPreview.bounds();
+  return PixelRect(b.x0, buffer.height() - b.y1, b.x1, buffer.height() - b.y0);
 }
 
 
+/*-------------------------\
+|    The view             |
+\-------------------------*/
+
  /*
- | Draw with the active tool using this canvas's two points, x1,y1 and x2,y2.
+ | The level of the pyramid the view shows, and the screen pixels each of
+ | its pixels covers each way.
 */
-void Canvas::drawWithActiveTool() {
-  GLfloat drawingAngle;
-  GLfloat angle, angleL, angleM, xDist, yDist, xLen, yLen, hypLen, longHypLen, smallHypLen, smallXlen, smallYlen, radius;
+int Canvas::viewLevel() const
+ { return myZoom > 0 ? myZoom : 0; }
+
+int Canvas::viewMagnification() const
+ { return myZoom < 0 ? 1 << -myZoom : 1; }
+
+ /*
+ | Return the pixel of the buffer under the given point of the canvas, with
+ | y downwards from the top.
+*/
+QPoint Canvas::toImage(int x, int y) const {
+  int level = viewLevel(), m = viewMagnification();
+  return QPoint( myViewX + x * (1 << level) / m,
+                 myViewY + y * (1 << level) / m );
+}
+
+ /*
+ | Return the rectangle of the canvas, y downwards, which shows the given
+ | rectangle of the buffer.
+*/
+PixelRect Canvas::toScreen(const PixelRect &rect) const {
+  int level = viewLevel(), m = viewMagnification();
+  PixelRect r = MipPyramid::scaled( rect, level );
+  if ( r.isEmpty() ) return r;
+  int originX = myViewX >> level, originY = myViewY >> level;
+  return PixelRect( (r.x0 - originX) * m, (r.y0 - originY) * m,
+                    (r.x1 - originX) * m, (r.y1 - originY) * m );
+}
+
+ /*
+ | Set the zoom, and the pixel of the buffer at the top-left of the canvas,
+ | keeping as much of the buffer in view as there is room for, and mark the
+ | canvas to be drawn again.  Zoomed out, the view starts on a pixel of the
+ | level it shows.
+*/
+void Canvas::setView(int zoom, int x, int y) {
+  if ( zoom < -maxZoomIn ) zoom = -maxZoomIn;
+  if ( zoom > myPyramid.levels()-1 ) zoom = myPyramid.levels()-1;
+  myZoom = zoom;
+
+  int level = viewLevel(), m = viewMagnification();
+  int maxX = buffer.width()  - (width()  << level) / m;
+  int maxY = buffer.height() - (height() << level) / m;
+  myViewX = x < maxX ? x : maxX;
+  myViewY = y < maxY ? y : maxY;
+  if ( myViewX < 0 ) myViewX = 0;
+  if ( myViewY < 0 ) myViewY = 0;
+  myViewX = myViewX >> level << level;
+  myViewY = myViewY >> level << level;
+  openPic = true;
+}
+
+ /*
+ | Zoom keeping the pixel of the buffer under the given point of the canvas
+ | where it is, as near as the new zoom allows.
+*/
+void Canvas::zoomAbout(int zoom, int x, int y) {
+  QPoint p = toImage( x, y );
+  if ( zoom < -maxZoomIn ) zoom = -maxZoomIn;
+  if ( zoom > myPyramid.levels()-1 ) zoom = myPyramid.levels()-1;
+  int level = zoom > 0 ? zoom : 0, m = zoom < 0 ? 1 << -zoom : 1;
+  setView( zoom, p.x() - (x << level) / m, p.y() - (y << level) / m );
+  updateGL();
+}
+
+void Canvas::zoomIn()
+ { zoomAbout( myZoom-1, width()/2, height()/2 ); }
+
+void Canvas::zoomOut()
+ { zoomAbout( myZoom+1, width()/2, height()/2 ); }
+
+void Canvas::zoomActual()
+ { zoomAbout( 0, width()/2, height()/2 ); }
+
+ /*
+ | The table is applied as the view is copied into the textures, so only
+ | the pixels on screen are looked up, and the buffer is left alone.
+*/
+void Canvas::previewTable( const PointTable &table ) {
+  myTablePreview = table;
+  tablePreview = true;
+  openPic = true;
+  updateGL();
+}
+
+void Canvas::endTablePreview() {
+  if ( !tablePreview ) return;
+  tablePreview = false;
+  openPic = true;
+  updateGL();
+}
+
+ /*
+ | Zoom in or out a step for each notch of the mouse wheel, about the
+ | pointer.
+*/
+void Canvas::wheelEvent( QWheelEvent *e ) {
+  int steps = e->delta() / 120;
+  if ( steps == 0 ) steps = e->delta() > 0 ? 1 : -1;
+  zoomAbout( myZoom - steps, e->x(), e->y() );
+}
+
+ /*
+ | Record the active tool's drawing for the current points as the preview,
+ | to be drawn over the buffer until the mouse is released, and mark the
+ | rectangles the old and new previews cover to be drawn again.  Only the
+ | rubber-banding tools have a preview.
+*/
+void Canvas::updatePreview() {
+  if ( myActiveTool == none || myActiveTool == pen ) return;
+  myRedrawRect = myRedrawRect.united( previewRect() );
+  myPreview.clear();
+  drawWithActiveTool(myPreview);
+  myRedrawRect = myRedrawRect.united( previewRect() );
+}
+
+ /*
+ | Draw with the active tool into the buffer, and mark the part of the
+ | buffer it drew on to be copied to the screen by the next paintGL.
+*/
+void Canvas::drawIntoBuffer() {
+  StageTimer timer( "tool" );
+  ToolStroke stroke = activeStroke();
+  ImageToolPainter painter( buffer, &myHistory );
+  drawToolStroke( painter, stroke );
+   // a stroke which drew nothing replays as nothing, so is not kept
+  if ( myJournal && !painter.changed().isEmpty() )
+    myJournal->recordStroke( stroke );
+  myDirtyRect = myDirtyRect.united( painter.changed() );
+}
+
+
+ /*
+ | The points of a circle of radius 1, cut into the given number of segments,
+ | going round from angle 0, with the first point again at the end.  Each
+ | number of segments' table is made the first time it is asked for, and
+ | kept, so the circle tools do no trigonometry as they are dragged.
+*/
+struct UnitCircle {
+  std::vector<GLfloat> cosine, sine;
+};
+
+static const UnitCircle &unitCircle( int segments ) {
+  static std::map<int, UnitCircle> tables;
+  UnitCircle &table = tables[segments];
+  if ( table.cosine.empty() ) {
+    table.cosine.resize( segments+1 );
+    table.sine.resize( segments+1 );
+    for ( int i = 0; i < segments; i++ ) {
+      table.cosine[i] = cos( i * twoPI / segments );
+      table.sine[i]   = sin( i * twoPI / segments );
+    }
+    table.cosine[segments] = table.cosine[0];
+    table.sine[segments]   = table.sine[0];
+  }
+  return table;
+}
+
+ /*
+ | The number of segments for a circle of the given radius in pixels: the
+ | fewest, of the powers of two in range, whose chords stray no more than
+ | toolCircleTolerance from the true circle.  A chord across an angle a
+ | strays about radius*a*a/8.
+*/
+static int circleSegments( GLfloat radius ) {
+  GLfloat needed = PI * sqrt( radius / (2 * toolCircleTolerance) );
+  int segments = toolCircleMinSegments;
+  while ( segments < needed && segments < toolCircleMaxSegments )
+    segments *= 2;
+  return segments;
+}
+
+ /*
+ | A circle about x1,y1 through x2,y2, its first point at x2,y2: the unit
+ | circle turned by the direction from the centre and scaled by the radius,
+ | which x2-x1, y2-y1 give without any angle being worked out.  The number
+ | of segments suits the larger of its radius in the buffer and on the
+ | screen, at the given magnification.
+*/
+struct CircleGeometry {
+  CircleGeometry( int x1, int y1, int x2, int y2, int magnification );
+
+  GLfloat x( int i ) const
+   { return cx + unit.cosine[i] * rx - unit.sine[i] * ry; }
+  GLfloat y( int i ) const
+   { return cy + unit.sine[i] * rx + unit.cosine[i] * ry; }
+
+  int               segments;
+  const UnitCircle &unit;
+  GLfloat           cx, cy, rx, ry;    // the centre, and the radius's vector
+};
+
+CircleGeometry::CircleGeometry( int x1, int y1, int x2, int y2,
+                                int magnification )
+ : segments( circleSegments( magnification *
+                             sqrt( (GLfloat)(x2-x1)*(x2-x1) +
+                                   (GLfloat)(y2-y1)*(y2-y1) ) ) ),
+   unit( unitCircle( segments ) ),
+   cx( x1 ), cy( y1 ), rx( x2-x1 ), ry( y2-y1 ) {}
+
+
+ /*
+ | The active tool's stroke, from this canvas's two points, x1,y1 and x2,y2,
+ | or the pen's points, and its settings.
+*/
+ToolStroke Canvas::activeStroke() const {
+  ToolStroke stroke;
+  stroke.tool           = (CanvasTool)myActiveTool;
+  stroke.x1             = x1;
+  stroke.y1             = y1;
+  stroke.x2             = x2;
+  stroke.y2             = y2;
+  stroke.points         = myStroke.copy();
+  stroke.penColor       = *myPenColor;
+  stroke.fillColor      = *myFillColor;
+  stroke.brushSize      = myBrushSize;
+  stroke.gradientDegree = myGradientDegree;
+  stroke.magnification  = viewMagnification();
+  return stroke;
+}
+
+ /*
+ | Draw with the active tool with the given painter: into the screen, or
+ | into the buffer.
+*/
+void Canvas::drawWithActiveTool(ToolPainter &painter)
+ { drawToolStroke( painter, activeStroke() ); }
+
+ /*
+ | Draw the stroke with the given painter.
+*/
+void drawToolStroke(ToolPainter &painter, const ToolStroke &stroke) {
+  int x1 = stroke.x1, y1 = stroke.y1, x2 = stroke.x2, y2 = stroke.y2;
+  const QPointArray &points = stroke.points;
+  GLfloat angle, angleL, angleM, xDist, yDist, hypLen, longHypLen, smallHypLen, smallXlen, smallYlen;
 //          minVC
   GLint   minPointSize = 1;
 //  int     height, width;
-  bool    halfwayColorSet;
   color3 penColor,  penColorDark,  penColorLight, 
          fillColor, fillColorDark, fillColorLight,
          vertexColor;
 //         firstColor, secondColor
 
   //switch from QT colors to openGL colors, 0...255  to  0.0...1.0
-  GLfloat gradientDegree = myGradientDegree / 255.0;
-  penColor[0] = myPenColor->red()   / 255.0;
-  penColor[1] = myPenColor->green() / 255.0;
-  penColor[2] = myPenColor->blue()  / 255.0;
+  GLfloat gradientDegree = stroke.gradientDegree / 255.0;
+  penColor[0] = stroke.penColor.red()   / 255.0;
+  penColor[1] = stroke.penColor.green() / 255.0;
+  penColor[2] = stroke.penColor.blue()  / 255.0;
   for ( int i = 0; i < 3; i++ ) {
     penColorLight[i] = penColor[i];
     penColorDark[i]  = penColor[i];
@@ -305,9 +846,9 @@ void Canvas::drawWithActiveTool() {
     if  (penColorDark[i]   - gradientDegree < 0) penColorDark[i]  = 0; //min: black
     else penColorDark[i]  -= gradientDegree;
   }
-  fillColor[0] = myFillColor->red()   / 255.0;
-  fillColor[1] = myFillColor->green() / 255.0;
-  fillColor[2] = myFillColor->blue()  / 255.0;
+  fillColor[0] = stroke.fillColor.red()   / 255.0;
+  fillColor[1] = stroke.fillColor.green() / 255.0;
+  fillColor[2] = stroke.fillColor.blue()  / 255.0;
   for ( int i = 0; i < 3; i++ ) {
     fillColorLight[i] = fillColor[i];
     fillColorDark[i]  = fillColor[i];
@@ -319,86 +860,88 @@ void Canvas::drawWithActiveTool() {
     else fillColorDark[i]  -= gradientDegree;
   } 
 
-  // use my brush size for points and lines
-  glPointSize(myBrushSize);
-  glLineWidth(myBrushSize);
+  // use the brush size for points and lines
+  int brushSize = stroke.brushSize;
+  painter.pointSize(brushSize);
+  painter.lineWidth(brushSize);
 
-  switch(myActiveTool) {
+  switch(stroke.tool) {
     case none    :
       break;
     case pen     :
-     // A point on point1 and point2, with a line between, without any gradient.
-      glPointSize(myBrushSize*0.5);
-      glColor3fv(penColor);
-      if (myBrushSize > minPointSize) {
-        glBegin(GL_POINTS);
-          glVertex2f(x1,y1);
-          glVertex2f(x2,y2);
-        glEnd();
+     // A point on each point of the stroke, with lines between, without any
+     // gradient.
+      painter.pointSize(brushSize*0.5);
+      painter.color3fv(penColor);
+      if (brushSize > minPointSize) {
+        painter.begin(GL_POINTS);
+          for (unsigned i = 0; i < points.size(); i++)
+            painter.vertex2f(points[i].x(), points[i].y());
+        painter.end();
       }
-      glBegin(GL_LINES);
-        glVertex2f(x1,y1);
-        glVertex2f(x2,y2);
-      glEnd();
-      glPointSize(myBrushSize);
+      painter.begin(GL_LINE_STRIP);
+        for (unsigned i = 0; i < points.size(); i++)
+          painter.vertex2f(points[i].x(), points[i].y());
+      painter.end();
+      painter.pointSize(brushSize);
       break;
     case line      :
      // A point on point1 and point2, with a line between.
-      glPointSize(myBrushSize*0.6);
-      if (myBrushSize > minPointSize) {
-        glBegin(GL_POINTS);
-          glColor3fv(penColorLight);
-          glVertex2f(x1,y1);
-        glEnd();
+      painter.pointSize(brushSize*0.6);
+      if (brushSize > minPointSize) {
+        painter.begin(GL_POINTS);
+          painter.color3fv(penColorLight);
+          painter.vertex2f(x1,y1);
+        painter.end();
       }
-      glBegin(GL_LINES);
-        glVertex2f(x1,y1);
-        glColor3fv(penColorDark);
-        glVertex2f(x2,y2);
-      glEnd();
-      if (myBrushSize > minPointSize) {
-        glBegin(GL_POINTS);
-          glVertex2f(x2,y2);
-        glEnd();
+      painter.begin(GL_LINES);
+        painter.vertex2f(x1,y1);
+        painter.color3fv(penColorDark);
+        painter.vertex2f(x2,y2);
+      painter.end();
+      if (brushSize > minPointSize) {
+        painter.begin(GL_POINTS);
+          painter.vertex2f(x2,y2);
+        painter.end();
       }
-      glPointSize(myBrushSize);
+      painter.pointSize(brushSize);
       break;
     case rectangle :
      // A pen rectangle from point1 to point2, 
      // with points on its corners to smooth them out.
-      glDisable(GL_POINT_SMOOTH);       //use square points
-      if (myBrushSize > minPointSize) {
-        glBegin(GL_POINTS);
-          glColor3fv(penColorLight);
-          glVertex2f(x1,y1);
-          glColor3fv(penColor);
-          glVertex2f(x2,y1);
-          glColor3fv(penColorDark);
-          glVertex2f(x2,y2);
-          glColor3fv(penColor);
-          glVertex2f(x1,y2);
-        glEnd();
+      painter.pointSmooth(false);       //use square points
+      if (brushSize > minPointSize) {
+        painter.begin(GL_POINTS);
+          painter.color3fv(penColorLight);
+          painter.vertex2f(x1,y1);
+          painter.color3fv(penColor);
+          painter.vertex2f(x2,y1);
+          painter.color3fv(penColorDark);
+          painter.vertex2f(x2,y2);
+          painter.color3fv(penColor);
+          painter.vertex2f(x1,y2);
+        painter.end();
       }
-      glBegin(GL_LINE_STRIP);
-        glColor3fv(penColorLight);
-        glVertex2f(x1,y1);
-        glColor3fv(penColor);
-        glVertex2f(x2,y1);
-        glColor3fv(penColorDark);
-        glVertex2f(x2,y2);
-        glColor3fv(penColor);
-        glVertex2f(x1,y2);
-        glColor3fv(penColorLight);
-        glVertex2f(x1,y1);
-      glEnd();
-      glEnable(GL_POINT_SMOOTH);       //use smooth, rounded points
+      painter.begin(GL_LINE_STRIP);
+        painter.color3fv(penColorLight);
+        painter.vertex2f(x1,y1);
+        painter.color3fv(penColor);
+        painter.vertex2f(x2,y1);
+        painter.color3fv(penColorDark);
+        painter.vertex2f(x2,y2);
+        painter.color3fv(penColor);
+        painter.vertex2f(x1,y2);
+        painter.color3fv(penColorLight);
+        painter.vertex2f(x1,y1);
+      painter.end();
+      painter.pointSmooth(true);      //use smooth, rounded points
       break;
     case rectangleFilled :
      // A filled rectangle from point1 to point2, 
      // a pen rectangle from point1 to point2, 
      // and points on its corners to smooth them out.
-      glDisable(GL_POINT_SMOOTH);       //use square points
-      glBegin(GL_POLYGON);
+      painter.pointSmooth(false);       //use square points
+      painter.begin(GL_POLYGON);
 /*
         width  = x1 - x2;
         height = y1 - y2;
@@ -414,12 +957,12 @@ void Canvas::drawWithActiveTool() {
               secondColor[i] = fillColorLight[i];
             }
           }
-          glColor3fv(firstColor);
-          glVertex2f(x1,y1);
-          glVertex2f(x2,y1);
-          glColor3fv(secondColor);
-          glVertex2f(x2,y2);
-          glVertex2f(x1,y2);
+          painter.color3fv(firstColor);
+          painter.vertex2f(x1,y1);
+          painter.vertex2f(x2,y1);
+          painter.color3fv(secondColor);
+          painter.vertex2f(x2,y2);
+          painter.vertex2f(x1,y2);
         } else {
           if ( height > 0 ) {
             for (int i = 0; i < 3; i++) {
@@ -432,146 +975,87 @@ void Canvas::drawWithActiveTool() {
               secondColor[i] = fillColorLight[i];
             }
           }
-          glColor3fv(secondColor);
-          glVertex2f(x1,y1);
-          glColor3fv(firstColor);
-          glVertex2f(x2,y1);
-          glVertex2f(x2,y2);
-          glColor3fv(secondColor);
-          glVertex2f(x1,y2);
+          painter.color3fv(secondColor);
+          painter.vertex2f(x1,y1);
+          painter.color3fv(firstColor);
+          painter.vertex2f(x2,y1);
+          painter.vertex2f(x2,y2);
+          painter.color3fv(secondColor);
+          painter.vertex2f(x1,y2);
         }
 */
-        glColor3fv(fillColorLight);
-        glVertex2f(x1,y1);
-        glColor3fv(fillColor);
-        glVertex2f(x2,y1);
-        glColor3fv(fillColorDark);
-        glVertex2f(x2,y2);
-        glColor3fv(fillColor);
-        glVertex2f(x1,y2);
-      glEnd();
-      glColor3fv(penColor);
-      if (myBrushSize > minPointSize) {
-        glBegin(GL_POINTS);
-          glColor3fv(penColorLight);
-          glVertex2f(x1,y1);
-          glColor3fv(penColor);
-          glVertex2f(x2,y1);
-          glColor3fv(penColorDark);
-          glVertex2f(x2,y2);
-          glColor3fv(penColor);
-          glVertex2f(x1,y2);
-        glEnd();
+        painter.color3fv(fillColorLight);
+        painter.vertex2f(x1,y1);
+        painter.color3fv(fillColor);
+        painter.vertex2f(x2,y1);
+        painter.color3fv(fillColorDark);
+        painter.vertex2f(x2,y2);
+        painter.color3fv(fillColor);
+        painter.vertex2f(x1,y2);
+      painter.end();
+      painter.color3fv(penColor);
+      if (brushSize > minPointSize) {
+        painter.begin(GL_POINTS);
+          painter.color3fv(penColorLight);
+          painter.vertex2f(x1,y1);
+          painter.color3fv(penColor);
+          painter.vertex2f(x2,y1);
+          painter.color3fv(penColorDark);
+          painter.vertex2f(x2,y2);
+          painter.color3fv(penColor);
+          painter.vertex2f(x1,y2);
+        painter.end();
       }
-      glBegin(GL_LINE_STRIP);
-        glColor3fv(penColorLight);
-        glVertex2f(x1,y1);
-        glColor3fv(penColor);
-        glVertex2f(x2,y1);
-        glColor3fv(penColorDark);
-        glVertex2f(x2,y2);
-        glColor3fv(penColor);
-        glVertex2f(x1,y2);
-        glColor3fv(penColorLight);
-        glVertex2f(x1,y1);
-      glEnd();
-      glEnable(GL_POINT_SMOOTH);       //use smooth, rounded points
+      painter.begin(GL_LINE_STRIP);
+        painter.color3fv(penColorLight);
+        painter.vertex2f(x1,y1);
+        painter.color3fv(penColor);
+        painter.vertex2f(x2,y1);
+        painter.color3fv(penColorDark);
+        painter.vertex2f(x2,y2);
+        painter.color3fv(penColor);
+        painter.vertex2f(x1,y2);
+        painter.color3fv(penColorLight);
+        painter.vertex2f(x1,y1);
+      painter.end();
+      painter.pointSmooth(true);      //use smooth, rounded points
       break;
     case circle :
      // A circle with its centre on point1, and its radius out to point2
-      xLen = fabs(fabs(x1)-fabs(x2));
-      yLen = fabs(fabs(y1)-fabs(y2));
-      radius = sqrt( xLen*xLen + yLen*yLen );
-      if (xLen == 0) xLen = 0.0001;          // avoid dividing by zero
-      drawingAngle = atan ( yLen / xLen );  // angle from point1 to point2
-      if ( y2 > y1 ) {
-        if ( x2 < x1 ) drawingAngle  = PI - drawingAngle;    //flip   into quad2
-      } else {
-        if ( x2 > x1 ) drawingAngle  = twoPI - drawingAngle; //flip   into quad4
-        else           drawingAngle += PI;                   //rotate into quad3
+      {
+        CircleGeometry c( x1, y1, x2, y2, stroke.magnification );
+        painter.begin(GL_LINE_STRIP);
+          for ( int i = 0; i <= c.segments; i++ ) {
+            painter.color3f( penColor[0] - gradientDegree * c.unit.cosine[i],
+                             penColor[1] - gradientDegree * c.unit.cosine[i],
+                             penColor[2] - gradientDegree * c.unit.cosine[i] );
+            painter.vertex2f( c.x(i), c.y(i) );
+          }
+        painter.end();
       }
-      glBegin(GL_LINE_STRIP);
-        for ( angle  = 0; angle  < twoPI + PI / toolCirclePointsPerPI; 
-              angle += PI / toolCirclePointsPerPI ) {
-          glColor3f( penColor[0] - gradientDegree * cos(angle),
-                     penColor[1] - gradientDegree * cos(angle),
-                     penColor[2] - gradientDegree * cos(angle) );
-          glVertex2f( x1 + radius * cos(angle+drawingAngle),
-                      y1 + radius * sin(angle+drawingAngle));
-        }
-      glEnd();
       break;
     case circleFilled :
      // A filled circle with its centre on point1, and its radius out to point2,
      // and a pen circle with its centre on point1 and its radius out to point2.
-      xLen = fabs(fabs(x1)-fabs(x2));
-      yLen = fabs(fabs(y1)-fabs(y2));
-      radius = sqrt( xLen*xLen + yLen*yLen );
-      if (xLen == 0) xLen = 0.0001;          // avoid dividing by zero
-      drawingAngle = atan ( yLen / xLen );  // angle from point1 to point2
-      if ( y2 > y1 ) {
-        if ( x2 < x1 ) drawingAngle  = PI - drawingAngle;    //flip   into quad2
-      } else {
-        if ( x2 > x1 ) drawingAngle  = twoPI - drawingAngle; //flip   into quad4
-        else           drawingAngle += PI;                   //rotate into quad3
-      }
-      glBegin(GL_POLYGON);
-        halfwayColorSet = false;
-//        glColor3f( fillColorLight[0], fillColorLight[1], fillColorLight[2] );
-        for ( angle  = 0; angle < twoPI + PI / toolCirclePointsPerPI; 
-              angle += PI / toolCirclePointsPerPI ) {
-          for (int i = 0; i < 3; i++) {
-            vertexColor[i] = fillColor[i] + gradientDegree * cos(angle);
+      {
+        CircleGeometry c( x1, y1, x2, y2, stroke.magnification );
+        painter.begin(GL_POLYGON);
+          for ( int i = 0; i <= c.segments; i++ ) {
+            for (int j = 0; j < 3; j++)
+              vertexColor[j] = fillColor[j] + gradientDegree * c.unit.cosine[i];
+            painter.color3f( vertexColor[0], vertexColor[1], vertexColor[2] );
+            painter.vertex2f( c.x(i), c.y(i) );
           }
-/*
-          minVC = 0.0;
-          for (int i = 0; i < 3; i++) {
-            if ( vertexColor[i] < minVC ) minVC = vertexColor[i];
+        painter.end();
+        painter.begin(GL_LINE_STRIP);
+          for ( int i = 0; i <= c.segments; i++ ) {
+            for (int j = 0; j < 3; j++)
+              vertexColor[j] = penColor[j] - gradientDegree * c.unit.cosine[i];
+            painter.color3f( vertexColor[0], vertexColor[1], vertexColor[2] );
+            painter.vertex2f( c.x(i), c.y(i) );
           }
-          if ( minVC < 0.0 ) {
-            for (int i = 0; i < 3; i++) {
-              vertexColor[i] += ( minVC + 0.1 );
-            }
-          }
-*/
-          //if ( angle == 0 ) {
-          //} else 
-//          if ( ! halfwayColorSet && angle >= PI ) {
-//            glColor3f( fillColorDark[0],  fillColorDark[1],  fillColorDark[2]  );
-//            halfwayColorSet = true;
-//          }
-          //glColor3f( fillColor[0] + 0.5 - gradientDegree * cos(angle),
-          //           fillColor[1] + 0.5 - gradientDegree * cos(angle),
-          //           fillColor[2] + 0.5 - gradientDegree * cos(angle) );
-          glColor3f( vertexColor[0], vertexColor[1], vertexColor[2] );
-          glVertex2f( x1 + radius * cos(angle+drawingAngle), 
-                      y1 + radius * sin(angle+drawingAngle)); 
-        }
- //       glColor3f( fillColorDark[0],  fillColorDark[1],  fillColorDark[2]  );
-      glEnd();
-      glBegin(GL_LINE_STRIP);
-        for ( angle  = 0; angle < twoPI + PI / toolCirclePointsPerPI; 
-              angle += PI / toolCirclePointsPerPI ) {
-          for (int i = 0; i < 3; i++) {
-            vertexColor[i] = penColor[i] - gradientDegree * cos(angle);
-          }
-          //minVC = 0.0;
-          //for (int i = 0; i < 3; i++) {
-          //  if ( vertexColor[i] < minVC ) minVC = vertexColor[i];
-          //}
-          //if ( minVC < 0.0 ) {
-          //  for (int i = 0; i < 3; i++) {
-          //    vertexColor[i] += ( minVC + 0.1 );
-          //  }
-          //}
-          glColor3f( vertexColor[0], vertexColor[1], vertexColor[2] );
-                    // penColor[0] - gradientDegree * cos(angle),
-                    // penColor[1] - gradientDegree * cos(angle),
-                    // penColor[2] - gradientDegree * cos(angle) );
-          glVertex2f( x1 + radius * cos(angle+drawingAngle),
-                      y1 + radius * sin(angle+drawingAngle));
-        }
-      glEnd();
+        painter.end();
+      }
       break;
     case triangle :
      // A pen triangle from point1 to point2, attempting to be equilateral,
@@ -588,27 +1072,27 @@ void Canvas::drawWithActiveTool() {
         smallXlen  = smallHypLen * cos( angleM );  // adjacentLen
         smallYlen  = smallHypLen * sin( angleM );  // oppositeLen
 
-        glColor3fv(penColor);
-        glBegin(GL_LINE_STRIP);
-          glColor3fv(penColorDark);
-          glVertex2f( x2, y2 );
-          glColor3fv(penColorLight);
+        painter.color3fv(penColor);
+        painter.begin(GL_LINE_STRIP);
+          painter.color3fv(penColorDark);
+          painter.vertex2f( x2, y2 );
+          painter.color3fv(penColorLight);
           if        ( y2 <= y1 && x2 >= x1) {          // upper right
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           } else if ( y2 <= y1 && x2 <  x1) {          // upper left
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else if ( y2 >  y1 && x2 >= x1) {          // lower right
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else                       {               // lower left
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           }
-          glColor3fv(penColorDark);
-          glVertex2f( x2, y2 );
-        glEnd();
+          painter.color3fv(penColorDark);
+          painter.vertex2f( x2, y2 );
+        painter.end();
       }
       break;
     case triangleFilled :
@@ -627,46 +1111,46 @@ void Canvas::drawWithActiveTool() {
         smallXlen  = smallHypLen * cos( angleM );  // adjacentLen
         smallYlen  = smallHypLen * sin( angleM );  // oppositeLen
 
-        glColor3fv(fillColor);
-        glBegin(GL_POLYGON);
-          glColor3fv(fillColorLight);
-          glVertex2f( x2, y2 );
-          glColor3fv(fillColorDark);
+        painter.color3fv(fillColor);
+        painter.begin(GL_POLYGON);
+          painter.color3fv(fillColorLight);
+          painter.vertex2f( x2, y2 );
+          painter.color3fv(fillColorDark);
           if        ( y2 <= y1 && x2 >= x1) {          // upper right
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           } else if ( y2 <= y1 && x2 <  x1) {          // upper left
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else if ( y2 >  y1 && x2 >= x1) {          // lower right
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else                       {               // lower left
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           }
-        glEnd();
-        glColor3fv(penColor);
-        glBegin(GL_LINE_STRIP);
-          glColor3fv(penColorDark);
-          glVertex2f( x2, y2 );
-          glColor3fv(penColorLight);
+        painter.end();
+        painter.color3fv(penColor);
+        painter.begin(GL_LINE_STRIP);
+          painter.color3fv(penColorDark);
+          painter.vertex2f( x2, y2 );
+          painter.color3fv(penColorLight);
           if        ( y2 <= y1 && x2 >= x1) {          // upper right
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           } else if ( y2 <= y1 && x2 <  x1) {          // upper left
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else if ( y2 >  y1 && x2 >= x1) {          // lower right
-            glVertex2f( x1-smallXlen, y1+smallYlen  );
-            glVertex2f( x1+smallXlen, y1-smallYlen );
+            painter.vertex2f( x1-smallXlen, y1+smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1-smallYlen );
           } else                       {               // lower left
-            glVertex2f( x1-smallXlen, y1-smallYlen  );
-            glVertex2f( x1+smallXlen, y1+smallYlen );
+            painter.vertex2f( x1-smallXlen, y1-smallYlen  );
+            painter.vertex2f( x1+smallXlen, y1+smallYlen );
           }
-          glColor3fv(penColorDark);
-          glVertex2f( x2, y2 );
-        glEnd();
+          painter.color3fv(penColorDark);
+          painter.vertex2f( x2, y2 );
+        painter.end();
       }
       break;
   }
@@ -674,6 +1158,171 @@ void Canvas::drawWithActiveTool() {
 
 
 
+/*============================================\
+|    Image manipulation kernels (no OpenGL)   |
+\============================================*/
+
+ /*
+ | Return a view of the pixels of the image for the imageOps kernels,
+ | converting the image to 32 bits per pixel first if need be.
+*/
+ImageRows imageRows(QImage &image) {
+  if ( image.depth() != 32 ) image = image.convertDepth( 32 );
+  return ImageRows( (uint32_t*)image.bits(), image.width(), image.height(),
+                    image.bytesPerLine() / sizeof(uint32_t) );
+}
+
+ /*
+ | Open the image file into image.  An SBM's tiles are mapped or expanded
+ | straight into image; a PNG is read a row at a time into the tiles, so it
+ | may be larger than the memory; other formats (and interlaced PNGs) are
+ | decoded whole first.
+*/
+bool loadImage(const QString &filename, TiledImage &image, std::string &error,
+               std::string *settings) {
+  if ( isTileFile( filename.local8Bit() ) ) {
+    std::string kept;
+    return readTileFile( filename.local8Bit(), image,
+                         settings ? *settings : kept, error );
+  }
+
+  PngReader reader;
+  if ( reader.open( filename.local8Bit(), error ) ) {
+    if ( !image.create( reader.width(), reader.height(), error ) )
+      return false;
+    TiledRowSink sink( image );
+    return reader.readInto( sink, error );
+  }
+
+  QImage whole;
+  if ( !whole.load( filename ) ) {
+    error = "cannot read the image";
+    return false;
+  }
+  whole = whole.convertDepth( 32 );
+  if ( !image.create( whole.width(), whole.height(), error ) ) return false;
+  image.write( image.rect(), imageRows(whole) );
+  return true;
+}
+
+ /*
+ | Save the image to a file in the format.  An SBM is written a tile at a
+ | time, and a PNG a row at a time, from the tiles; other formats are put
+ | together whole in memory to be written.
+*/
+bool saveImage(const TiledImage &image, const QString &filename,
+               const QString &format, std::string &error,
+               const std::string &settings) {
+  if ( format.upper() == "SBM" )
+    return writeTileFile( image, filename.local8Bit(), settings, true, error );
+
+  if ( format.upper() == "PNG" ) {
+    PngWriter writer;
+    std::vector<uint32_t> row( image.width() );
+    if ( !writer.open( filename.local8Bit(), image.width(), image.height(),
+                       false, error ) )
+      return false;
+    for ( int y = 0; y < image.height(); y++ ) {
+      image.read( PixelRect( 0, y, image.width(), y+1 ),
+                  ImageRows( &row[0], image.width(), 1, 0 ) );
+      writer.putRow( &row[0] );
+    }
+    return writer.finish( error );
+  }
+
+  QImage whole( image.width(), image.height(), 32 );
+  image.read( image.rect(), imageRows(whole) );
+  if ( !whole.save( filename, format.upper() ) ) {
+    error = "cannot write the image";
+    return false;
+  }
+  return true;
+}
+
+ /*
+ | Apply the given convolution matrix to the image.  The matrix reads from an
+ | unmodified copy of the image while the result is written.
+*/
+void convoluteImage(QImage &image, const convolutionType type,
+                    const convolutionEngine engine) {
+  QImage source = image.copy();
+  imageConvolute( imageRows(source), imageRows(image), type, engine );
+}
+
+ /*
+ | Invert the colors in the image.
+*/
+void invertImage(QImage &image) {
+  imageInvert( imageRows(image) );
+}
+
+ /*
+ | Fade the colors in the image towards white.
+*/
+void fadeImage(QImage &image, const int fadeDegree) {
+  imageFade( imageRows(image), fadeDegree );
+}
+
+ /*
+ | Intensify the colors in the image towards black.
+*/
+void intensifyImage(QImage &image, const int fadeDegree) {
+  imageIntensify( imageRows(image), fadeDegree );
+}
+
+ /*
+ | Blur the image with a box of the given radius, passes times over.
+*/
+void boxBlurImage(QImage &image, const int radius, const int passes) {
+  ImageRows rows = imageRows(image);
+  imageBoxBlur( rows, rows, radius, passes );
+}
+ /*
+ | Apply the given matrix of weights, of any size, to the image, in the given
+ | way (by default the quickest for the size of the matrix).
+*/
+void convoluteKernelImage(QImage &image, const ConvolutionKernel &kernel,
+                          const kernelMethod method) {
+  QImage source = image.copy();
+  imageConvoluteKernel( imageRows(source), imageRows(image), kernel.matrix(),
+                        kernel.size, method );
+}
+ /*
+ | Run the chain of filters over the image, a tile at a time.
+*/
+void runChainImage(QImage &image, const FilterChain &chain,
+                   const convolutionEngine engine) {
+  QImage source = image.copy();
+  chain.run( imageRows(source), imageRows(image), engine );
+}
+
+ /*
+ | The filter as the Canvas runs it.  A box blur's radius is scaled with the
+ | image; the 3x3 matrices and the kernels work on pixels as they are.
+*/
+TileFilter *CanvasFilter::tileFilter(double scale) const {
+  switch ( kind ) {
+    case filterConvolute :
+      return new ConvoluteTileFilter( (convolutionType)value, engineSimd );
+    case filterBoxBlur : {
+      int radius = (int)( value * scale + 0.5 );
+      return new BoxBlurTileFilter( radius < 1 ? 1 : radius, 1 );
+    }
+    case filterFade :
+      return new PointTileFilter( fadeTable(value) );
+    case filterIntensify :
+      return new PointTileFilter( intensifyTable(value) );
+    case filterKernel :
+      return new KernelTileFilter( kernel, methodAuto );
+    case filterChain :
+      return new ChainTileFilter( chain, engineSimd );
+    case filterInvert :
+    default :
+      return new PointTileFilter( invertTable() );
+  }
+}
+
+
 /*============================================\
 |    General (non-OpenGL) widget stuff        |
 \============================================*/
@@ -691,6 +1340,16 @@ splatterBoardManip::splatterBoardManip( QWidget *parent, const char *name )
 
   canvas = new Canvas( this );
   setCentralWidget( canvas );
+  connect( canvas, SIGNAL( statsChanged(const QString&) ),
+           statusBar(), SLOT( message(const QString&) ) );
+
+  myTracing = profileEnabled();
+  lTimings = new QLabel( statusBar() );
+  statusBar()->addWidget( lTimings, 0, TRUE );
+  lTimings->hide();
+  myTimingsTimer = new QTimer( this );
+  connect( myTimingsTimer, SIGNAL( timeout() ),
+           this, SLOT( slotUpdateTimings() ) );
 
 
   // make some toolbars
@@ -806,11 +1465,26 @@ splatterBoardManip::splatterBoardManip( QWidget *parent, const char *name )
   bIntensify = new QToolButton(QPixmap(), "Intensify", "Intensify", this, 
     SLOT( slotIntensify() ), manipulationTools);
   bIntensify->setText( "Intensify" );
+  lFadeDegree = new QLabel(" degree ", manipulationTools, "Fade Degree: ");
+  sFadeDegree = new QSlider(0, 255, 8, canvas->fadeDegree(), Qt::Horizontal,
+    manipulationTools, "Fade Degree");
+  QToolTip::add( sFadeDegree, "Fade and intensify degree: dragging previews "
+    "the fade" );
+  connect(sFadeDegree,SIGNAL(valueChanged(int)),this,
+    SLOT(slotFadeDegree(int)));
+  connect(sFadeDegree,SIGNAL(sliderMoved(int)),this,
+    SLOT(slotPreviewFade(int)));
+  connect(sFadeDegree,SIGNAL(sliderReleased()),this,SLOT(slotEndPreview()));
   manipulationTools->addSeparator();
 
   bBlur = new QToolButton(QPixmap(), "Blur", "Blur", this, 
     SLOT( slotBlur() ), manipulationTools);
   bBlur->setText( "Blur" );
+  lBlurRadius = new QLabel(" radius ", manipulationTools, "Blur Radius: ");
+  sBlurRadius = new QSpinBox(1, maxBlurRadius, 1, manipulationTools,
+    "Blur Radius");
+  QToolTip::add( sBlurRadius, "Blur radius: 1 is the 3x3 blur matrix, "
+    "larger radii blur with a box of that radius" );
   manipulationTools->addSeparator();
 
   bSharpen = new QToolButton(QPixmap(), "Sharpen", "Sharpen", this, 
@@ -848,6 +1522,21 @@ splatterBoardManip::splatterBoardManip( QWidget *parent, const char *name )
   bLaplacian2 = new QToolButton(QPixmap(), "Laplacian2", "Laplacian2", this, 
     SLOT( slotLaplacian2() ), manipulationTools2);
   bLaplacian2->setText( "Laplacian2" );
+  manipulationTools2->addSeparator();
+
+  bKernel = new QToolButton(QPixmap(), "Apply a kernel from a file", 
+    "Kernel...", this, SLOT( slotKernel() ), manipulationTools2);
+  bKernel->setText( "Kernel..." );
+  manipulationTools2->addSeparator();
+
+  bQueue = new QToolButton(QPixmap(), "Queue the filters into a chain", 
+    "Queue", 0, 0, manipulationTools2);
+  bQueue->setText( "Queue" );
+  bQueue->setToggleButton( true );
+  connect( bQueue, SIGNAL( toggled(bool) ), this, SLOT( slotQueue(bool) ) );
+  bRunChain = new QToolButton(QPixmap(), "Run the queued filters in one pass",
+    "Run chain", this, SLOT( slotRunChain() ), manipulationTools2);
+  updateChainButton();
 
 
   // make a menubar
@@ -855,9 +1544,24 @@ splatterBoardManip::splatterBoardManip( QWidget *parent, const char *name )
   file = new QPopupMenu();
   file->insertItem ("&Save", this, SLOT( slotSave() ) );
   file->insertItem ("&Open", this, SLOT( slotOpen() ) );
+  file->insertItem ("Save &Trace...", this, SLOT( slotSaveTrace() ) );
   file->insertItem ("E&xit", this, SLOT( slotExit() ), CTRL+Key_Q );
+  edit = new QPopupMenu();
+  edit->insertItem ("&Undo", this, SLOT( slotUndo() ), CTRL+Key_Z );
+  edit->insertItem ("&Redo", this, SLOT( slotRedo() ), CTRL+Key_Y );
+
+  view = new QPopupMenu();
+  view->insertItem ("Zoom &In", this, SLOT( slotZoomIn() ), CTRL+Key_Plus );
+  view->insertItem ("Zoom &Out", this, SLOT( slotZoomOut() ), CTRL+Key_Minus );
+  view->insertItem ("&Actual Size", this, SLOT( slotZoomActual() ),
+                    CTRL+Key_0 );
+  view->insertSeparator();
+  myTimingsItem = view->insertItem ("Show &Timings", this,
+                                    SLOT( slotTimings() ), CTRL+Key_T );
   menubar = new QMenuBar( this );
   menubar->insertItem( "&File", file);
+  menubar->insertItem( "&Edit", edit);
+  menubar->insertItem( "&View", view);
   menubar->insertSeparator();
   menubar->insertItem( myAuthorText );
 
@@ -871,7 +1575,8 @@ splatterBoardManip::splatterBoardManip( QWidget *parent, const char *name )
 
 void splatterBoardManip::slotSave() {
   QString filename = 
-   QFileDialog::getSaveFileName( myWorkingPath, "Images (*.png *.bmp *.xpm)", 
+   QFileDialog::getSaveFileName( myWorkingPath,
+    "Images (*.png *.bmp *.xpm);;Sessions, with the tools' settings (*.sbm)",
     this, "save image dialog" "Choose a destination image file.");
   if ( !filename.isEmpty() ) {
     canvas->save( filename, filename.right(3) );
@@ -881,27 +1586,93 @@ void splatterBoardManip::slotSave() {
 
 void splatterBoardManip::slotOpen() {
   QString filename = 
-   QFileDialog::getOpenFileName( myWorkingPath, "Images (*.png *.bmp *.xpm)", 
+   QFileDialog::getOpenFileName( myWorkingPath,
+    "Images (*.png *.bmp *.xpm *.sbm)",
     this, "open file dialog", "Choose an image file to open.");
   if ( !filename.isEmpty() ) {
     canvas->open( filename );
+    showSettings();
     myWorkingPath = filename.left( filename.findRev('/')+1 );
   }
 }
 
-void splatterBoardManip::slotInvert()       { canvas->invert(); }
-void splatterBoardManip::slotFade()         { canvas->fade(); }
-void splatterBoardManip::slotIntensify()    { canvas->intensify(); }
-void splatterBoardManip::slotBlur()         { canvas->convolute(blur); }
-void splatterBoardManip::slotSharpen()      { canvas->convolute(sharpen); }
-void splatterBoardManip::slotEdgeDetectX()  { canvas->convolute(edgeDetectX); }
-void splatterBoardManip::slotEdgeDetectY()  { canvas->convolute(edgeDetectY); }
-void splatterBoardManip::slotSobel()        { canvas->convolute(sobel); }
-void splatterBoardManip::slotLaplacian()    { canvas->convolute(laplacian); }
-void splatterBoardManip::slotLaplacian2()   { canvas->convolute(laplacian2); }
-void splatterBoardManip::slotLapOfGauss()   { canvas->convolute(lapOfGauss); }
+void splatterBoardManip::slotInvert() {
+  if ( bQueue->isOn() ) { myChain.addInvert(); updateChainButton(); }
+  else                  canvas->invert();
+}
+void splatterBoardManip::slotFade() {
+  if ( bQueue->isOn() ) { myChain.addFade( canvas->fadeDegree() );
+                          updateChainButton(); }
+  else                  canvas->fade();
+}
+void splatterBoardManip::slotIntensify() {
+  if ( bQueue->isOn() ) { myChain.addIntensify( canvas->fadeDegree() );
+                          updateChainButton(); }
+  else                  canvas->intensify();
+}
+void splatterBoardManip::slotBlur() {
+  if ( sBlurRadius->value() > 1 && !bQueue->isOn() )
+    canvas->boxBlur( sBlurRadius->value() );
+  else
+    applyConvolution(blur);
+}
+void splatterBoardManip::slotSharpen()      { applyConvolution(sharpen); }
+void splatterBoardManip::slotEdgeDetectX()  { applyConvolution(edgeDetectX); }
+void splatterBoardManip::slotEdgeDetectY()  { applyConvolution(edgeDetectY); }
+void splatterBoardManip::slotSobel()        { applyConvolution(sobel); }
+void splatterBoardManip::slotLaplacian()    { applyConvolution(laplacian); }
+void splatterBoardManip::slotLaplacian2()   { applyConvolution(laplacian2); }
+void splatterBoardManip::slotLapOfGauss()   { applyConvolution(lapOfGauss); }
 void splatterBoardManip::slotClear()        { canvas->clear(); }
 
+void splatterBoardManip::applyConvolution(const convolutionType type) {
+  if ( bQueue->isOn() ) {
+    myChain.addConvolution( type );
+    updateChainButton();
+  } else
+    canvas->convolute( type );
+}
+
+ /*
+ | While queueing, the filters which cannot be chained are disabled.
+*/
+void splatterBoardManip::slotQueue(bool on) {
+  sBlurRadius->setEnabled( !on );
+  bKernel->setEnabled( !on );
+}
+
+void splatterBoardManip::slotRunChain() {
+  if ( myChain.isEmpty() ) return;
+  canvas->runChain( myChain );
+  myChain.clear();
+  bQueue->setOn( false );
+  updateChainButton();
+}
+
+ /*
+ | Show the number of queued filters on the Run chain button.
+*/
+void splatterBoardManip::updateChainButton() {
+  if ( myChain.isEmpty() ) bRunChain->setText( "Run chain" );
+  else bRunChain->setText( QString("Run chain (%1)").arg( myChain.count() ) );
+  bRunChain->setEnabled( !myChain.isEmpty() );
+}
+
+void splatterBoardManip::slotKernel() {
+  QString filename = 
+   QFileDialog::getOpenFileName( myWorkingPath, "Kernels (*.txt *.kernel)", 
+    this, "open kernel dialog", "Choose a convolution kernel file.");
+  if ( filename.isEmpty() ) return;
+
+  ConvolutionKernel kernel;
+  std::string error;
+  if ( imageLoadKernel( filename.local8Bit(), kernel, error ) )
+    canvas->convoluteKernel( kernel );
+  else
+    QMessageBox::warning( this, "Kernel", 
+      QString("Could not read %1:\n%2").arg( filename ).arg( error.c_str() ) );
+}
+
 void splatterBoardManip::slotPen()          { canvas->activateTool(pen); }
 void splatterBoardManip::slotLine()         { canvas->activateTool(line); }
 void splatterBoardManip::slotRectangle()    { canvas->activateTool(rectangle); }
@@ -914,6 +1685,65 @@ void splatterBoardManip::slotTriangle()     { canvas->activateTool(triangle); }
 void splatterBoardManip::slotTriangleFilled()  
  { canvas->activateTool(triangleFilled); }
 void splatterBoardManip::slotExit()         { close(); }
+void splatterBoardManip::slotUndo()         { canvas->undo(); }
+void splatterBoardManip::slotRedo()         { canvas->redo(); }
+void splatterBoardManip::slotZoomIn()       { canvas->zoomIn(); }
+void splatterBoardManip::slotZoomOut()      { canvas->zoomOut(); }
+void splatterBoardManip::slotZoomActual()   { canvas->zoomActual(); }
+
+ /*
+ | Show or hide the timings in the status bar.  While they are shown, the
+ | timers are on, and keep their events for File > Save Trace.  With
+ | --trace on the command line, they are on from the start, and stay on.
+*/
+void splatterBoardManip::slotTimings() {
+  bool on = !view->isItemChecked( myTimingsItem );
+  view->setItemChecked( myTimingsItem, on );
+  if ( on ) {
+    profileEnable( true, true );
+    slotUpdateTimings();
+    lTimings->show();
+    myTimingsTimer->start( timingsInterval );
+  } else {
+    myTimingsTimer->stop();
+    lTimings->hide();
+    if ( !myTracing ) profileEnable( false );
+  }
+}
+
+void splatterBoardManip::slotUpdateTimings()
+ { lTimings->setText( profileSummary().c_str() ); }
+
+void splatterBoardManip::slotSaveTrace() {
+  QString filename =
+   QFileDialog::getSaveFileName( myWorkingPath, "Traces (*.json)",
+    this, "save trace dialog", "Choose a file to save the trace in.");
+  if ( filename.isEmpty() ) return;
+  std::string error;
+  if ( !profileWriteTrace( filename.local8Bit(), error ) )
+    QMessageBox::warning( this, "Save Trace", error.c_str() );
+}
+
+ /*
+ | Show the canvas's settings, as an SBM file may have changed them, in the
+ | tool buttons, sliders and colour buttons.
+*/
+void splatterBoardManip::showSettings() {
+  if ( canvas->activeTool() != none )
+    bgDrawingTools->setButton( canvas->activeTool() );
+  sBrushSize->setValue( canvas->brushSize() );
+  sGradientDegree->setValue( canvas->gradientDegree() );
+  sFadeDegree->setValue( canvas->fadeDegree() );
+  bPenColor->setPaletteBackgroundColor( canvas->penColor() );
+  bFillColor->setPaletteBackgroundColor( canvas->fillColor() );
+  bBackgroundColor->setPaletteBackgroundColor( canvas->backgroundColor() );
+}
+
+void splatterBoardManip::setHistoryLimit(int megabytes)
+ { canvas->setHistoryLimit(megabytes); }
+
+void splatterBoardManip::setJournal(const QString &filename)
+ { canvas->setJournal(filename); }
 
 void splatterBoardManip::slotPenColor()  { 
   QColor pickColor = QColorDialog::getColor( canvas->penColor(), this );
@@ -945,4 +1775,16 @@ void splatterBoardManip::slotBrushSize(int value)
 void splatterBoardManip::slotGradientDegree(int value)
  {  canvas->setGradientDegree(value); }
 
+void splatterBoardManip::slotFadeDegree(int value)
+ { canvas->setFadeDegree(value); }
+
+ /*
+ | Show the image faded by the slider's degree while it is dragged.
+*/
+void splatterBoardManip::slotPreviewFade(int value)
+ { canvas->previewTable( fadeTable(value) ); }
+
+void splatterBoardManip::slotEndPreview()
+ { canvas->endTablePreview(); }
+
 
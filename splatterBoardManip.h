@@ -44,13 +44,25 @@
 #include <qslider.h>
 #include <qlabel.h>
 #include <qbuttongroup.h>
+#include <qspinbox.h>
 
 #include <math.h>   //for drawing triangles and circles using trigonometry, etc.
 
+#include "imageOps.h"   //the image manipulation kernels and convolutions
+#include "filterChain.h"
+#include "mipPyramid.h"
+#include "profiler.h"
+#include "tiledImage.h"
+#include "tiledTexture.h"
+#include "toolPainter.h"
+
 class QMouseEvent;
+class QWheelEvent;
 class QResizeEvent;
 class QPaintEvent;
 class QToolButton;
+class QTimer;
+class Journal;
 
 
  /*
@@ -63,62 +75,94 @@ class QToolButton;
 #define halfPI    PI / 2
 #define quarterPI PI / 4
 #define atanPI  atan(PI)
-#define toolCirclePointsPerPI    24    //tool configuration
+#define toolCircleTolerance    0.25    //pixels a circle's edge may stray
+#define toolCircleMinSegments    16    //  from the true circle, with at
+#define toolCircleMaxSegments  4096    //  least and at most this many sides
+#define defaultFadeDegree       128    //fade() and intensify() configuration
+#define penFrameInterval         16    //ms between pen frames, about 60 a second
+#define maxZoomIn                 4    //the view magnifies up to 2^4 times
+#define timingsInterval         500    //ms between showings of the timings
 
  //definitions used by Canvas : color data structures
 typedef GLfloat color3[3];
 typedef float color3f255[3];
 
- //definitions used by Canvas : convolutions
-typedef float     float3[3];
-typedef float3    kernel3x3[3];
-typedef kernel3x3 convolutionKernels[10];
-const convolutionKernels convolutionMatrix =
- { { { 0.0, 0.0, 0.0 },                      //fade
-     { 0.0, 1.0, 0.0 },
-     { 0.0, 0.0, 0.0 } },
-   { { 0.0, 0.0, 0.0 },                      //intensify
-     { 0.0, 1.0, 0.0 },
-     { 0.0, 0.0, 0.0 } },
-   { { 0.1111111, 0.1111111, 0.1111111 },    //blur
-     { 0.1111111, 0.1111111, 0.1111111 },
-     { 0.1111111, 0.1111111, 0.1111111 } },
-   { { -0.117647, -0.117647, -0.117647 },    //sharpen
-     { -0.117647, 1.941176 , -0.117647 },
-     { -0.117647, -0.117647, -0.117647 } },
-   { { -0.05, -0.07, -0.05  },               //Laplacian-of-Gaussian variant
-     { -0.07, 1.58,  -0.07 },
-     { -0.05, -0.07, -0.05  } },
-   { { 0.0  , 0.0, 0.0  },                   //edgeDetectX
-     { -0.25, 1.5, -0.25 },
-     { 0.0  , 0.0, 0.0  } },
-   { { 0.0, -0.25, 0.0 },                    //edgeDetectY
-     { 0.0, 1.5  , 0.0 },
-     { 0.0, -0.25 , 0.0 } },
-   { {  0.5,  1.5,  0.5  },                  //sobel
-     {  0.0,  1.0,  0.0 },
-     { -0.5, -1.5, -0.5  } },
-   { { 0.75,  -2.25, 0.75  },                //Laplacian
-     { -2.25, 4.0,   -2.25 },
-     { 0.75,  -2.25, 0.75  } },
-   { { 0.25,  -0.75, 0.25  },                //Laplacian2
-     { -0.75, 1.0,   -0.75 },
-     { 0.25,  -0.75, 0.25  } } };
-enum convolutionType { fade, intensify, blur, sharpen, lapOfGauss,
-                       edgeDetectX, edgeDetectY,
-                       sobel, laplacian, laplacian2 };
+ //image manipulation kernels on QImages, usable without a Canvas or a GL
+ //context (the Canvas manipulation functions and the batch mode use these)
+ImageRows imageRows(QImage &image);
+void convoluteImage(QImage &image, const convolutionType type,
+                    const convolutionEngine engine = engineSimd);
+void fadeImage     (QImage &image, const int fadeDegree);
+void intensifyImage(QImage &image, const int fadeDegree);
+void boxBlurImage  (QImage &image, const int radius, const int passes = 1);
+void convoluteKernelImage(QImage &image, const ConvolutionKernel &kernel,
+                          const kernelMethod method = methodAuto);
+void runChainImage (QImage &image, const FilterChain &chain,
+                    const convolutionEngine engine = engineSimd);
+void invertImage   (QImage &image);
+
+ //open an image file into image, or save image to a file in the given
+ //format, PNGs a row at a time and SBMs (see tileFile.h) a tile at a time,
+ //with the settings an SBM keeps; return false, with the reason in error,
+ //if it cannot be read or written
+bool loadImage(const QString &filename, TiledImage &image, std::string &error,
+               std::string *settings = 0);
+bool saveImage(const TiledImage &image, const QString &filename,
+               const QString &format, std::string &error,
+               const std::string &settings = std::string());
 
 //list of the tools supported by Canvas
 enum CanvasTool { none, pen, line, rectangle, rectangleFilled, circle, 
                   circleFilled, triangle, triangleFilled };
 
+ /*
+ | One use of a tool, with everything it is drawn from: its points, y
+ | upwards from the bottom of the image, and the settings at the time.
+*/
+struct ToolStroke {
+  CanvasTool  tool;
+  int         x1, y1, x2, y2;
+  QPointArray points;           // the pen's, since the last frame
+  QColor      penColor, fillColor;
+  int         brushSize, gradientDegree;
+  int         magnification;    // the view's, which the circles' sides suit
+};
+
+ //draw the stroke with the painter: into the screen, or into an image
+void drawToolStroke(ToolPainter &painter, const ToolStroke &stroke);
+
+ /*
+ | One of the Canvas's filters, as given: the matrix, the radius of a box
+ | blur, or the degree of a fade or an intensify, with the kernel or chain
+ | for those.
+*/
+enum canvasFilterKind { filterConvolute, filterBoxBlur, filterInvert,
+                        filterFade, filterIntensify, filterKernel,
+                        filterChain };
+
+struct CanvasFilter {
+  canvasFilterKind  kind;
+  int               value;
+  ConvolutionKernel kernel;
+  FilterChain       chain;
+
+  CanvasFilter(canvasFilterKind k = filterInvert, int v = 0)
+   : kind(k), value(v) {}
+
+   // A new filter which runs it over tiles, on an image scale times the
+   // size it was given for.
+  TileFilter *tileFilter(double scale = 1.0) const;
+};
+
 class Canvas : public QGLWidget {
  Q_OBJECT
 
  public:
   Canvas( QWidget *parent = 0, const char *name = 0 );
+  ~Canvas();
 
-   // Save|open images files to|from disk.
+   // Save|open images files to|from disk.  An SBM file keeps the tools'
+   // settings with the image.
   void save( const QString &filename, const QString &format );
   void open( const QString &filename );
 
@@ -127,25 +171,43 @@ class Canvas : public QGLWidget {
   void intensify();
   void invert();
   void convolute(const convolutionType type);
+  void boxBlur(const int radius);
+  void convoluteKernel(const ConvolutionKernel &kernel);
+  void runChain(const FilterChain &chain);
   void clear();
 
-   // Return the given integer value limited within the range 0 to 255.
-  int limit0_255(const int & val) {
-    if      (val < 0  ) return 0;
-    else if (val > 255) return 255;
-    else return val; 
-  }
+   // Undo and redo the changes to the image, strokes and filters.
+  void undo();
+  void redo();
+  void setHistoryLimit(int megabytes);
+
+   // Zoom the view in or out by a factor of two, about its middle, or back
+   // to one screen pixel for each pixel of the image.
+  void zoomIn();
+  void zoomOut();
+  void zoomActual();
+
+   // Keep a journal of the changes in the file, restoring the session it
+   // holds if there is one (see journal.h).
+  void setJournal(const QString &filename);
+
+   // Show the image through the table, without changing it, until the
+   // preview is ended.
+  void previewTable(const PointTable &table);
+  void endTablePreview();
 
    // Activate the given tool.
   void activateTool(CanvasTool toolNum) { myActiveTool = toolNum; }
   void makeCheckImage(void);
 
    // Accessor functions.
+  int    activeTool()      { return myActiveTool; }
   QColor penColor()        { return *myPenColor; }
   QColor fillColor()       { return *myFillColor; }
   QColor backgroundColor() { return *myBackgroundColor; }
   int    brushSize()       { return myBrushSize; }
   int    gradientDegree()  { return myGradientDegree; }
+  int    fadeDegree()      { return myFadeDegree; }
 
    // Modifier functions.
   void setPenColor (QColor newColor)       { *myPenColor        = newColor; }
@@ -153,24 +215,72 @@ class Canvas : public QGLWidget {
   void setBackgroundColor(QColor newColor) { *myBackgroundColor = newColor; }
   void setBrushSize(int newSize)           { myBrushSize       = newSize;  }
   void setGradientDegree(int newVal)       { myGradientDegree  = newVal; }
+  void setFadeDegree(int newVal)           { myFadeDegree      = newVal; }
+
+   // The tools' settings, as lines of a name and a value, and set them
+   // back from those, leaving any not given as they are.
+  std::string settings() const;
+  void        setSettings(const std::string &settings);
+
+ signals:
+   // A line about the pen's drawing, to show in the status bar.
+  void statsChanged(const QString &text);
+
+ protected slots:
+  void    drawStroke();
 
  protected:
-  void    drawWithActiveTool();
+  ToolStroke activeStroke() const;
+  void    drawWithActiveTool(ToolPainter &painter);
+  void    drawIntoBuffer();
+  void    createBuffer(int w, int h);
+  void    beginChange();
+  void    endChange();
+  void    applyFilter(const CanvasFilter &filter);
+  void    updatePreview();
+  PixelRect previewRect() const;
+  void    setView(int zoom, int x, int y);
+  void    zoomAbout(int zoom, int x, int y);
+  int     viewLevel() const;
+  int     viewMagnification() const;
+  QPoint  toImage(int x, int y) const;
+  PixelRect toScreen(const PixelRect &rect) const;
   void    resizeGL (int w, int h);
   void    initializeGL();
   void    paintGL();
 
 
-  QImage buffer, workingBuffer;
+   // the drawing, in a scratch file; the screen only ever shows a copy of
+   // the part of it in view
+  TiledImage buffer;
+  PixelRect myDirtyRect;   // the part of buffer drawn on since the last paintGL
+  PixelRect myRedrawRect;  // the part of buffer to draw on the screen again
+  MipPyramid myPyramid;    // buffer's smaller copies, for zooming out
+  TiledTexture myTexture;  // the copy of the view the screen is drawn from
+   // the view: a power of two to shrink buffer by, or if negative to
+   // magnify it by, and the pixel of buffer at the top-left of the screen
+  int    myZoom, myViewX, myViewY;
+  bool   panning;         // with the middle button, from myPanX,myPanY
+  int    myPanX, myPanY;
+   // the shape being dragged out, drawn over the screen but not into buffer
+  RecordingToolPainter myPreview;
+  PointTable myTablePreview;   // the screen's pixels are looked up in it
+  bool   tablePreview;         // while this is set
+  TileHistory myHistory;   // the changes to buffer, for undo and redo
+  Journal *myJournal;      // the record of them, if one is being kept
   QColor *myPenColor, *myFillColor, *myBackgroundColor;
   int    myBrushSize, myActiveTool, myGradientDegree, myFadeDegree;
   int    x1, y1, x2, y2;
   bool   mousePressed, openPic;
+  QPointArray myStroke;   // the pen's points not yet drawn, and the last drawn
+  QTimer *myFrameTimer;   // for drawing the pen's stroke once a frame
+  int    myMotionEvents, myStrokeFrames;   // in the current pen stroke
 
    // Overloaded QT functions.
   virtual void mousePressEvent  ( QMouseEvent* event);
   virtual void mouseReleaseEvent( QMouseEvent* event);
   virtual void mouseMoveEvent   ( QMouseEvent* event);
+  virtual void wheelEvent       ( QWheelEvent* event);
 
 };
 
@@ -186,6 +296,12 @@ class splatterBoardManip : public QMainWindow {
  public:
   splatterBoardManip( QWidget *parent = 0, const char *name = 0 );
 
+   // Set the most memory the undo history may take, in megabytes.
+  void setHistoryLimit(int megabytes);
+
+   // Keep a journal of the session in the file.
+  void setJournal(const QString &filename);
+
  protected:
   Canvas	*canvas;
   QButtonGroup  *bgDrawingTools;
@@ -193,21 +309,41 @@ class splatterBoardManip : public QMainWindow {
                 *bInvert, *bFade, *bIntensify, 
                 *bBlur, *bSharpen, 
                 *bEdgeDetectX, *bEdgeDetectY, 
-                *bSobel, *bLaplacian, *bLaplacian2, *bLapOfGauss,
+                *bSobel, *bLaplacian, *bLaplacian2, *bLapOfGauss, *bKernel,
                 *bPen, *bLine, *bRectangle, *bRectangleFilled, 
                 *bCircle, *bCircleFilled, *bTriangle, *bTriangleFilled,
-                *bPenColor, *bFillColor, *bBackgroundColor;
-  QSlider       *sBrushSize, *sGradientDegree;
-  QLabel        *lBrushSize, *lGradientDegree;
-  QPopupMenu	*file;
+                *bPenColor, *bFillColor, *bBackgroundColor,
+                *bQueue, *bRunChain;
+  QSlider       *sBrushSize, *sGradientDegree, *sFadeDegree;
+  QLabel        *lBrushSize, *lGradientDegree, *lFadeDegree, *lBlurRadius;
+  QSpinBox      *sBlurRadius;
+  QPopupMenu	*file, *edit, *view;
   QMenuBar	*menubar;
+  QLabel        *lTimings;       // The timings, in the status bar.
+  QTimer        *myTimingsTimer; // For showing them afresh.
+  int           myTimingsItem;   // The View menu's item which shows them.
+  bool          myTracing;       // The timers were on from the start.
   QString       myWorkingPath;   // Path in which to look for files.
   QString       myAuthorText;
+  FilterChain   myChain;         // The filters queued while bQueue is on.
+
+   // Apply the filter now, or queue it on the chain if bQueue is on.
+  void applyConvolution(const convolutionType type);
+  void updateChainButton();
+  void showSettings();
 
  protected slots:
   void slotSave();
   void slotOpen();
   void slotExit();
+  void slotUndo();
+  void slotRedo();
+  void slotZoomIn();
+  void slotZoomOut();
+  void slotZoomActual();
+  void slotTimings();
+  void slotUpdateTimings();
+  void slotSaveTrace();
 
    // Image Manipulation Slots.
   void slotInvert();
@@ -221,6 +357,9 @@ class splatterBoardManip : public QMainWindow {
   void slotLaplacian();
   void slotLaplacian2();
   void slotLapOfGauss();
+  void slotKernel();
+  void slotQueue(bool on);
+  void slotRunChain();
   void slotClear();
 
    // Tool slots.
@@ -239,6 +378,9 @@ class splatterBoardManip : public QMainWindow {
   void slotBackgroundColor();
   void slotBrushSize(int value);
   void slotGradientDegree(int value);
+  void slotFadeDegree(int value);
+  void slotPreviewFade(int value);
+  void slotEndPreview();
 
 };
 
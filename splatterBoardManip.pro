@@ -3,11 +3,40 @@
 ######################################################################
 
 TEMPLATE = app
-INCLUDEPATH += .
+INCLUDEPATH += . imageOps verify
 
 # Config
 CONFIG += qt opengl
 
 # Input
-HEADERS += splatterBoardManip.h
-SOURCES += main.cpp splatterBoardManip.cpp
+HEADERS += splatterBoardManip.h batchMode.h verifyMode.h toolPainter.h \
+           tiledTexture.h pngRows.h journal.h replayMode.h \
+           verify/verifySuite.h
+SOURCES += main.cpp splatterBoardManip.cpp batchMode.cpp verifyMode.cpp \
+           toolPainter.cpp tiledTexture.cpp pngRows.cpp journal.cpp \
+           replayMode.cpp verify/verifySuite.cpp
+
+# PNG files are read and written a row at a time through libpng
+LIBS += -lpng
+
+# The image manipulation kernels, a static library of their own
+imageOps.target   = imageOps/libimageOps.a
+imageOps.commands = cd imageOps && $(QMAKE) imageOps.pro && $(MAKE)
+imageOps.depends  = FORCE
+QMAKE_EXTRA_UNIX_TARGETS += imageOps
+TARGETDEPS += imageOps/libimageOps.a
+LIBS += -LimageOps -limageOps
+
+# The benchmark, a program of its own (see bench/bench.pro): "make bench"
+bench.target   = bench
+bench.commands = cd bench && $(QMAKE) bench.pro && $(MAKE)
+bench.depends  = FORCE
+QMAKE_EXTRA_UNIX_TARGETS += bench
+
+# The filters' checks, a program of their own (see verify/verify.pro):
+# "make check" builds them and runs them on the sample images and kernels
+check.target   = check
+check.commands = cd verify && $(QMAKE) verify.pro && $(MAKE) && \
+                 ./verify --kernels ../kernels ../images
+check.depends  = FORCE
+QMAKE_EXTRA_UNIX_TARGETS += check
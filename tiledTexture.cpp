@@ -0,0 +1,247 @@
+/*---------------------.
+| tiledTexture.cpp      \______________________________
+|                                                      \
+| See the header of tiledTexture.h for details.        |
+\_____________________________________________________*/
+
+#include "tiledTexture.h"
+#include "profiler.h"
+
+#include <GL/glx.h>
+#include <string.h>
+
+ // the width and height of a tile, which every OpenGL can make a texture of
+#define textureTileSize    256
+
+ // the packed pixel format of QImage's 32-bit pixels, from OpenGL 1.2
+#ifndef GL_BGRA
+#define GL_BGRA                        0x80E1
+#endif
+#ifndef GL_UNSIGNED_INT_8_8_8_8_REV
+#define GL_UNSIGNED_INT_8_8_8_8_REV    0x8367
+#endif
+
+ // GL_ARB_pixel_buffer_object, and the buffer calls of
+ // GL_ARB_vertex_buffer_object which it uses
+#ifndef GL_PIXEL_UNPACK_BUFFER_ARB
+#define GL_PIXEL_UNPACK_BUFFER_ARB     0x88EC
+#endif
+#ifndef GL_STREAM_DRAW_ARB
+#define GL_STREAM_DRAW_ARB             0x88E0
+#endif
+#ifndef GL_WRITE_ONLY_ARB
+#define GL_WRITE_ONLY_ARB              0x88B9
+#endif
+
+typedef void      (*genBuffersFunction)   ( GLsizei, GLuint* );
+typedef void      (*deleteBuffersFunction)( GLsizei, const GLuint* );
+typedef void      (*bindBufferFunction)   ( GLenum, GLuint );
+typedef void      (*bufferDataFunction)   ( GLenum, ptrdiff_t, const GLvoid*,
+                                            GLenum );
+typedef GLvoid   *(*mapBufferFunction)    ( GLenum, GLenum );
+typedef GLboolean (*unmapBufferFunction)  ( GLenum );
+
+static genBuffersFunction    genBuffers    = 0;
+static deleteBuffersFunction deleteBuffers = 0;
+static bindBufferFunction    bindBuffer    = 0;
+static bufferDataFunction    bufferData    = 0;
+static mapBufferFunction     mapBuffer     = 0;
+static unmapBufferFunction   unmapBuffer   = 0;
+
+ /*
+ | Return true if the current context has pixel buffer objects, looking up
+ | their functions the first time.
+*/
+static bool hasPixelBuffers() {
+  static int found = -1;
+  if ( found >= 0 ) return found;
+
+  const char *extensions = (const char*)glGetString( GL_EXTENSIONS );
+  found = 0;
+  if ( extensions && strstr( extensions, "GL_ARB_pixel_buffer_object" ) ) {
+    genBuffers    = (genBuffersFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glGenBuffersARB" );
+    deleteBuffers = (deleteBuffersFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glDeleteBuffersARB" );
+    bindBuffer    = (bindBufferFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glBindBufferARB" );
+    bufferData    = (bufferDataFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glBufferDataARB" );
+    mapBuffer     = (mapBufferFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glMapBufferARB" );
+    unmapBuffer   = (unmapBufferFunction)
+      glXGetProcAddressARB( (const GLubyte*)"glUnmapBufferARB" );
+    found = genBuffers && deleteBuffers && bindBuffer && bufferData &&
+            mapBuffer && unmapBuffer;
+  }
+  return found;
+}
+
+
+TiledTexture::TiledTexture()
+ : myWidth(0), myHeight(0), myOriginX(0), myOriginY(0), myColumns(0),
+   myRows(0), myPixelBuffer(0) {}
+
+TiledTexture::~TiledTexture()
+ { release(); }
+
+void TiledTexture::release() {
+  if ( !myTiles.empty() )
+    glDeleteTextures( myTiles.size(), &myTiles[0] );
+  myTiles.clear();
+  if ( myPixelBuffer )
+    deleteBuffers( 1, &myPixelBuffer );
+  myPixelBuffer = 0;
+  myWidth = myHeight = myColumns = myRows = 0;
+}
+
+void TiledTexture::resize( int width, int height ) {
+  if ( width == myWidth && height == myHeight ) return;
+  release();
+  myWidth   = width;
+  myHeight  = height;
+  myColumns = (width  + textureTileSize-1) / textureTileSize;
+  myRows    = (height + textureTileSize-1) / textureTileSize;
+  if ( myColumns * myRows == 0 ) return;
+
+  myTiles.resize( myColumns * myRows );
+  glGenTextures( myTiles.size(), &myTiles[0] );
+  for (unsigned i=0; i<myTiles.size(); i++) {
+    glBindTexture( GL_TEXTURE_2D, myTiles[i] );
+     // the screen shows the image pixel for pixel, so no filtering
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, textureTileSize, textureTileSize,
+                  0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0 );
+  }
+  glBindTexture( GL_TEXTURE_2D, 0 );
+
+  if ( hasPixelBuffers() )
+    genBuffers( 1, &myPixelBuffer );
+}
+
+void TiledTexture::setOrigin( int x, int y ) {
+  myOriginX = x;
+  myOriginY = y;
+}
+
+ /*
+ | Copy the rectangle, in the textures' own coordinates, into each tile it
+ | covers, from pixels, which hold the rectangle pixelsRect in rows rowLength
+ | pixels apart.
+*/
+void TiledTexture::uploadTiles( const PixelRect &rect, const GLvoid *pixels,
+                                const PixelRect &pixelsRect, int rowLength ) {
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, rowLength );
+  for (int ty=rect.y0/textureTileSize; ty*textureTileSize<rect.y1; ty++)
+    for (int tx=rect.x0/textureTileSize; tx*textureTileSize<rect.x1; tx++) {
+      PixelRect tile( tx*textureTileSize, ty*textureTileSize,
+                      (tx+1)*textureTileSize, (ty+1)*textureTileSize );
+      PixelRect part = rect.intersected( tile );
+      glPixelStorei( GL_UNPACK_SKIP_PIXELS, part.x0 - pixelsRect.x0 );
+      glPixelStorei( GL_UNPACK_SKIP_ROWS,   part.y0 - pixelsRect.y0 );
+      glBindTexture( GL_TEXTURE_2D, myTiles[ ty*myColumns + tx ] );
+      glTexSubImage2D( GL_TEXTURE_2D, 0, part.x0 - tile.x0, part.y0 - tile.y0,
+                       part.width(), part.height(), GL_BGRA,
+                       GL_UNSIGNED_INT_8_8_8_8_REV, pixels );
+    }
+  glBindTexture( GL_TEXTURE_2D, 0 );
+  glPixelStorei( GL_UNPACK_ROW_LENGTH,  0 );
+  glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
+  glPixelStorei( GL_UNPACK_SKIP_ROWS,   0 );
+}
+
+ /*
+ | With a pixel buffer object, the rectangle is copied into a fresh buffer
+ | (the old one is orphaned, so there is no waiting for the textures to be
+ | done with it), and the textures are filled from that without the CPU.
+ | Without one, each of the image's tiles is passed to OpenGL as it is, or
+ | through a copy when there is a table to look the pixels up in.
+*/
+void TiledTexture::upload( const TiledImage &image, const PixelRect &rect,
+                           const PointTable *table ) {
+  PixelRect window( myOriginX, myOriginY, myOriginX + myWidth,
+                    myOriginY + myHeight );
+  PixelRect r = rect.intersected( window ).intersected( image.rect() );
+  if ( r.isEmpty() ) return;
+  PixelRect inWindow( r.x0 - myOriginX, r.y0 - myOriginY,
+                      r.x1 - myOriginX, r.y1 - myOriginY );
+  StageTimer timer( "upload" );
+  profileCount( "pixels uploaded", (long)r.width() * r.height() );
+
+  if ( myPixelBuffer ) {
+    bindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, myPixelBuffer );
+    bufferData( GL_PIXEL_UNPACK_BUFFER_ARB, r.width() * r.height() * 4, 0,
+                GL_STREAM_DRAW_ARB );
+    uint32_t *mapped = (uint32_t*)mapBuffer( GL_PIXEL_UNPACK_BUFFER_ARB,
+                                             GL_WRITE_ONLY_ARB );
+    if ( mapped ) {
+      ImageRows rows( mapped, r.width(), r.height(), r.width() );
+      image.read( r, rows );
+      if ( table ) imageApplyTable( rows, *table );
+      unmapBuffer( GL_PIXEL_UNPACK_BUFFER_ARB );
+      uploadTiles( inWindow, 0, inWindow, r.width() );
+      bindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
+      return;
+    }
+    bindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
+  }
+
+  std::vector<uint32_t> copy;
+  for (int row=r.y0/imageTileSize; row*imageTileSize<r.y1; row++)
+    for (int column=r.x0/imageTileSize; column*imageTileSize<r.x1;
+         column++) {
+      PixelRect t = image.tileRect( column, row ).intersected( r );
+      PixelRect part( t.x0 - myOriginX, t.y0 - myOriginY,
+                      t.x1 - myOriginX, t.y1 - myOriginY );
+      if ( table ) {
+        copy.resize( t.width() * t.height() );
+        ImageRows rows( &copy[0], t.width(), t.height(), t.width() );
+        image.read( t, rows );
+        imageApplyTable( rows, *table );
+        uploadTiles( part, &copy[0], part, t.width() );
+        continue;
+      }
+      ImageRows pixels = image.tile( column, row );
+      uploadTiles( part, pixels.row( t.y0 % imageTileSize )
+                           + t.x0 % imageTileSize,
+                   part, imageTileSize );
+    }
+}
+
+ /*
+ | Draw a textured quad for the part of each tile inside the rectangle.
+*/
+void TiledTexture::draw( const PixelRect &rect ) const {
+  PixelRect r( rect.x0 - myOriginX, rect.y0 - myOriginY,
+               rect.x1 - myOriginX, rect.y1 - myOriginY );
+  r = r.intersected( PixelRect( 0, 0, myWidth, myHeight ) );
+  if ( r.isEmpty() ) return;
+  StageTimer timer( "draw" );
+
+  glEnable( GL_TEXTURE_2D );
+  glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+  for (int ty=r.y0/textureTileSize; ty*textureTileSize<r.y1; ty++)
+    for (int tx=r.x0/textureTileSize; tx*textureTileSize<r.x1; tx++) {
+      PixelRect tile( tx*textureTileSize, ty*textureTileSize,
+                      (tx+1)*textureTileSize, (ty+1)*textureTileSize );
+      PixelRect part = r.intersected( tile );
+      float s0 = (float)(part.x0 - tile.x0) / textureTileSize;
+      float s1 = (float)(part.x1 - tile.x0) / textureTileSize;
+      float t0 = (float)(part.y0 - tile.y0) / textureTileSize;
+      float t1 = (float)(part.y1 - tile.y0) / textureTileSize;
+      glBindTexture( GL_TEXTURE_2D, myTiles[ ty*myColumns + tx ] );
+      glBegin( GL_QUADS );
+        glTexCoord2f( s0, t0 );
+        glVertex2i( part.x0 + myOriginX, part.y0 + myOriginY );
+        glTexCoord2f( s1, t0 );
+        glVertex2i( part.x1 + myOriginX, part.y0 + myOriginY );
+        glTexCoord2f( s1, t1 );
+        glVertex2i( part.x1 + myOriginX, part.y1 + myOriginY );
+        glTexCoord2f( s0, t1 );
+        glVertex2i( part.x0 + myOriginX, part.y1 + myOriginY );
+      glEnd();
+    }
+  glBindTexture( GL_TEXTURE_2D, 0 );
+  glDisable( GL_TEXTURE_2D );
+}
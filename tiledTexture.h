@@ -0,0 +1,68 @@
+/*---------------------.
+| tiledTexture.h        \______________________________
+|                                                      \
+| A copy of the part of an image on screen, kept in    |
+| OpenGL textures, which the screen is drawn from.     |
+| The textures cover a window onto the image, about    |
+| the size of the canvas, from a given origin, and     |
+| are cut into square tiles a power of two wide, so    |
+| any OpenGL 1.2 can hold them.  They take the image's |
+| own 32-bit pixels as they are, so nothing is         |
+| converted on the way.  Only the part of the image    |
+| which has changed is copied in, through a pixel      |
+| buffer object where the driver has them, so that the |
+| copy does not hold up drawing.                       |
+|                                                      |
+| All the functions need the canvas's OpenGL context   |
+| to be current.                                       |
+\_____________________________________________________*/
+
+
+#ifndef TILEDTEXTURE_H
+#define TILEDTEXTURE_H
+
+
+#include <qgl.h>
+#include <vector>
+
+#include "tiledImage.h"
+
+
+class TiledTexture {
+ public:
+  TiledTexture();
+  ~TiledTexture();
+
+   // Make room for a window of the given size onto an image, with its
+   // top-left at the given pixel.  The contents are undefined until
+   // uploaded.
+  void resize( int width, int height );
+  void setOrigin( int x, int y );
+
+   // Copy the rectangle of the image into the textures, as much of it as
+   // is in the window, through the table if one is given.
+  void upload( const TiledImage &image, const PixelRect &rect,
+               const PointTable *table = 0 );
+
+   // Draw the rectangle of the image, as much of it as is in the window, at
+   // the image's own coordinates, y downwards; the modelview matrix puts it
+   // on the screen.
+  void draw( const PixelRect &rect ) const;
+
+  int width()  const { return myWidth; }
+  int height() const { return myHeight; }
+
+ protected:
+  void release();
+  void uploadTiles( const PixelRect &rect, const GLvoid *pixels,
+                    const PixelRect &pixelsRect, int rowLength );
+
+  int  myWidth, myHeight;
+  int  myOriginX, myOriginY;
+  int  myColumns, myRows;           // the number of tiles across and down
+  std::vector<GLuint> myTiles;      // row by row, from the top
+  GLuint myPixelBuffer;             // 0 without pixel buffer objects
+};
+
+
+#endif
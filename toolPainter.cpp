@@ -0,0 +1,190 @@
+/*---------------------.
+| toolPainter.cpp       \______________________________
+|                                                      \
+| See the header of toolPainter.h for details.         |
+\_____________________________________________________*/
+
+#include "toolPainter.h"
+
+#include <math.h>
+
+ /*
+ | Construct a painter drawing into the image, with OpenGL's initial state.
+*/
+ImageToolPainter::ImageToolPainter( TiledImage &image, TileHistory *history )
+ : myImage(image), myMode(GL_POINTS),
+   myColor(0, 0, 1, 1, 1), myPointSize(1), myLineWidth(1),
+   myPointSmooth(true), myHistory(history) {}
+
+void ImageToolPainter::begin( GLenum mode ) {
+  myMode = mode;
+  myVertices.clear();
+}
+
+void ImageToolPainter::color3f( GLfloat red, GLfloat green, GLfloat blue ) {
+  myColor.red   = red;
+  myColor.green = green;
+  myColor.blue  = blue;
+}
+
+ /*
+ | Add a vertex in the current color, turned the image's way up, with y
+ | running downwards from its top row.
+*/
+void ImageToolPainter::vertex2f( GLfloat x, GLfloat y ) {
+  RasterVertex v = myColor;
+  v.x = x;
+  v.y = myImage.height() - y;
+  myVertices.push_back( v );
+}
+
+ /*
+ | Draw the vertices given since begin(), as OpenGL would, into each tile
+ | they reach.
+*/
+void ImageToolPainter::end() {
+  int count = myVertices.size();
+  if ( count == 0 ) return;
+
+   // the vertices' bounds, and as far as a point or line reaches past them
+  float reach = ( myPointSize > myLineWidth ? myPointSize : myLineWidth ) / 2
+                + 1;
+  float x0 = myVertices[0].x, y0 = myVertices[0].y, x1 = x0, y1 = y0;
+  for (int i=1; i<count; i++) {
+    if ( myVertices[i].x < x0 ) x0 = myVertices[i].x;
+    if ( myVertices[i].x > x1 ) x1 = myVertices[i].x;
+    if ( myVertices[i].y < y0 ) y0 = myVertices[i].y;
+    if ( myVertices[i].y > y1 ) y1 = myVertices[i].y;
+  }
+  PixelRect bounds = PixelRect( (int)floor( x0 - reach ),
+                                (int)floor( y0 - reach ),
+                                (int)ceil( x1 + reach ),
+                                (int)ceil( y1 + reach ) )
+                       .intersected( myImage.rect() );
+  if ( bounds.isEmpty() ) {
+    myVertices.clear();
+    return;
+  }
+  if ( myHistory ) myHistory->touch( myImage, bounds );
+
+  std::vector<RasterVertex> shifted( count );
+  for (int row=bounds.y0/imageTileSize; row*imageTileSize<bounds.y1; row++)
+    for (int column=bounds.x0/imageTileSize; column*imageTileSize<bounds.x1;
+         column++) {
+      PixelRect t = myImage.tileRect( column, row );
+      for (int i=0; i<count; i++) {
+        shifted[i] = myVertices[i];
+        shifted[i].x = rasterSnap( shifted[i].x ) - t.x0;
+        shifted[i].y = rasterSnap( shifted[i].y ) - t.y0;
+      }
+      PixelRect r = rasterize( myImage.tileToWrite( column, row ), shifted );
+      if ( !r.isEmpty() )
+        myChanged = myChanged.united( PixelRect( r.x0 + t.x0, r.y0 + t.y0,
+                                                 r.x1 + t.x0, r.y1 + t.y0 ) );
+    }
+  myVertices.clear();
+}
+
+ /*
+ | Draw the vertices into one tile, in its own coordinates, returning the
+ | rectangle of it drawn on.
+*/
+PixelRect ImageToolPainter::rasterize( const ImageRows &tile,
+                               const std::vector<RasterVertex> &v ) const {
+  PixelRect changed;
+  int count = v.size();
+  switch ( myMode ) {
+    case GL_POINTS :
+      for (int i=0; i<count; i++)
+        changed = changed.united( rasterPoint( tile, v[i], myPointSize,
+                                               myPointSmooth ) );
+      break;
+    case GL_LINES :
+      for (int i=1; i<count; i+=2)
+        changed = changed.united( rasterLine( tile, v[i-1], v[i],
+                                              myLineWidth ) );
+      break;
+    case GL_LINE_STRIP :
+      for (int i=1; i<count; i++)
+        changed = changed.united( rasterLine( tile, v[i-1], v[i],
+                                              myLineWidth ) );
+      break;
+    case GL_POLYGON :
+      if ( count >= 3 )
+        changed = changed.united( rasterPolygon( tile, &v[0], count ) );
+      break;
+  }
+  return changed;
+}
+
+
+/*-------------------------\
+|    The recorder         |
+\-------------------------*/
+
+RecordingToolPainter::RecordingToolPainter()
+ { clear(); }
+
+void RecordingToolPainter::clear() {
+  myCalls.clear();
+  myPointSize = myLineWidth = 1;
+  myReach = 0;
+}
+
+void RecordingToolPainter::record( callType type, GLenum mode, GLfloat a,
+                                   GLfloat b, GLfloat c ) {
+  Call call;
+  call.type = type;
+  call.mode = mode;
+  call.a = a;  call.b = b;  call.c = c;
+  myCalls.push_back( call );
+}
+
+void RecordingToolPainter::vertex2f( GLfloat x, GLfloat y ) {
+  if ( myReach == 0 ) {
+    myMinX = myMaxX = x;
+    myMinY = myMaxY = y;
+  } else {
+    if ( x < myMinX ) myMinX = x;
+    if ( x > myMaxX ) myMaxX = x;
+    if ( y < myMinY ) myMinY = y;
+    if ( y > myMaxY ) myMaxY = y;
+  }
+   // half the widest point or line so far, and a pixel for rounding
+  GLfloat size = myPointSize > myLineWidth ? myPointSize : myLineWidth;
+  if ( size / 2 + 1 > myReach ) myReach = size / 2 + 1;
+  record( callVertex, 0, x, y );
+}
+
+void RecordingToolPainter::pointSize( GLfloat size ) {
+  myPointSize = size;
+  record( callPointSize, 0, size );
+}
+
+void RecordingToolPainter::lineWidth( GLfloat width ) {
+  myLineWidth = width;
+  record( callLineWidth, 0, width );
+}
+
+void RecordingToolPainter::replay( ToolPainter &painter ) const {
+  for (unsigned i=0; i<myCalls.size(); i++) {
+    const Call &call = myCalls[i];
+    switch ( call.type ) {
+      case callBegin       : painter.begin( call.mode );                break;
+      case callEnd         : painter.end();                             break;
+      case callColor       : painter.color3f( call.a, call.b, call.c ); break;
+      case callVertex      : painter.vertex2f( call.a, call.b );        break;
+      case callPointSize   : painter.pointSize( call.a );               break;
+      case callLineWidth   : painter.lineWidth( call.a );               break;
+      case callPointSmooth : painter.pointSmooth( call.mode );          break;
+    }
+  }
+}
+
+PixelRect RecordingToolPainter::bounds() const {
+  if ( myReach == 0 ) return PixelRect();
+  return PixelRect( (int)floor( myMinX - myReach ),
+                    (int)floor( myMinY - myReach ),
+                    (int)ceil( myMaxX + myReach ),
+                    (int)ceil( myMaxY + myReach ) );
+}
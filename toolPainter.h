@@ -0,0 +1,151 @@
+/*---------------------.
+| toolPainter.h         \______________________________
+|                                                      \
+| The drawing calls the canvas tools make, behind an   |
+| interface with two ends: one passes them on to       |
+| OpenGL, for the rubber-band outlines drawn while the |
+| mouse is held down, and one draws them into the      |
+| canvas's image, which holds the finished drawing.    |
+|                                                      |
+| A third end records the calls, so that the outline   |
+| can be drawn again without being worked out again.   |
+|                                                      |
+| Coordinates are the image's pixels, but OpenGL's way |
+| up, with y upwards from the bottom of the image.     |
+| The screen end is drawn through a modelview matrix   |
+| which puts the image where the canvas shows it.      |
+\_____________________________________________________*/
+
+
+#ifndef TOOLPAINTER_H
+#define TOOLPAINTER_H
+
+
+#include <qgl.h>
+#include <vector>
+
+#include "raster.h"
+#include "tileHistory.h"
+
+
+ /*
+ | The subset of OpenGL immediate mode the tools use.  begin() takes
+ | GL_POINTS, GL_LINES, GL_LINE_STRIP or GL_POLYGON.
+*/
+class ToolPainter {
+ public:
+  virtual ~ToolPainter() {}
+
+  virtual void begin( GLenum mode ) = 0;
+  virtual void end() = 0;
+  virtual void color3f( GLfloat red, GLfloat green, GLfloat blue ) = 0;
+  virtual void vertex2f( GLfloat x, GLfloat y ) = 0;
+  virtual void pointSize( GLfloat size ) = 0;
+  virtual void lineWidth( GLfloat width ) = 0;
+  virtual void pointSmooth( bool on ) = 0;   // round points, or square
+
+  void color3fv( const GLfloat *color )
+   { color3f( color[0], color[1], color[2] ); }
+};
+
+
+ /*
+ | Draw with OpenGL.  Point sizes and line widths are in the image's pixels,
+ | so they are scaled by the screen pixels each one covers.
+*/
+class GLToolPainter : public ToolPainter {
+ public:
+  GLToolPainter( GLfloat scale = 1.0 ) : myScale(scale) {}
+
+  void begin( GLenum mode )              { glBegin(mode); }
+  void end()                             { glEnd(); }
+  void color3f( GLfloat r, GLfloat g, GLfloat b ) { glColor3f(r, g, b); }
+  void vertex2f( GLfloat x, GLfloat y )  { glVertex2f(x, y); }
+  void pointSize( GLfloat size )         { glPointSize(size * myScale); }
+  void lineWidth( GLfloat width )        { glLineWidth(width * myScale); }
+  void pointSmooth( bool on )
+   { if ( on ) glEnable(GL_POINT_SMOOTH); else glDisable(GL_POINT_SMOOTH); }
+
+ protected:
+  GLfloat myScale;
+};
+
+
+ /*
+ | Draw into an image, a tile at a time, remembering the rectangle of it
+ | which has been drawn on.  If given a history, the painter touches each
+ | part of the image before drawing on it.
+*/
+class ImageToolPainter : public ToolPainter {
+ public:
+  ImageToolPainter( TiledImage &image, TileHistory *history = 0 );
+
+  void begin( GLenum mode );
+  void end();
+  void color3f( GLfloat red, GLfloat green, GLfloat blue );
+  void vertex2f( GLfloat x, GLfloat y );
+  void pointSize( GLfloat size )         { myPointSize = size; }
+  void lineWidth( GLfloat width )        { myLineWidth = width; }
+  void pointSmooth( bool on )            { myPointSmooth = on; }
+
+   // The part of the image drawn on so far.
+  PixelRect changed() const              { return myChanged; }
+
+ protected:
+  PixelRect rasterize( const ImageRows &tile,
+                       const std::vector<RasterVertex> &vertices ) const;
+
+  TiledImage  &myImage;
+  GLenum       myMode;
+  RasterVertex myColor;
+  std::vector<RasterVertex> myVertices;   // those since begin()
+  float        myPointSize, myLineWidth;
+  bool         myPointSmooth;
+  PixelRect    myChanged;
+  TileHistory *myHistory;
+};
+
+
+ /*
+ | Record the calls, to be replayed into another painter, and the rectangle
+ | they cover.
+*/
+class RecordingToolPainter : public ToolPainter {
+ public:
+  RecordingToolPainter();
+
+  void begin( GLenum mode )              { record( callBegin, mode ); }
+  void end()                             { record( callEnd ); }
+  void color3f( GLfloat red, GLfloat green, GLfloat blue )
+   { record( callColor, 0, red, green, blue ); }
+  void vertex2f( GLfloat x, GLfloat y );
+  void pointSize( GLfloat size );
+  void lineWidth( GLfloat width );
+  void pointSmooth( bool on )            { record( callPointSmooth, on ); }
+
+  void clear();
+  bool isEmpty() const                   { return myCalls.empty(); }
+  void replay( ToolPainter &painter ) const;
+
+   // The pixels the recorded drawing may cover, y upwards.
+  PixelRect bounds() const;
+
+ protected:
+  enum callType { callBegin, callEnd, callColor, callVertex, callPointSize,
+                  callLineWidth, callPointSmooth };
+  struct Call {
+    callType type;
+    GLenum   mode;
+    GLfloat  a, b, c;
+  };
+  void record( callType type, GLenum mode = 0, GLfloat a = 0, GLfloat b = 0,
+               GLfloat c = 0 );
+
+  std::vector<Call> myCalls;
+  GLfloat myPointSize, myLineWidth;
+  GLfloat myMinX, myMinY, myMaxX, myMaxY;   // of the vertices
+  GLfloat myReach;        // the furthest a point or line reaches past them
+};
+
+
+#endif
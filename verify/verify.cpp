@@ -0,0 +1,44 @@
+/*---------------------.
+| verify.cpp            \______________________________
+|                                                      \
+| The filters' checks (see verifySuite.h) as a         |
+| program of their own, with no QT or OpenGL.          |
+|                                                      |
+|   verify [--threads <n>] [--kernels <dir>]           |
+|          [images/ ...]                               |
+|                                                      |
+| The kernel files in the directory, kernels/ if none  |
+| is named, are checked to load.  The exit status is 1 |
+| if any check fails.  "make check" in the top         |
+| directory builds it and runs it on the sample images |
+| and kernels.                                         |
+\_____________________________________________________*/
+
+#include "verifySuite.h"
+#include "imageOps.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static bool isDirectory( const char *path ) {
+  struct stat status;
+  return stat( path, &status ) == 0 && S_ISDIR( status.st_mode );
+}
+
+int main( int argc, char **argv ) {
+  std::vector<std::string> paths;
+  std::string kernels = "kernels";
+  for (int i=1; i<argc; i++) {
+    if ( !strcmp( argv[i], "--threads" ) && i+1 < argc )
+      imageSetThreadCount( atoi( argv[++i] ) );
+    else if ( !strcmp( argv[i], "--kernels" ) && i+1 < argc )
+      kernels = argv[++i];
+    else
+      paths.push_back( argv[i] );
+  }
+  if ( paths.empty() && isDirectory( "images" ) )
+    paths.push_back( "images" );
+  int failures = verifyFilters( paths ) + verifyKernels( kernels );
+  return failures ? 1 : 0;
+}
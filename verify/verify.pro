@@ -0,0 +1,25 @@
+######################################################################
+# The filters' checks against the reference loops, a command-line
+# program with no dependence on QT or OpenGL.  "make check" in the top
+# directory builds it and runs it on the sample images and kernels.
+######################################################################
+
+TEMPLATE = app
+INCLUDEPATH += . .. ../imageOps
+TARGET = verify
+
+# Config
+CONFIG += console warn_on release thread
+CONFIG -= qt
+
+# Input
+HEADERS += verifySuite.h ../pngRows.h
+SOURCES += verify.cpp verifySuite.cpp ../pngRows.cpp
+
+# The image manipulation kernels, a static library of their own
+imageOps.target   = ../imageOps/libimageOps.a
+imageOps.commands = cd ../imageOps && $(QMAKE) imageOps.pro && $(MAKE)
+imageOps.depends  = FORCE
+QMAKE_EXTRA_UNIX_TARGETS += imageOps
+TARGETDEPS += ../imageOps/libimageOps.a
+LIBS += -L../imageOps -limageOps -lpng
@@ -0,0 +1,584 @@
+/*---------------------.
+| verifySuite.cpp       \______________________________
+|                                                      \
+| See the header of verifySuite.h for details.         |
+\_____________________________________________________*/
+
+#include "verifySuite.h"
+#include "imageOps.h"
+#include "filterChain.h"
+#include "tiledImage.h"
+#include "tileFile.h"
+#include "pngRows.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+ // fade() and intensify()'s degree by default, as the canvas's
+#define verifyDefaultFade   128
+
+ // made-up images are laid out with a few pixels between the rows, so that
+ // every path is run over a stride wider than the image
+#define verifyRowPadding    3
+
+ /*
+ | The filters which are checked.
+*/
+enum verifyKind { verifyConvolute, verifyFade, verifyIntensify,
+                  verifyInvert };
+
+struct verifyOperation {
+  const char      *name;
+  verifyKind       kind;
+  convolutionType  type;
+};
+
+static const verifyOperation verifyOperations[] = {
+  { "blur",        verifyConvolute, blur        },
+  { "sharpen",     verifyConvolute, sharpen     },
+  { "lapOfGauss",  verifyConvolute, lapOfGauss  },
+  { "edgeDetectX", verifyConvolute, edgeDetectX },
+  { "edgeDetectY", verifyConvolute, edgeDetectY },
+  { "sobel",       verifyConvolute, sobel       },
+  { "laplacian",   verifyConvolute, laplacian   },
+  { "laplacian2",  verifyConvolute, laplacian2  },
+  { "fade",        verifyFade,      fade        },
+  { "intensify",   verifyIntensify, intensify   },
+  { "invert",      verifyInvert,    fade        } };
+const int verifyOperationCount =
+  sizeof(verifyOperations) / sizeof(verifyOperations[0]);
+
+ // fade and intensify are checked at each of these degrees
+static const int verifyFadeDegrees[] = { 0, 64, verifyDefaultFade, 255 };
+const int verifyFadeDegreeCount =
+  sizeof(verifyFadeDegrees) / sizeof(verifyFadeDegrees[0]);
+
+ /*
+ | The ways a filter may be run: on the whole image, as a one-step chain, or
+ | a block of tiles at a time through a scratch file, each with an engine.
+ | The point operations do not depend on the engine, and are run on the
+ | paths with engineSimd alone.
+*/
+enum verifyRoute { routeDirect, routeChain, routeTiled };
+
+struct verifyPath {
+  const char        *name;
+  verifyRoute        route;
+  convolutionEngine  engine;
+};
+
+static const verifyPath verifyPaths[] = {
+  { "scalar",      routeDirect, engineScalar     },
+  { "simd",        routeDirect, engineSimd       },
+  { "fixed",       routeDirect, engineFixedPoint },
+  { "chain simd",  routeChain,  engineSimd       },
+  { "chain fixed", routeChain,  engineFixedPoint },
+  { "tiled simd",  routeTiled,  engineSimd       },
+  { "tiled fixed", routeTiled,  engineFixedPoint } };
+const int verifyPathCount = sizeof(verifyPaths) / sizeof(verifyPaths[0]);
+
+ /*
+ | An image to check the filters on, with its own copy of the pixels.
+*/
+struct verifyImage {
+  std::string           name;
+  int                   width, height;
+  std::vector<uint32_t> pixels;
+
+  verifyImage( const std::string &n, int w, int h )
+   : name(n), width(w), height(h),
+     pixels( (w + verifyRowPadding) * h ) {}
+
+  ImageRows rows() {
+    return ImageRows( &pixels[0], width, height, width + verifyRowPadding );
+  }
+};
+
+ /*
+ | How far a path's result is from the reference: the number of channels
+ | beyond the tolerance, the largest difference in any channel, and the
+ | first place a channel is beyond the tolerance.
+*/
+struct verifyDifference {
+  int      failures, worst;
+  int      x, y, channel;
+  uint32_t expected, got;
+};
+
+
+ /*
+ | Return the most a path's result may differ from the reference in any
+ | channel.  The tables of the point operations are exact, as are the
+ | scalar and fixed-point loops over the whole image and the vectorized loop
+ | with AVX2; the other engines round differently (see imageOps.h).
+*/
+static int tolerance( const verifyOperation &op, const verifyPath &path ) {
+  if ( op.kind != verifyConvolute ) return 0;
+  switch ( path.engine ) {
+    case engineSimd       : return strcmp( imageSimdLevel(), "avx2" ) ? 1 : 0;
+    case engineFixedPoint : return 1;
+    default               : return 0;
+  }
+}
+
+static void copyRows( const ImageRows &src, const ImageRows &dst ) {
+  for (int y=0; y<src.height; y++)
+    memcpy( dst.row(y), src.row(y), src.width * sizeof(uint32_t) );
+}
+
+static void runReference( const verifyOperation &op, const int fadeDegree,
+                          const ImageRows &src, const ImageRows &dst ) {
+  if ( op.kind == verifyConvolute ) {
+    referenceConvolute( src, dst, op.type );
+    return;
+  }
+  copyRows( src, dst );
+  switch ( op.kind ) {
+    case verifyFade      : referenceFade( dst, fadeDegree );      break;
+    case verifyIntensify : referenceIntensify( dst, fadeDegree ); break;
+    default              : referenceInvert( dst );                break;
+  }
+}
+
+static PointTable pointTable( const verifyOperation &op,
+                              const int fadeDegree ) {
+  switch ( op.kind ) {
+    case verifyFade      : return fadeTable( fadeDegree );
+    case verifyIntensify : return intensifyTable( fadeDegree );
+    default              : return invertTable();
+  }
+}
+
+ /*
+ | Run the filter over src into dst by the given path.  Return false, with
+ | the reason in error, if the path could not be run.
+*/
+static bool runPath( const verifyOperation &op, const verifyPath &path,
+                     const int fadeDegree, const ImageRows &src,
+                     const ImageRows &dst, std::string &error ) {
+  switch ( path.route ) {
+    case routeDirect :
+      if ( op.kind == verifyConvolute ) {
+        imageConvolute( src, dst, op.type, path.engine );
+        return true;
+      }
+      copyRows( src, dst );
+      switch ( op.kind ) {
+        case verifyFade      : imageFade( dst, fadeDegree );      break;
+        case verifyIntensify : imageIntensify( dst, fadeDegree ); break;
+        default              : imageInvert( dst );                break;
+      }
+      return true;
+
+    case routeChain : {
+      FilterChain chain;
+      if ( op.kind == verifyConvolute ) chain.addConvolution( op.type );
+      else chain.addTable( pointTable( op, fadeDegree ) );
+      chain.run( src, dst, path.engine );
+      return true;
+    }
+
+    case routeTiled : {
+      TiledImage image;
+      if ( !image.create( src.width, src.height, error ) ) return false;
+      image.write( image.rect(), src );
+      bool done = op.kind == verifyConvolute
+        ? tiledApply( image, ConvoluteTileFilter( op.type, path.engine ),
+                      error )
+        : tiledApply( image, PointTileFilter( pointTable( op, fadeDegree ) ),
+                      error );
+      if ( !done ) return false;
+      image.read( image.rect(), dst );
+      return true;
+    }
+  }
+  return false;
+}
+
+static verifyDifference compare( const ImageRows &expected,
+                                 const ImageRows &got, const int tolerance ) {
+  verifyDifference d;
+  d.failures = d.worst = 0;
+  d.x = d.y = d.channel = 0;
+  d.expected = d.got = 0;
+  for (int y=0; y<expected.height; y++)
+    for (int x=0; x<expected.width; x++) {
+      uint32_t a = expected.row(y)[x], b = got.row(y)[x];
+      if ( a == b ) continue;
+      for (int c=0; c<4; c++) {
+        int difference = (int)((a >> 8*c) & 0xff) - (int)((b >> 8*c) & 0xff);
+        if ( difference < 0 ) difference = -difference;
+        if ( difference > d.worst ) d.worst = difference;
+        if ( difference <= tolerance ) continue;
+        if ( d.failures++ == 0 ) {
+          d.x = x;  d.y = y;  d.channel = c;
+          d.expected = a;  d.got = b;
+        }
+      }
+    }
+  return d;
+}
+
+ /*
+ | Check every filter by every path on the image against the reference,
+ | printing each check which fails.  Return the number of checks run, and
+ | add the number which failed to failures.
+*/
+static int verifyOne( verifyImage &image, int &failures ) {
+  static const char *channels[] = { "blue", "green", "red", "alpha" };
+  ImageRows src = image.rows();
+  verifyImage expected( image.name, image.width, image.height );
+  verifyImage got( image.name, image.width, image.height );
+  int checks = 0, failed = 0, worst = 0;
+
+  for (int o=0; o<verifyOperationCount; o++) {
+    const verifyOperation &op = verifyOperations[o];
+    int degrees = op.kind == verifyFade || op.kind == verifyIntensify
+                    ? verifyFadeDegreeCount : 1;
+    for (int d=0; d<degrees; d++) {
+      int fadeDegree = verifyFadeDegrees[d];
+      runReference( op, fadeDegree, src, expected.rows() );
+
+      for (int p=0; p<verifyPathCount; p++) {
+        const verifyPath &path = verifyPaths[p];
+        if ( op.kind != verifyConvolute && path.engine != engineSimd )
+          continue;
+        std::string error;
+        checks++;
+        if ( !runPath( op, path, fadeDegree, src, got.rows(), error ) ) {
+          printf( "  FAILED %s / %s: %s\n", op.name, path.name,
+                  error.c_str() );
+          failed++;
+          continue;
+        }
+        int allowed = tolerance( op, path );
+        verifyDifference diff = compare( expected.rows(), got.rows(),
+                                         allowed );
+        if ( diff.worst > worst ) worst = diff.worst;
+        if ( !diff.failures ) continue;
+        failed++;
+        char name[64];
+        snprintf( name, sizeof(name), degrees > 1 ? "%s:%d" : "%s", op.name,
+                  fadeDegree );
+        printf( "  FAILED %s / %s: %d channels beyond %d, worst %d; first "
+                "at (%d,%d) %s, expected %08x got %08x\n", name,
+                path.name, diff.failures, allowed, diff.worst, diff.x, diff.y,
+                channels[ diff.channel ], diff.expected, diff.got );
+      }
+    }
+  }
+
+  char result[32];
+  snprintf( result, sizeof(result), failed ? "%d failed" : "all passed",
+            failed );
+  printf( "%-32s %4dx%-4d %3d checks, %s, largest difference %d\n",
+          image.name.c_str(), image.width, image.height, checks, result,
+          worst );
+  failures += failed;
+  return checks;
+}
+
+
+ /*
+ | Made-up images for the edge cases: solid colors, channels at 0 and 255,
+ | noise (alpha as well), and images 1 to 3 pixels across, which the
+ | convolutions must copy through and the vectorized loops must not read
+ | past.
+*/
+static void fillSolid( verifyImage &image, uint32_t color ) {
+  ImageRows rows = image.rows();
+  for (int y=0; y<rows.height; y++)
+    for (int x=0; x<rows.width; x++)
+      rows.row(y)[x] = color;
+}
+
+static void fillNoise( verifyImage &image, uint32_t seed, bool saturated ) {
+  ImageRows rows = image.rows();
+  for (int y=0; y<rows.height; y++)
+    for (int x=0; x<rows.width; x++) {
+      seed = seed * 1664525u + 1013904223u;
+      uint32_t pixel = seed;
+      if ( saturated ) {
+        pixel = 0xff000000u;
+        for (int c=0; c<3; c++)
+          if ( seed & (0x1000u << c) ) pixel |= 0xffu << 8*c;
+      }
+      rows.row(y)[x] = pixel;
+    }
+}
+
+static void makeEdgeCases( std::vector<verifyImage> &images ) {
+  static const struct { const char *name; uint32_t color; } solids[] = {
+    { "black", 0xff000000u }, { "white", 0xffffffffu },
+    { "gray",  0xff808080u }, { "red",   0xffff0000u },
+    { "green", 0xff00ff00u }, { "blue",  0xff0000ffu } };
+  for (unsigned i=0; i<sizeof(solids)/sizeof(solids[0]); i++) {
+    images.push_back( verifyImage( std::string( "solid " ) + solids[i].name,
+                                   37, 29 ) );
+    fillSolid( images.back(), solids[i].color );
+  }
+
+  images.push_back( verifyImage( "saturated channels", 64, 48 ) );
+  fillNoise( images.back(), 1, true );
+  images.push_back( verifyImage( "noise", 257, 131 ) );
+  fillNoise( images.back(), 2, false );
+
+  for (int w=1; w<=3; w++)
+    for (int h=1; h<=3; h++) {
+      images.push_back( verifyImage( "narrow", w, h ) );
+      fillNoise( images.back(), w*4 + h, false );
+    }
+  for (int n=1; n<=3; n++) {
+    images.push_back( verifyImage( "narrow", n, 40 ) );
+    fillNoise( images.back(), 100 + n, false );
+    images.push_back( verifyImage( "narrow", 40, n ) );
+    fillNoise( images.back(), 200 + n, false );
+  }
+}
+
+ /*
+ | Load the PNG file, or each PNG file in the directory, appending them to
+ | images.  Return false if a file could not be loaded.
+*/
+static bool loadImages( const std::string &path,
+                        std::vector<verifyImage> &images ) {
+  DIR *dir = opendir( path.c_str() );
+  if ( dir ) {
+    std::vector<std::string> files;
+    while ( struct dirent *entry = readdir( dir ) ) {
+      std::string name = entry->d_name;
+      if ( name.size() > 4 &&
+           !strcasecmp( name.c_str() + name.size() - 4, ".png" ) )
+        files.push_back( name );
+    }
+    closedir( dir );
+    std::sort( files.begin(), files.end() );
+    bool loaded = true;
+    for (unsigned i=0; i<files.size(); i++)
+      loaded = loadImages( path + "/" + files[i], images ) && loaded;
+    return loaded;
+  }
+
+  PngReader reader;
+  std::string error;
+  if ( !reader.open( path.c_str(), error ) ) {
+    fprintf( stderr, "%s: %s\n", path.c_str(), error.c_str() );
+    return false;
+  }
+  std::string name = path.substr( path.rfind( '/' ) + 1 );
+  images.push_back( verifyImage( name, reader.width(), reader.height() ) );
+  ImageRows rows = images.back().rows();
+  for (int y=0; y<rows.height; y++)
+    if ( !reader.readRow( rows.row(y), error ) ) {
+      fprintf( stderr, "%s: %s\n", path.c_str(), error.c_str() );
+      images.pop_back();
+      return false;
+    }
+  return true;
+}
+
+
+/*-------------------------\
+|    Opened session files  |
+\-------------------------*/
+
+ // the session checked, 32 MB of noise, which does not compress, so that
+ // each tile is mapped from the file
+#define verifySessionWidth   4096
+#define verifySessionHeight  2048
+
+static uint32_t sessionPixel( int x, int y ) {
+  uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+  return h * 2654435761u;
+}
+
+static void sessionRows( int x0, int y0, const ImageRows &rows ) {
+  for (int y=0; y<rows.height; y++)
+    for (int x=0; x<rows.width; x++)
+      rows.row(y)[x] = sessionPixel( x0 + x, y0 + y );
+}
+
+ // the memory the process holds, from /proc, or -1 where there is none
+static long long residentBytes() {
+  FILE *file = fopen( "/proc/self/statm", "r" );
+  if ( !file ) return -1;
+  long long size, resident;
+  bool read = fscanf( file, "%lld %lld", &size, &resident ) == 2;
+  fclose( file );
+  return read ? resident * sysconf( _SC_PAGESIZE ) : -1;
+}
+
+ /*
+ | Save a session, open it, its tiles mapped from the file, and invert it in
+ | place, checking that the result is right and that the memory held grows
+ | by no more than a few rows of tiles, not by the size of the image, as it
+ | would if the changed tiles were kept in memory.  Return false if not.
+*/
+static bool verifySession() {
+  const char *name = "opened session";
+  std::string error;
+  char filename[] = "/tmp/verifySessionXXXXXX";
+  int descriptor = mkstemp( filename );
+  if ( descriptor < 0 ) {
+    printf( "  FAILED %s: cannot make a file in /tmp\n", name );
+    return false;
+  }
+  close( descriptor );
+
+  TiledImage image;
+  bool done = image.create( verifySessionWidth, verifySessionHeight, error );
+  for (int row=0; done && row<image.tileRows(); row++) {
+    for (int column=0; column<image.tileColumns(); column++)
+      sessionRows( column * imageTileSize, row * imageTileSize,
+                   image.tileToWrite( column, row ) );
+    image.release( PixelRect( 0, row * imageTileSize, image.width(),
+                              (row+1) * imageTileSize ) );
+  }
+  std::string settings;
+  done = done && writeTileFile( image, filename, settings, true, error ) &&
+         readTileFile( filename, image, settings, error );
+  unlink( filename );
+  long long before = residentBytes();
+  done = done && tiledApply( image, PointTileFilter( invertTable() ), error );
+  long long after = residentBytes();
+  if ( !done ) {
+    printf( "  FAILED %s: %s\n", name, error.c_str() );
+    return false;
+  }
+
+  std::vector<uint32_t> expected( image.width() * imageTileSize );
+  std::vector<uint32_t> got( expected.size() );
+  for (int y0=0; y0<image.height(); y0+=imageTileSize) {
+    ImageRows e( &expected[0], image.width(), imageTileSize, image.width() );
+    ImageRows g( &got[0], image.width(), imageTileSize, image.width() );
+    sessionRows( 0, y0, e );
+    referenceInvert( e );
+    image.read( PixelRect( 0, y0, image.width(), y0 + imageTileSize ), g );
+    if ( expected != got ) {
+      printf( "  FAILED %s: inverted wrongly in rows %d to %d\n", name, y0,
+              y0 + imageTileSize );
+      return false;
+    }
+  }
+
+  long long limit = (long long)image.width() * image.height() *
+                    sizeof(uint32_t) / 4;
+  if ( before >= 0 && after >= 0 && after - before > limit ) {
+    printf( "  FAILED %s: inverting it held %lld MB more, over %lld MB\n",
+            name, ( after - before ) >> 20, limit >> 20 );
+    return false;
+  }
+  printf( "%-32s %4dx%-4d inverted, memory held %s%lld MB\n", name,
+          image.width(), image.height(), after >= before ? "+" : "",
+          ( after - before ) >> 20 );
+  return true;
+}
+
+
+int verifyFilters( const std::vector<std::string> &paths ) {
+  printf( "verifying against the reference loops, simd: %s, threads: %d\n",
+          imageSimdLevel(), imageThreadCount() );
+
+  std::vector<verifyImage> images;
+  int failures = 0;
+  for (unsigned i=0; i<paths.size(); i++)
+    if ( !loadImages( paths[i], images ) )
+      failures++;
+  makeEdgeCases( images );
+
+  int checks = 0;
+  for (unsigned i=0; i<images.size(); i++)
+    checks += verifyOne( images[i], failures );
+  checks++;
+  if ( !verifySession() ) failures++;
+
+  printf( "%d checks on %d images, %d failed\n", checks, (int)images.size(),
+          failures );
+  return failures;
+}
+
+
+/*-------------------------\
+|    Kernel files          |
+\-------------------------*/
+
+ /*
+ | Write a 101x101 kernel of made-up weights, nine decimals each, so that a
+ | row is over a thousand bytes, and check that it loads with them.
+*/
+static bool verifyLongLines() {
+  const int size = 101;
+  char filename[] = "/tmp/verifyKernelXXXXXX";
+  int descriptor = mkstemp( filename );
+  FILE *file = descriptor < 0 ? 0 : fdopen( descriptor, "w" );
+  if ( !file ) {
+    printf( "long lines: cannot write a kernel file\n" );
+    return false;
+  }
+  std::vector<double> written;
+  uint32_t seed = 12345;
+  for (int i=0; i<size*size; i++) {
+    seed = seed * 1103515245u + 12345u;
+    written.push_back( ( seed >> 8 ) / 16777216.0 - 0.5 );
+    fprintf( file, "%.9f%c", written.back(),
+             i % size == size-1 ? '\n' : ' ' );
+  }
+  fclose( file );
+
+  ConvolutionKernel kernel;
+  std::string error;
+  bool loaded = imageLoadKernel( filename, kernel, error );
+  unlink( filename );
+  if ( !loaded ) {
+    printf( "long lines: %s\n", error.c_str() );
+    return false;
+  }
+  if ( kernel.size != size ) {
+    printf( "long lines: loaded as %dx%d\n", kernel.size, kernel.size );
+    return false;
+  }
+  for (int i=0; i<size*size; i++)
+    if ( fabs( kernel.weights[i] - written[i] ) > 1e-6 ) {
+      printf( "long lines: weight %d is %.9f, written as %.9f\n", i,
+              kernel.weights[i], written[i] );
+      return false;
+    }
+  return true;
+}
+
+int verifyKernels( const std::string &directory ) {
+  std::vector<std::string> files;
+  if ( DIR *dir = opendir( directory.c_str() ) ) {
+    while ( struct dirent *entry = readdir( dir ) ) {
+      std::string name = entry->d_name;
+      if ( name.size() > 4 &&
+           !strcasecmp( name.c_str() + name.size() - 4, ".txt" ) )
+        files.push_back( name );
+    }
+    closedir( dir );
+  }
+  std::sort( files.begin(), files.end() );
+
+  int failures = verifyLongLines() ? 0 : 1;
+  for (unsigned i=0; i<files.size(); i++) {
+    ConvolutionKernel kernel;
+    std::string error;
+    if ( imageLoadKernel( ( directory + "/" + files[i] ).c_str(), kernel,
+                          error ) )
+      printf( "%-34s %3dx%-3d loaded\n", files[i].c_str(), kernel.size,
+              kernel.size );
+    else {
+      printf( "%-34s %s\n", files[i].c_str(), error.c_str() );
+      failures++;
+    }
+  }
+  printf( "%d kernel files and long lines, %d failed\n", (int)files.size(),
+          failures );
+  return failures;
+}
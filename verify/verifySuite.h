@@ -0,0 +1,37 @@
+/*---------------------.
+| verifySuite.h         \______________________________
+|                                                      \
+| Checks every faster path of the filters (the         |
+| vectorized and fixed-point engines, the filter chain |
+| and the tiled scratch-file path) against the         |
+| reference loops, on PNG images and on made-up edge   |
+| cases.  It uses imageOps alone, with no QT or        |
+| OpenGL, so it runs wherever the library builds: the  |
+| verify program (see verify.pro, "make check") runs   |
+| it, as does the window's --verify.                   |
+|                                                      |
+| Any difference beyond a filter's tolerance is        |
+| reported with the pixel and channel it is in.        |
+\_____________________________________________________*/
+
+
+#ifndef VERIFYSUITE_H
+#define VERIFYSUITE_H
+
+
+#include <string>
+#include <vector>
+
+
+ // Check the filters on the PNG files and directories of them named in
+ // paths, and on the edge cases, printing what is found.  Return the
+ // number of checks which failed.
+int verifyFilters( const std::vector<std::string> &paths );
+
+ // Check that each kernel file in the directory loads as a matrix of odd
+ // size, and that a made-up kernel with lines longer than any buffer reads
+ // back as it was written.  Return the number of checks which failed.
+int verifyKernels( const std::string &directory );
+
+
+#endif
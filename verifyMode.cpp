@@ -0,0 +1,39 @@
+/*---------------------.
+| verifyMode.cpp        \______________________________
+|                                                      \
+| See the header of verifyMode.h for details.          |
+\_____________________________________________________*/
+
+#include "verifyMode.h"
+#include "verifySuite.h"
+
+#include <qapplication.h>
+#include <qfileinfo.h>
+
+
+bool isVerifyCommand( int argc, char **argv )
+ { return argc > 1 && QString( argv[1] ) == "--verify"; }
+
+ /*
+ | Check the filters on the images and directories named on the command line
+ | (the sample images under images/ if none are), and on the edge cases, and
+ | the kernel files under kernels/ or the directory given with --kernels.
+*/
+int runVerify( int argc, char **argv ) {
+  QApplication app( argc, argv, FALSE );
+  std::vector<std::string> paths;
+  std::string kernels = "kernels";
+  for ( int i = 2; i < argc; i++ ) {
+    if ( QString( argv[i] ) == "--kernels" && i+1 < argc )
+      kernels = argv[++i];
+    else if ( ( QString( argv[i] ) == "--threads" ||
+           QString( argv[i] ) == "--trace" ) && i+1 < argc )
+      i++;   // already applied by main()
+    else
+      paths.push_back( argv[i] );
+  }
+  if ( paths.empty() && QFileInfo( "images" ).isDir() )
+    paths.push_back( "images" );
+  int failures = verifyFilters( paths ) + verifyKernels( kernels );
+  return failures ? 1 : 0;
+}
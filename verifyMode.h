@@ -0,0 +1,26 @@
+/*---------------------.
+| verifyMode.h          \______________________________
+|                                                      \
+| A headless command-line mode which runs the filters' |
+| checks (see verify/verifySuite.h) from the window's  |
+| program, on the machine and build it runs on.        |
+|                                                      |
+|   splatterBoardManip --verify [--kernels <dir>]      |
+|                               [images/ ...]          |
+|                                                      |
+| Any check which fails makes the exit status 1.       |
+\_____________________________________________________*/
+
+
+#ifndef VERIFYMODE_H
+#define VERIFYMODE_H
+
+
+ // Return true if the command line asks for the verify mode.
+bool isVerifyCommand( int argc, char **argv );
+
+ // Run the verify mode, returning the process exit status.
+int  runVerify( int argc, char **argv );
+
+
+#endif